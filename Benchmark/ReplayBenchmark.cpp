@@ -0,0 +1,423 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+#include "Server.hpp"
+#include "ServerBuilder.hpp"
+#include "ServerConfig.hpp"
+#include "ReverseProxy.hpp"
+#include "ServerUtils.hpp"
+
+// Replays recorded HTTP/1.1 requests against an in-process HTTPServer over
+// loopback connections (HTTPServer::openLoopback), so no TCP/IP stack is
+// involved, and reports what the server spends per request.
+//
+// The corpus holds one JSON object per line, whose "request" field is the raw
+// request, e.g. {"request": "GET /hello HTTP/1.1\r\nHost: x\r\n\r\n"}. Other
+// fields are ignored. Without a corpus, GET /hello is replayed.
+//
+// With --listen <address>, e.g. unix:/tmp/replay.sock or 127.0.0.1:9090, the
+// server listens there and the clients connect through it instead, to compare
+// Unix domain sockets with TCP over loopback.
+//
+// With --busy-poll <budget>, the corpus is replayed twice, against the default
+// worker loop and against busy-poll workers, and the latencies are compared.
+
+namespace
+{
+
+struct Options
+{
+    std::string corpus;
+    int connections{8};
+    int requests{20000};        // per connection
+    int pipeline{1};            // requests in flight per connection
+    int workers{4};
+    int busyPoll{0};            // spin budget in microseconds, 0 = default loop only
+    std::string listen;         // connect through this listener, empty = loopback socketpairs
+};
+
+struct RunResult
+{
+    uint64_t responses{0};
+    double wallSeconds{0};
+    double serverCpu{0};
+    double clientCpu{0};
+    std::vector<uint64_t> roundTrips;   // sorted
+    std::string error;
+
+    double percentile(double p) const
+    {
+        return roundTrips[std::min(roundTrips.size() - 1, static_cast<size_t>(p * roundTrips.size()))] / 1000.0;
+    }
+};
+
+struct ClientResult
+{
+    uint64_t responses{0};
+    double cpuSeconds{0};
+    std::vector<uint64_t> roundTrips;   // ns per pipelined batch
+    std::string error;
+};
+
+double cpuSeconds(clockid_t clock)
+{
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The string value of "field" in one JSON object, unescaped. Empty if absent.
+std::string jsonString(std::string_view line, std::string_view field)
+{
+    std::string key = "\"" + std::string(field) + "\"";
+    size_t pos = line.find(key);
+    if (pos == std::string_view::npos)
+        return std::string();
+    pos = line.find('"', line.find(':', pos + key.length()));
+    if (pos == std::string_view::npos)
+        return std::string();
+
+    std::string value;
+    for (size_t i = pos + 1; i < line.length(); i++)
+    {
+        char c = line[i];
+        if (c == '"')
+            return value;
+        if (c != '\\' || i + 1 == line.length())
+        {
+            value.push_back(c);
+            continue;
+        }
+
+        switch (char escaped = line[++i])
+        {
+        case 'n': value.push_back('\n'); break;
+        case 'r': value.push_back('\r'); break;
+        case 't': value.push_back('\t'); break;
+        case 'b': value.push_back('\b'); break;
+        case 'f': value.push_back('\f'); break;
+        case 'u':
+        {
+            // Requests are ASCII, anything wider is kept as UTF-8
+            unsigned code = std::stoul(std::string(line.substr(i + 1, 4)), nullptr, 16);
+            i += 4;
+            if (code < 0x80)
+                value.push_back(static_cast<char>(code));
+            else if (code < 0x800)
+            {
+                value.push_back(static_cast<char>(0xC0 | (code >> 6)));
+                value.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+            else
+            {
+                value.push_back(static_cast<char>(0xE0 | (code >> 12)));
+                value.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                value.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+            break;
+        }
+        default: value.push_back(escaped); break;
+        }
+    }
+    throw std::runtime_error("Unterminated string in corpus line");
+}
+
+std::vector<std::string> loadCorpus(const std::string& path)
+{
+    if (path.empty())
+        return { "GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n" };
+
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error("Cannot open corpus " + path);
+
+    std::vector<std::string> requests;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::string request = jsonString(line, "request");
+        if (!request.empty())
+            requests.push_back(std::move(request));
+    }
+    if (requests.empty())
+        throw std::runtime_error("No \"request\" entries in " + path);
+    return requests;
+}
+
+// One connection: send a batch, wait for all of its responses, repeat
+void runClient(int fd, const std::vector<std::string>& corpus, size_t offset,
+    const Options& options, ClientResult& result)
+{
+    double cpuStart = cpuSeconds(CLOCK_THREAD_CPUTIME_ID);
+    result.roundTrips.reserve(options.requests / options.pipeline + 1);
+
+    std::string batch;
+    std::vector<bool> headRequests;
+    char buffer[64 * 1024];
+    ResponseFramer framer;
+    size_t next = offset;
+
+    for (int sent = 0; sent < options.requests; )
+    {
+        batch.clear();
+        headRequests.clear();
+        for (int i = 0; i < options.pipeline && sent < options.requests; i++, sent++)
+        {
+            const std::string& request = corpus[next++ % corpus.size()];
+            batch.append(request);
+            headRequests.push_back(request.starts_with("HEAD "));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t written = 0; written < batch.length(); )
+        {
+            ssize_t n = send(fd, batch.data() + written, batch.length() - written, 0);
+            if (n <= 0)
+            {
+                result.error = std::string("send failed: ") + strerror(errno);
+                return;
+            }
+            written += n;
+        }
+
+        // Responses may straddle reads, the framer says where each one ends
+        size_t pending = 0;
+        std::string relayed;
+        framer.reset(headRequests[0]);
+        while (pending < headRequests.size())
+        {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0)
+            {
+                result.error = n == 0 ? "server closed the connection" : strerror(errno);
+                return;
+            }
+
+            size_t offsetInRead = 0;
+            while (offsetInRead < static_cast<size_t>(n) && pending < headRequests.size())
+            {
+                offsetInRead += framer.feed(buffer + offsetInRead, n - offsetInRead, relayed);
+                relayed.clear();
+                if (framer.failed() || framer.untilClose())
+                {
+                    result.error = "response without usable framing";
+                    return;
+                }
+                if (framer.complete())
+                {
+                    result.responses++;
+                    if (++pending < headRequests.size())
+                        framer.reset(headRequests[pending]);
+                }
+            }
+        }
+
+        result.roundTrips.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    result.cpuSeconds = cpuSeconds(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+}
+
+Options parseOptions(int argc, char* argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        if (i + 1 == argc)
+            throw std::invalid_argument("Missing value for " + arg);
+        std::string value(argv[++i]);
+
+        if (arg == "--corpus")
+            options.corpus = value;
+        else if (arg == "--connections")
+            options.connections = std::stoi(value);
+        else if (arg == "--requests")
+            options.requests = std::stoi(value);
+        else if (arg == "--pipeline")
+            options.pipeline = std::stoi(value);
+        else if (arg == "--workers")
+            options.workers = std::stoi(value);
+        else if (arg == "--busy-poll")
+            options.busyPoll = std::stoi(value);
+        else if (arg == "--listen")
+            options.listen = value;
+        else
+            throw std::invalid_argument("Unknown option " + arg);
+    }
+
+    if (options.connections < 1 || options.requests < 1 || options.pipeline < 1 || options.workers < 1)
+        throw std::invalid_argument("connections, requests, pipeline and workers must be positive");
+    if (options.busyPoll < 0)
+        throw std::invalid_argument("busy-poll must not be negative");
+    return options;
+}
+
+// A blocking client connection to one of the server's listeners
+int connectTo(const std::string& address)
+{
+    sockaddr_storage addr;
+    socklen_t length = server::utils::createSockAddr(address, addr);
+    int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&addr), length) < 0)
+    {
+        std::string error = strerror(errno);
+        if (fd >= 0)
+            close(fd);
+        throw std::runtime_error("Failed to connect to " + address + ": " + error);
+    }
+
+    if (addr.ss_family != AF_UNIX)
+    {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+// One server, one round of clients
+RunResult replay(const Options& options, const std::vector<std::string>& corpus, int busyPollBudget)
+{
+    // Without --listen, the listener is bound to an ephemeral port and never used
+    ServerConfig config;
+    config.port = 0;
+    if (!options.listen.empty())
+        config.listeners.push_back(ServerConfig::ListenerConfig{options.listen});
+    config.workers = options.workers;
+    config.maxEvents = 1024;
+    if (busyPollBudget > 0)
+    {
+        config.busyPoll = true;
+        config.busyPollBudget = busyPollBudget;
+    }
+
+    auto server = ServerBuilder(config)
+        .route("/hello", Method::GET, [](const Request&)
+        {
+            Response res(StatusCode::Ok);
+            res.setContent("Hello, Optiver!");
+            return res;
+        })
+        .build();
+    server->start();
+
+    std::vector<int> fds;
+    for (int i = 0; i < options.connections; i++)
+        fds.push_back(options.listen.empty() ? server->openLoopback() : connectTo(options.listen));
+
+    std::vector<ClientResult> results(options.connections);
+    std::vector<std::thread> clients;
+
+    double processStart = cpuSeconds(CLOCK_PROCESS_CPUTIME_ID);
+    auto wallStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.connections; i++)
+        clients.emplace_back(runClient, fds[i], std::cref(corpus), static_cast<size_t>(i), std::cref(options),
+            std::ref(results[i]));
+    for (std::thread& client : clients)
+        client.join();
+
+    RunResult run;
+    run.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    double processCpu = cpuSeconds(CLOCK_PROCESS_CPUTIME_ID) - processStart;
+
+    for (int fd : fds)
+        close(fd);
+    server->stop();
+
+    for (const ClientResult& result : results)
+    {
+        if (!result.error.empty())
+        {
+            run.error = result.error;
+            return run;
+        }
+        run.responses += result.responses;
+        run.clientCpu += result.cpuSeconds;
+        run.roundTrips.insert(run.roundTrips.end(), result.roundTrips.begin(), result.roundTrips.end());
+    }
+    std::sort(run.roundTrips.begin(), run.roundTrips.end());
+
+    // Everything but the client threads: workers, acceptor and their idle polling
+    run.serverCpu = std::max(0.0, processCpu - run.clientCpu);
+    return run;
+}
+
+void report(const std::string& label, const RunResult& run)
+{
+    std::cout << label << "\n"
+        << "  Throughput:  " << static_cast<uint64_t>(run.responses / run.wallSeconds) << " requests/s\n"
+        << "  Server CPU:  " << static_cast<uint64_t>(run.serverCpu * 1e9 / run.responses) << " ns/request\n"
+        << "  Client CPU:  " << static_cast<uint64_t>(run.clientCpu * 1e9 / run.responses) << " ns/request\n"
+        << "  Round trip:  p50 " << run.percentile(0.5) << " us, p99 " << run.percentile(0.99)
+        << " us, max " << run.roundTrips.back() / 1000.0 << " us\n";
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    std::vector<std::string> corpus;
+    try
+    {
+        options = parseOptions(argc, argv);
+        corpus = loadCorpus(options.corpus);
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << ex.what() << "\n"
+            << "Usage: " << argv[0] << " [--corpus <file.jsonl>] [--connections <n>] [--requests <n per connection>]"
+            << " [--pipeline <n>] [--workers <n>] [--busy-poll <spin budget us>] [--listen <address>]\n";
+        return 1;
+    }
+
+    spdlog::set_level(spdlog::level::warn);
+
+    std::vector<std::pair<std::string, RunResult>> runs;
+    runs.emplace_back("Default worker loop", replay(options, corpus, 0));
+    if (options.busyPoll > 0)
+    {
+        runs.emplace_back("Busy-poll workers, spin budget up to " + std::to_string(options.busyPoll) + " us",
+            replay(options, corpus, options.busyPoll));
+    }
+
+    for (const auto& [label, run] : runs)
+    {
+        if (!run.error.empty())
+        {
+            std::cerr << label << ": client failed: " << run.error << "\n";
+            return 1;
+        }
+    }
+
+    std::cout << "Replayed " << runs[0].second.responses << " requests (" << corpus.size() << " distinct) over "
+        << options.connections << (options.listen.empty() ? " loopback" : " " + options.listen)
+        << " connections, pipeline " << options.pipeline
+        << ", " << options.workers << " workers\n";
+    for (const auto& [label, run] : runs)
+        report(label, run);
+
+    if (runs.size() == 2)
+    {
+        const RunResult& base = runs[0].second;
+        const RunResult& busy = runs[1].second;
+        std::cout << "Busy-poll vs default: p50 " << busy.percentile(0.5) - base.percentile(0.5)
+            << " us, p99 " << busy.percentile(0.99) - base.percentile(0.99) << " us, server CPU "
+            << static_cast<int64_t>((busy.serverCpu / busy.responses - base.serverCpu / base.responses) * 1e9)
+            << " ns/request\n";
+    }
+    return 0;
+}
\ No newline at end of file
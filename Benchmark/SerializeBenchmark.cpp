@@ -0,0 +1,150 @@
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "HTTPUtils.hpp"
+#include "Response.hpp"
+
+// Times HTTP/1.1 response serialization into a reused output buffer, as a
+// worker does into a connection's output, for a few typical responses:
+//
+//  - strings: the serializer before pre-rendered status lines, which built
+//    the status line from toString() strings and Content-Length with
+//    std::to_string, and sent no Date header
+//  - strings + Date: the same, formatting a Date header for every response
+//  - appendResponse: the current serializer, pre-rendered status lines, the
+//    cached Date line and Content-Length written in place
+
+namespace
+{
+
+// Keeps the serialization loops from being optimized away
+volatile size_t s_sink = 0;
+
+void appendWithStrings(std::string& out, const Response& response, bool sendBody, bool withDate)
+{
+    size_t size = 64 + (sendBody ? response.content().length() : 0);
+    for (const auto& p : response.headers())
+        size += p.first.length() + p.second.length() + 4;
+    out.reserve(out.length() + size);
+
+    out.append(http::utils::toString(response.version())).append(" ");
+    out.append(std::to_string(static_cast<int>(response.statusCode()))).append(" ");
+    out.append(http::utils::toString(response.statusCode())).append("\r\n");
+    if (withDate)
+        out.append("Date: ").append(http::utils::formatHttpDate(std::time(nullptr))).append("\r\n");
+    if (sendBody)
+        out.append("Content-Length: ").append(std::to_string(response.contentLength())).append("\r\n");
+    for (const auto& p : response.headers())
+        out.append(p.first).append(": ").append(p.second).append("\r\n");
+    out.append("\r\n");
+    if (sendBody)
+        out.append(response.content());
+}
+
+struct Sample
+{
+    std::string label;
+    Response response;
+    bool sendBody;
+};
+
+std::vector<Sample> makeSamples()
+{
+    std::vector<Sample> samples;
+
+    Response hello(StatusCode::Ok);
+    hello.setContent("Hello, Optiver!");
+    samples.push_back({"200, 15 byte body", hello, true});
+
+    Response json(StatusCode::Ok);
+    json.setHeader("Content-Type", "application/json");
+    json.setHeader("Cache-Control", "max-age=60");
+    json.setHeader("ETag", "\"1000-9c0a5e31d2b4f817\"");
+    json.setHeader("Last-Modified", "Sun, 06 Nov 1994 08:49:37 GMT");
+    json.setHeader("Accept-Ranges", "bytes");
+    json.setHeader("Vary", "Accept-Encoding");
+    json.setContent(std::string(4096, 'x'));
+    samples.push_back({"200, 6 headers, 4 KB body", json, true});
+
+    Response notModified(StatusCode::NotModified);
+    notModified.setHeader("ETag", "\"1000-9c0a5e31d2b4f817\"");
+    samples.push_back({"304", notModified, false});
+
+    Response notFound(StatusCode::NotFound);
+    samples.push_back({"404, empty", notFound, true});
+
+    return samples;
+}
+
+// Nanoseconds per response
+template<typename Serialize>
+double measure(const Response& response, int iterations, Serialize serialize)
+{
+    std::string out;
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        out.clear();
+        serialize(out, response);
+        total += out.length();
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    s_sink = total;
+    return elapsed / iterations;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 2000000;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg(argv[i]);
+            if (arg == "--iterations" && i + 1 < argc)
+                iterations = std::stoi(argv[++i]);
+            else
+                throw std::invalid_argument("Unknown option " + arg);
+        }
+        if (iterations < 1)
+            throw std::invalid_argument("iterations must be positive");
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << ex.what() << "\nUsage: " << argv[0] << " [--iterations <n per response>]\n";
+        return 1;
+    }
+
+    std::cout << "ns per response, " << iterations << " iterations each\n";
+    for (const Sample& sample : makeSamples())
+    {
+        bool sendBody = sample.sendBody;
+        double strings = measure(sample.response, iterations, [sendBody](std::string& out, const Response& response)
+        {
+            appendWithStrings(out, response, sendBody, false);
+        });
+        double stringsWithDate = measure(sample.response, iterations, [sendBody](std::string& out, const Response& response)
+        {
+            appendWithStrings(out, response, sendBody, true);
+        });
+        double current = measure(sample.response, iterations, [sendBody](std::string& out, const Response& response)
+        {
+            http::utils::appendResponse(out, response, sendBody);
+        });
+
+        std::cout << "  " << sample.label << ":\n"
+            << "    strings:         " << strings << "\n"
+            << "    strings + Date:  " << stringsWithDate << "\n"
+            << "    appendResponse:  " << current << " (with Date)\n";
+    }
+    return 0;
+}
\ No newline at end of file
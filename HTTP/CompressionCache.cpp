@@ -0,0 +1,56 @@
+#include "CompressionCache.hpp"
+#include "CompressionUtils.hpp"
+
+std::string CompressionCache::compress(std::string_view content, ContentEncoding encoding,
+    const http::utils::Sha256Digest* digest)
+{
+    // It would evict everything else and still not fit, not worth hashing
+    if (content.length() > m_shardCapacity)
+    {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return http::utils::compress(content, encoding, http::utils::CompressionLevel::Fast);
+    }
+
+    Key key{digest ? *digest : http::utils::sha256(content), encoding};
+    Shard& shard = m_shards[KeyHash{}(key) % kShards];
+
+    std::shared_ptr<const std::string> compressed;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (auto it = shard.index.find(key); it != shard.index.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            compressed = it->second->compressed;
+        }
+    }
+    if (compressed)
+    {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return *compressed;
+    }
+
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    compressed = std::make_shared<const std::string>(
+        http::utils::compress(content, encoding, http::utils::CompressionLevel::Best));
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // Another worker may have raced us to the same payload, keep theirs
+    if (shard.index.contains(key))
+        return *compressed;
+
+    shard.lru.push_front({key, compressed});
+    shard.index.emplace(key, shard.lru.begin());
+    shard.bytes += compressed->length();
+    m_bytes.fetch_add(compressed->length(), std::memory_order_relaxed);
+
+    while (shard.bytes > m_shardCapacity)
+    {
+        const Entry& victim = shard.lru.back();
+        shard.bytes -= victim.compressed->length();
+        m_bytes.fetch_sub(victim.compressed->length(), std::memory_order_relaxed);
+        m_evictions.fetch_add(1, std::memory_order_relaxed);
+        shard.index.erase(victim.key);
+        shard.lru.pop_back();
+    }
+    return *compressed;
+}
\ No newline at end of file
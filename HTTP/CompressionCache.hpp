@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "Enum.hpp"
+#include "HTTPUtils.hpp"
+
+// Compressed variants of cacheable bodies, shared by all workers.
+// Hot payloads are compressed once (at the best level) instead of per request,
+// and the least recently used variants are evicted to stay within capacity.
+class CompressionCache
+{
+private:
+    static constexpr size_t kDefaultCapacity = 64 * 1024 * 1024;
+    static constexpr size_t kShards = 16;
+
+    // A body is identified by its SHA-256, so a body crafted to collide with
+    // another can never be served the other's compressed bytes
+    struct Key
+    {
+        http::utils::Sha256Digest digest;
+        ContentEncoding encoding;
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            size_t hash;
+            std::memcpy(&hash, key.digest.data(), sizeof(hash));
+            return hash * 31 + static_cast<size_t>(key.encoding);
+        }
+    };
+
+    struct Entry
+    {
+        Key key;
+        std::shared_ptr<const std::string> compressed;
+    };
+
+    // Most recently used first, each shard under its own lock
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        std::list<Entry> lru;
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        size_t bytes{0};
+    };
+
+    std::array<Shard, kShards> m_shards;
+    size_t m_shardCapacity;
+
+    std::atomic<size_t> m_hits{0};
+    std::atomic<size_t> m_misses{0};
+    std::atomic<size_t> m_evictions{0};
+    std::atomic<size_t> m_bytes{0};
+
+public:
+    explicit CompressionCache(size_t capacity = kDefaultCapacity) : m_shardCapacity(capacity / kShards) {}
+
+    // Returns the compressed body, compressing and caching it on a miss.
+    // digest is the SHA-256 of content if the caller already knows it,
+    // nullptr to compute it here. Bodies too large to cache are compressed
+    // at the fast level every time.
+    std::string compress(std::string_view content, ContentEncoding encoding,
+        const http::utils::Sha256Digest* digest = nullptr);
+
+    size_t hits() const { return m_hits.load(std::memory_order_relaxed); }
+    size_t misses() const { return m_misses.load(std::memory_order_relaxed); }
+    size_t evictions() const { return m_evictions.load(std::memory_order_relaxed); }
+    size_t bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+};
\ No newline at end of file
@@ -43,11 +43,22 @@ enum class StatusCode
     NotFound = 404,
     MethodNotAllowed = 405,
     RequestTimeout = 408,
+    RangeNotSatisfiable = 416,
     ImATeapot = 418,
+    TooManyRequests = 429,
     InternalServerError = 500,
     NotImplemented = 501,
     BadGateway = 502,
     ServiceUnvailable = 503,
     GatewayTimeout = 504,
     HttpVersionNotSupported = 505
+};
+
+enum class ContentEncoding
+{
+    Identity,
+    Gzip,
+    Deflate,
+    Brotli,
+    Zstd
 };
\ No newline at end of file
@@ -0,0 +1,469 @@
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "HPACK.hpp"
+
+namespace
+{
+
+const std::array<HeaderField, HPACKTable::kStaticSize> kStaticTable = {{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""}
+}};
+
+// Huffman code length of each symbol (RFC 7541, Appendix B), 256 = EOS.
+// The code is canonical, so the codes themselves are rebuilt from the lengths.
+constexpr std::array<uint8_t, 257> kHuffmanLengths = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30
+};
+
+constexpr int kMaxCodeLength = 30;
+
+struct HuffmanTable
+{
+    uint32_t codes[257];
+    uint32_t firstCode[kMaxCodeLength + 1]{};   // first canonical code of each length
+    uint16_t firstIndex[kMaxCodeLength + 1]{};  // its position in symbols[]
+    uint16_t count[kMaxCodeLength + 1]{};
+    uint16_t symbols[257];                      // sorted by (length, symbol)
+
+    HuffmanTable()
+    {
+        for (int i = 0; i < 257; i++)
+            symbols[i] = i;
+        std::stable_sort(symbols, symbols + 257, [](uint16_t a, uint16_t b)
+        {
+            return kHuffmanLengths[a] < kHuffmanLengths[b];
+        });
+
+        uint32_t code = 0;
+        int length = kHuffmanLengths[symbols[0]];
+        for (int i = 0; i < 257; i++)
+        {
+            int symbolLength = kHuffmanLengths[symbols[i]];
+            if (i > 0)
+                code = (code + 1) << (symbolLength - length);
+            length = symbolLength;
+
+            if (count[length]++ == 0)
+            {
+                firstCode[length] = code;
+                firstIndex[length] = i;
+            }
+            codes[symbols[i]] = code;
+        }
+    }
+};
+
+const HuffmanTable kHuffman;
+
+const std::unordered_map<std::string_view, size_t>& staticNameIndex()
+{
+    static const std::unordered_map<std::string_view, size_t> index = []
+    {
+        std::unordered_map<std::string_view, size_t> map;
+        for (size_t i = 0; i < kStaticTable.size(); i++)
+            map.emplace(kStaticTable[i].first, i + 1);   // keeps the first index per name
+        return map;
+    }();
+    return index;
+}
+
+size_t decodeInteger(const uint8_t*& p, const uint8_t* end, int prefixBits)
+{
+    if (p >= end)
+        throw std::invalid_argument("HPACK integer truncated");
+
+    size_t mask = (1u << prefixBits) - 1;
+    size_t value = *p++ & mask;
+    if (value < mask)
+        return value;
+
+    for (int shift = 0; ; shift += 7)
+    {
+        if (p >= end || shift > 28)
+            throw std::invalid_argument("HPACK integer overflow");
+        uint8_t byte = *p++;
+        value += size_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+}
+
+void encodeInteger(std::string& out, uint8_t firstByte, int prefixBits, size_t value)
+{
+    size_t mask = (1u << prefixBits) - 1;
+    if (value < mask)
+    {
+        out.push_back(static_cast<char>(firstByte | value));
+        return;
+    }
+
+    out.push_back(static_cast<char>(firstByte | mask));
+    value -= mask;
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+std::string huffmanDecode(const uint8_t* p, size_t length)
+{
+    std::string out;
+    out.reserve(length * 8 / 5);
+
+    uint32_t code = 0;
+    int codeLength = 0;
+    for (const uint8_t* end = p + length; p < end; p++)
+    {
+        for (int bit = 7; bit >= 0; bit--)
+        {
+            code = (code << 1) | ((*p >> bit) & 1);
+            codeLength++;
+
+            uint32_t offset = code - kHuffman.firstCode[codeLength];
+            if (kHuffman.count[codeLength] != 0 && code >= kHuffman.firstCode[codeLength]
+                && offset < kHuffman.count[codeLength])
+            {
+                uint16_t symbol = kHuffman.symbols[kHuffman.firstIndex[codeLength] + offset];
+                if (symbol == 256)
+                    throw std::invalid_argument("HPACK string contains EOS");
+                out.push_back(static_cast<char>(symbol));
+                code = 0;
+                codeLength = 0;
+            }
+            else if (codeLength == kMaxCodeLength)
+                throw std::invalid_argument("Invalid HPACK Huffman code");
+        }
+    }
+
+    // Padding must be a prefix of EOS (all ones) and shorter than a byte
+    if (codeLength > 7 || code != (1u << codeLength) - 1)
+        throw std::invalid_argument("Invalid HPACK Huffman padding");
+    return out;
+}
+
+size_t huffmanLength(std::string_view string)
+{
+    size_t bits = 0;
+    for (unsigned char c : string)
+        bits += kHuffmanLengths[c];
+    return (bits + 7) / 8;
+}
+
+void huffmanEncode(std::string& out, std::string_view string)
+{
+    uint64_t buffer = 0;
+    int bits = 0;
+    for (unsigned char c : string)
+    {
+        buffer = (buffer << kHuffmanLengths[c]) | kHuffman.codes[c];
+        bits += kHuffmanLengths[c];
+        while (bits >= 8)
+        {
+            bits -= 8;
+            out.push_back(static_cast<char>(buffer >> bits));
+        }
+    }
+
+    // Pad with the most significant bits of EOS
+    if (bits > 0)
+        out.push_back(static_cast<char>((buffer << (8 - bits)) | (0xff >> bits)));
+}
+
+std::string decodeString(const uint8_t*& p, const uint8_t* end)
+{
+    if (p >= end)
+        throw std::invalid_argument("HPACK string truncated");
+
+    bool huffman = *p & 0x80;
+    size_t length = decodeInteger(p, end, 7);
+    if (length > size_t(end - p))
+        throw std::invalid_argument("HPACK string truncated");
+
+    std::string string = huffman
+        ? huffmanDecode(p, length)
+        : std::string(reinterpret_cast<const char*>(p), length);
+    p += length;
+    return string;
+}
+
+void encodeString(std::string& out, std::string_view string)
+{
+    size_t compressed = huffmanLength(string);
+    if (compressed < string.length())
+    {
+        encodeInteger(out, 0x80, 7, compressed);
+        huffmanEncode(out, string);
+    }
+    else
+    {
+        encodeInteger(out, 0x00, 7, string.length());
+        out.append(string);
+    }
+}
+
+}
+
+const HeaderField* HPACKTable::get(size_t index) const
+{
+    if (index == 0)
+        return nullptr;
+    if (index <= kStaticSize)
+        return &kStaticTable[index - 1];
+    if (index - kStaticSize <= m_entries.size())
+        return &m_entries[index - kStaticSize - 1];
+    return nullptr;
+}
+
+void HPACKTable::evict(size_t limit)
+{
+    while (m_size > limit && !m_entries.empty())
+    {
+        const HeaderField& oldest = m_entries.back();
+        m_size -= oldest.first.length() + oldest.second.length() + kEntryOverhead;
+        m_entries.pop_back();
+    }
+}
+
+void HPACKTable::insert(std::string name, std::string value)
+{
+    size_t entrySize = name.length() + value.length() + kEntryOverhead;
+
+    // An entry larger than the table empties it and is not stored
+    if (entrySize > m_maxSize)
+    {
+        evict(0);
+        return;
+    }
+
+    evict(m_maxSize - entrySize);
+    m_entries.emplace_front(std::move(name), std::move(value));
+    m_size += entrySize;
+}
+
+void HPACKTable::setMaxSize(size_t size)
+{
+    m_maxSize = size;
+    evict(m_maxSize);
+}
+
+size_t HPACKTable::find(std::string_view name, std::string_view value, bool& exact) const
+{
+    size_t nameMatch = 0;
+    exact = false;
+
+    const auto& names = staticNameIndex();
+    if (auto it = names.find(name); it != names.end())
+    {
+        nameMatch = it->second;
+        for (size_t i = it->second; i <= kStaticSize && kStaticTable[i - 1].first == name; i++)
+        {
+            if (kStaticTable[i - 1].second == value)
+            {
+                exact = true;
+                return i;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        if (m_entries[i].first != name)
+            continue;
+        if (m_entries[i].second == value)
+        {
+            exact = true;
+            return kStaticSize + i + 1;
+        }
+        if (nameMatch == 0)
+            nameMatch = kStaticSize + i + 1;
+    }
+    return nameMatch;
+}
+
+std::vector<HeaderField> HPACKDecoder::decode(const uint8_t* data, size_t length)
+{
+    std::vector<HeaderField> headers;
+    const uint8_t* p = data;
+    const uint8_t* end = data + length;
+    bool fieldSeen = false;
+
+    while (p < end)
+    {
+        uint8_t byte = *p;
+
+        // Indexed header field
+        if (byte & 0x80)
+        {
+            const HeaderField* field = m_table.get(decodeInteger(p, end, 7));
+            if (field == nullptr)
+                throw std::invalid_argument("HPACK index out of range");
+            headers.push_back(*field);
+            fieldSeen = true;
+            continue;
+        }
+
+        // Dynamic table size update, only allowed before the first field
+        if ((byte & 0xe0) == 0x20)
+        {
+            size_t size = decodeInteger(p, end, 5);
+            if (fieldSeen || size > m_maxTableSize)
+                throw std::invalid_argument("Invalid HPACK table size update");
+            m_table.setMaxSize(size);
+            continue;
+        }
+
+        // Literal: with incremental indexing (01), without indexing (0000) or never indexed (0001)
+        bool indexed = (byte & 0xc0) == 0x40;
+        size_t nameIndex = decodeInteger(p, end, indexed ? 6 : 4);
+
+        std::string name;
+        if (nameIndex == 0)
+            name = decodeString(p, end);
+        else
+        {
+            const HeaderField* field = m_table.get(nameIndex);
+            if (field == nullptr)
+                throw std::invalid_argument("HPACK index out of range");
+            name = field->first;
+        }
+        std::string value = decodeString(p, end);
+
+        if (indexed)
+            m_table.insert(name, value);
+        headers.emplace_back(std::move(name), std::move(value));
+        fieldSeen = true;
+    }
+
+    return headers;
+}
+
+void HPACKEncoder::setMaxTableSize(size_t size)
+{
+    // We never need more than the default, a smaller peer limit is honoured
+    size = std::min(size, k_hpackDefaultTableSize);
+    if (size != m_table.maxSize())
+    {
+        m_table.setMaxSize(size);
+        m_sizeUpdatePending = true;
+    }
+}
+
+void HPACKEncoder::encode(const std::vector<HeaderField>& headers, std::string& out)
+{
+    if (m_sizeUpdatePending)
+    {
+        encodeInteger(out, 0x20, 5, m_table.maxSize());
+        m_sizeUpdatePending = false;
+    }
+
+    for (const auto& [name, value] : headers)
+    {
+        bool exact;
+        size_t index = m_table.find(name, value, exact);
+        if (exact)
+        {
+            encodeInteger(out, 0x80, 7, index);
+            continue;
+        }
+
+        // Credentials are never indexed, per-response values would only churn the table
+        bool sensitive = name == "set-cookie" || name == "authorization" || name == "cookie";
+        bool volatileValue = name == "content-length" || name == "date"
+            || name == "etag" || name == "last-modified" || name == "content-range";
+
+        if (sensitive)
+            encodeInteger(out, 0x10, 4, index);
+        else if (volatileValue)
+            encodeInteger(out, 0x00, 4, index);
+        else
+        {
+            encodeInteger(out, 0x40, 6, index);
+            m_table.insert(name, value);
+        }
+
+        if (index == 0)
+            encodeString(out, name);
+        encodeString(out, value);
+    }
+}
\ No newline at end of file
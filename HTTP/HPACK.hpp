@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// HPACK header compression for HTTP/2 (RFC 7541)
+
+using HeaderField = std::pair<std::string, std::string>;
+
+constexpr size_t k_hpackDefaultTableSize = 4096;
+
+// Static + per-connection dynamic table. Indices are 1-based across both
+class HPACKTable
+{
+private:
+    static constexpr size_t kEntryOverhead = 32;
+
+    std::deque<HeaderField> m_entries;  // newest first
+    size_t m_size{0};
+    size_t m_maxSize{k_hpackDefaultTableSize};
+
+    void evict(size_t limit);
+
+public:
+    static constexpr size_t kStaticSize = 61;
+
+    const HeaderField* get(size_t index) const;
+    void insert(std::string name, std::string value);
+    void setMaxSize(size_t size);
+    size_t maxSize() const { return m_maxSize; }
+
+    // Index of an exact name/value match, else of a name-only match, else 0
+    size_t find(std::string_view name, std::string_view value, bool& exact) const;
+};
+
+class HPACKDecoder
+{
+private:
+    HPACKTable m_table;
+    size_t m_maxTableSize{k_hpackDefaultTableSize};   // our SETTINGS_HEADER_TABLE_SIZE
+
+public:
+    // Decode one complete header block, throws std::invalid_argument on a
+    // compression error (which is fatal for the connection)
+    std::vector<HeaderField> decode(const uint8_t* data, size_t length);
+};
+
+class HPACKEncoder
+{
+private:
+    HPACKTable m_table;
+    bool m_sizeUpdatePending{false};
+
+public:
+    // Peer's SETTINGS_HEADER_TABLE_SIZE, signalled at the start of the next block
+    void setMaxTableSize(size_t size);
+    void encode(const std::vector<HeaderField>& headers, std::string& out);
+};
\ No newline at end of file
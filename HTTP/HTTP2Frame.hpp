@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// HTTP/2 framing layer (RFC 9113, section 4 and 6)
+
+constexpr size_t k_http2FrameHeaderSize = 9;
+constexpr uint32_t k_http2DefaultWindowSize = 65535;
+constexpr uint32_t k_http2DefaultMaxFrameSize = 16384;
+constexpr uint32_t k_http2MaxWindowSize = 0x7fffffff;
+
+enum class FrameType : uint8_t
+{
+    Data = 0x0,
+    Headers = 0x1,
+    Priority = 0x2,
+    RstStream = 0x3,
+    Settings = 0x4,
+    PushPromise = 0x5,
+    Ping = 0x6,
+    GoAway = 0x7,
+    WindowUpdate = 0x8,
+    Continuation = 0x9
+};
+
+namespace FrameFlag
+{
+    constexpr uint8_t EndStream = 0x1;
+    constexpr uint8_t Ack = 0x1;
+    constexpr uint8_t EndHeaders = 0x4;
+    constexpr uint8_t Padded = 0x8;
+    constexpr uint8_t Priority = 0x20;
+}
+
+enum class SettingId : uint16_t
+{
+    HeaderTableSize = 0x1,
+    EnablePush = 0x2,
+    MaxConcurrentStreams = 0x3,
+    InitialWindowSize = 0x4,
+    MaxFrameSize = 0x5,
+    MaxHeaderListSize = 0x6
+};
+
+enum class HTTP2Error : uint32_t
+{
+    NoError = 0x0,
+    ProtocolError = 0x1,
+    InternalError = 0x2,
+    FlowControlError = 0x3,
+    SettingsTimeout = 0x4,
+    StreamClosed = 0x5,
+    FrameSizeError = 0x6,
+    RefusedStream = 0x7,
+    Cancel = 0x8,
+    CompressionError = 0x9,
+    ConnectError = 0xa,
+    EnhanceYourCalm = 0xb,
+    InadequateSecurity = 0xc,
+    HTTP11Required = 0xd
+};
+
+struct FrameHeader
+{
+    uint32_t length;
+    FrameType type;
+    uint8_t flags;
+    uint32_t streamId;
+
+    bool hasFlag(uint8_t flag) const { return (flags & flag) != 0; }
+};
+
+namespace http2
+{
+
+inline uint32_t readUint32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+inline void appendUint32(std::string& out, uint32_t value)
+{
+    out.push_back(static_cast<char>(value >> 24));
+    out.push_back(static_cast<char>(value >> 16));
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+inline FrameHeader parseFrameHeader(const uint8_t* p)
+{
+    FrameHeader header;
+    header.length = (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2];
+    header.type = static_cast<FrameType>(p[3]);
+    header.flags = p[4];
+    header.streamId = readUint32(p + 5) & 0x7fffffff;
+    return header;
+}
+
+inline void appendFrameHeader(std::string& out, uint32_t length, FrameType type,
+    uint8_t flags, uint32_t streamId)
+{
+    out.push_back(static_cast<char>(length >> 16));
+    out.push_back(static_cast<char>(length >> 8));
+    out.push_back(static_cast<char>(length));
+    out.push_back(static_cast<char>(type));
+    out.push_back(static_cast<char>(flags));
+    appendUint32(out, streamId & 0x7fffffff);
+}
+
+}
\ No newline at end of file
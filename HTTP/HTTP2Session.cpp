@@ -0,0 +1,790 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "HTTP2Session.hpp"
+#include "Router.hpp"
+#include "RequestArena.hpp"
+#include "PhaseTrace.hpp"
+#include "HTTPUtils.hpp"
+#include "spdlog/spdlog.h"
+
+namespace
+{
+
+constexpr std::string_view kClientPreface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+constexpr std::string_view kSwitchingProtocols =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Connection: Upgrade\r\n"
+    "Upgrade: h2c\r\n\r\n";
+
+// Hop-by-hop headers are not allowed in HTTP/2 messages
+bool isConnectionHeader(const std::string& name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+        || name == "transfer-encoding" || name == "upgrade";
+}
+
+void appendSetting(std::string& out, SettingId id, uint32_t value)
+{
+    out.push_back(static_cast<char>(static_cast<uint16_t>(id) >> 8));
+    out.push_back(static_cast<char>(static_cast<uint16_t>(id)));
+    http2::appendUint32(out, value);
+}
+
+}
+
+HTTP2Session::HTTP2Session(Router& router)
+    : m_router(router)
+{
+}
+
+bool HTTP2Session::hasPreface(const char* data, size_t length)
+{
+    // A short first read still commits to HTTP/2, no HTTP/1.1 method starts with "PRI "
+    size_t n = std::min(length, kClientPreface.length());
+    return n >= 4 && std::memcmp(data, kClientPreface.data(), n) == 0;
+}
+
+bool HTTP2Session::isUpgradeRequest(const Request& request)
+{
+    std::string upgrade(request.header("Upgrade"));
+    std::transform(upgrade.begin(), upgrade.end(), upgrade.begin(),
+        [](char c) { return tolower(c); });
+
+    // Requests with a body stay on HTTP/1.1, the upgrade is optional for the server
+    return upgrade.find("h2c") != std::string::npos
+        && request.hasHeader("HTTP2-Settings")
+        && request.content().empty();
+}
+
+void HTTP2Session::start()
+{
+    std::string settings;
+    appendSetting(settings, SettingId::MaxConcurrentStreams, kMaxConcurrentStreams);
+    appendSetting(settings, SettingId::InitialWindowSize, kStreamWindowSize);
+    writeFrame(FrameType::Settings, 0, 0, settings.data(), settings.length());
+
+    // The connection window can only be raised by WINDOW_UPDATE
+    writeWindowUpdate(0, kConnectionWindowSize - k_http2DefaultWindowSize);
+}
+
+void HTTP2Session::upgrade(const Request& request)
+{
+    std::string settings = http::utils::decodeBase64(request.header("HTTP2-Settings"));
+
+    m_outbound.append(kSwitchingProtocols);
+    start();
+
+    if (!applySettings(reinterpret_cast<const uint8_t*>(settings.data()), settings.length()))
+        return;
+
+    // The upgraded request becomes stream 1, half-closed (remote)
+    Stream& stream = m_streams[1];
+    stream.request = request;
+    stream.request.setVersion(Version::HTTP_2_0);
+    stream.remoteClosed = true;
+    stream.sendWindow = m_peerInitialWindow;
+    m_lastStreamId = 1;
+
+    spdlog::info("HTTP/2 session upgraded from HTTP/1.1");
+    dispatch(1, stream);
+    flushStreams();
+}
+
+bool HTTP2Session::receive(const char* data, size_t length)
+{
+    if (m_goAwaySent)
+        return false;
+
+    // Parse straight from the read buffer unless a partial frame is pending
+    size_t consumed;
+    if (m_inbound.empty())
+    {
+        std::string_view input(data, length);
+        consumed = processInput(input);
+        m_inbound.assign(input.substr(consumed));
+    }
+    else
+    {
+        m_inbound.append(data, length);
+        consumed = processInput(m_inbound);
+        m_inbound.erase(0, consumed);
+    }
+
+    if (m_goAwaySent)
+        return false;
+
+    // Replenish the connection window once half of it was used
+    if (m_recvWindow < kConnectionWindowSize / 2)
+    {
+        writeWindowUpdate(0, kConnectionWindowSize - m_recvWindow);
+        m_recvWindow = kConnectionWindowSize;
+    }
+
+    flushStreams();
+    return true;
+}
+
+void HTTP2Session::consume(size_t length)
+{
+    m_outboundCursor += length;
+    if (m_outboundCursor == m_outbound.length())
+    {
+        m_outbound.clear();
+        m_outboundCursor = 0;
+    }
+}
+
+size_t HTTP2Session::processInput(std::string_view input)
+{
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(input.data());
+    size_t cursor = 0;
+
+    if (!m_prefaceReceived)
+    {
+        if (input.length() < kClientPreface.length())
+        {
+            if (!hasPreface(input.data(), input.length()))
+                connectionError(HTTP2Error::ProtocolError, "Invalid client preface");
+            return 0;
+        }
+        if (input.substr(0, kClientPreface.length()) != kClientPreface)
+        {
+            connectionError(HTTP2Error::ProtocolError, "Invalid client preface");
+            return 0;
+        }
+        m_prefaceReceived = true;
+        cursor = kClientPreface.length();
+    }
+
+    while (!m_goAwaySent && input.length() - cursor >= k_http2FrameHeaderSize)
+    {
+        FrameHeader header = http2::parseFrameHeader(data + cursor);
+
+        // We never advertise a larger SETTINGS_MAX_FRAME_SIZE
+        if (header.length > k_http2DefaultMaxFrameSize)
+        {
+            connectionError(HTTP2Error::FrameSizeError, "Frame exceeds max frame size");
+            break;
+        }
+
+        if (input.length() - cursor - k_http2FrameHeaderSize < header.length)
+            break;
+
+        handleFrame(header, data + cursor + k_http2FrameHeaderSize);
+        cursor += k_http2FrameHeaderSize + header.length;
+    }
+
+    return cursor;
+}
+
+void HTTP2Session::handleFrame(const FrameHeader& header, const uint8_t* payload)
+{
+    spdlog::debug("HTTP/2 frame type {} flags {} stream {} length {}",
+        static_cast<int>(header.type), header.flags, header.streamId, header.length);
+
+    // Nothing may interleave with an open header block
+    if (m_continuationStreamId != 0 && (header.type != FrameType::Continuation
+            || header.streamId != m_continuationStreamId))
+    {
+        connectionError(HTTP2Error::ProtocolError, "Expected CONTINUATION frame");
+        return;
+    }
+
+    switch (header.type)
+    {
+    case FrameType::Data:
+        onData(header, payload);
+        break;
+
+    case FrameType::Headers:
+        onHeaders(header, payload);
+        break;
+
+    case FrameType::Continuation:
+        onContinuation(header, payload);
+        break;
+
+    case FrameType::Priority:
+        if (header.streamId == 0)
+            connectionError(HTTP2Error::ProtocolError, "PRIORITY on stream 0");
+        else if (header.length != 5)
+            resetStream(header.streamId, HTTP2Error::FrameSizeError);
+        break;
+
+    case FrameType::RstStream:
+        if (header.streamId == 0 || header.streamId > m_lastStreamId)
+            connectionError(HTTP2Error::ProtocolError, "RST_STREAM on idle stream");
+        else if (header.length != 4)
+            connectionError(HTTP2Error::FrameSizeError, "Invalid RST_STREAM length");
+        else
+            closeStream(header.streamId);
+        break;
+
+    case FrameType::Settings:
+        onSettings(header, payload);
+        break;
+
+    case FrameType::PushPromise:
+        connectionError(HTTP2Error::ProtocolError, "Client sent PUSH_PROMISE");
+        break;
+
+    case FrameType::Ping:
+        if (header.streamId != 0)
+            connectionError(HTTP2Error::ProtocolError, "PING on a stream");
+        else if (header.length != 8)
+            connectionError(HTTP2Error::FrameSizeError, "Invalid PING length");
+        else if (!header.hasFlag(FrameFlag::Ack))
+            writeFrame(FrameType::Ping, FrameFlag::Ack, 0,
+                reinterpret_cast<const char*>(payload), 8);
+        break;
+
+    case FrameType::GoAway:
+        if (header.streamId != 0)
+            connectionError(HTTP2Error::ProtocolError, "GOAWAY on a stream");
+        else
+        {
+            // Finish the streams in flight, then close
+            m_peerGoAway = true;
+            spdlog::info("HTTP/2 peer sent GOAWAY");
+        }
+        break;
+
+    case FrameType::WindowUpdate:
+        onWindowUpdate(header, payload);
+        break;
+
+    default:
+        // Unknown frame types must be ignored
+        break;
+    }
+}
+
+void HTTP2Session::onData(const FrameHeader& header, const uint8_t* payload)
+{
+    if (header.streamId == 0)
+    {
+        connectionError(HTTP2Error::ProtocolError, "DATA on stream 0");
+        return;
+    }
+
+    // The whole frame, padding included, counts against flow control
+    m_recvWindow -= header.length;
+    if (m_recvWindow < 0)
+    {
+        connectionError(HTTP2Error::FlowControlError, "Connection window exceeded");
+        return;
+    }
+
+    size_t length = header.length;
+    if (header.hasFlag(FrameFlag::Padded))
+    {
+        if (length == 0 || payload[0] >= length)
+        {
+            connectionError(HTTP2Error::ProtocolError, "Invalid DATA padding");
+            return;
+        }
+        length -= payload[0] + 1;
+        payload++;
+    }
+
+    auto it = m_streams.find(header.streamId);
+    if (it == m_streams.end() || it->second.remoteClosed)
+    {
+        if (header.streamId > m_lastStreamId)
+            connectionError(HTTP2Error::ProtocolError, "DATA on idle stream");
+        else
+            resetStream(header.streamId, HTTP2Error::StreamClosed);
+        return;
+    }
+
+    Stream& stream = it->second;
+    stream.recvWindow -= header.length;
+    if (stream.recvWindow < 0)
+    {
+        resetStream(header.streamId, HTTP2Error::FlowControlError);
+        return;
+    }
+
+    if (stream.body.length() + length > kMaxRequestBodySize)
+    {
+        resetStream(header.streamId, HTTP2Error::Cancel);
+        return;
+    }
+    stream.body.append(reinterpret_cast<const char*>(payload), length);
+
+    if (header.hasFlag(FrameFlag::EndStream))
+    {
+        stream.remoteClosed = true;
+        dispatch(header.streamId, stream);
+    }
+    else if (stream.recvWindow < kStreamWindowSize / 2)
+    {
+        writeWindowUpdate(header.streamId, kStreamWindowSize - stream.recvWindow);
+        stream.recvWindow = kStreamWindowSize;
+    }
+}
+
+void HTTP2Session::onHeaders(const FrameHeader& header, const uint8_t* payload)
+{
+    // Client streams are odd-numbered
+    if (header.streamId == 0 || header.streamId % 2 == 0)
+    {
+        connectionError(HTTP2Error::ProtocolError, "HEADERS on invalid stream");
+        return;
+    }
+
+    size_t length = header.length;
+    size_t padding = 0;
+    if (header.hasFlag(FrameFlag::Padded))
+    {
+        if (length == 0)
+        {
+            connectionError(HTTP2Error::ProtocolError, "Invalid HEADERS padding");
+            return;
+        }
+        padding = payload[0];
+        payload++;
+        length--;
+    }
+    if (header.hasFlag(FrameFlag::Priority))
+    {
+        if (length < 5)
+        {
+            connectionError(HTTP2Error::FrameSizeError, "Invalid HEADERS priority");
+            return;
+        }
+        payload += 5;
+        length -= 5;
+    }
+    if (padding > length)
+    {
+        connectionError(HTTP2Error::ProtocolError, "Invalid HEADERS padding");
+        return;
+    }
+    length -= padding;
+
+    auto it = m_streams.find(header.streamId);
+    if (it != m_streams.end())
+    {
+        // Trailers must close the stream
+        if (it->second.remoteClosed || !header.hasFlag(FrameFlag::EndStream))
+        {
+            connectionError(HTTP2Error::ProtocolError, "Unexpected HEADERS on open stream");
+            return;
+        }
+        it->second.trailers = true;
+    }
+    else
+    {
+        if (header.streamId <= m_lastStreamId)
+        {
+            connectionError(HTTP2Error::StreamClosed, "HEADERS on closed stream");
+            return;
+        }
+
+        m_lastStreamId = header.streamId;
+        it = m_streams.emplace(header.streamId, Stream()).first;
+        it->second.sendWindow = m_peerInitialWindow;
+        it->second.request.setVersion(Version::HTTP_2_0);
+
+        // The block is still decoded to keep the HPACK state in sync
+        it->second.refused = m_peerGoAway || m_streams.size() > kMaxConcurrentStreams;
+    }
+
+    Stream& stream = it->second;
+    stream.endStream = header.hasFlag(FrameFlag::EndStream);
+    stream.headerBlock.assign(reinterpret_cast<const char*>(payload), length);
+
+    if (header.hasFlag(FrameFlag::EndHeaders))
+        onHeaderBlockComplete(header.streamId);
+    else
+        m_continuationStreamId = header.streamId;
+}
+
+void HTTP2Session::onContinuation(const FrameHeader& header, const uint8_t* payload)
+{
+    auto it = m_streams.find(header.streamId);
+    if (header.streamId != m_continuationStreamId || it == m_streams.end())
+    {
+        connectionError(HTTP2Error::ProtocolError, "Unexpected CONTINUATION frame");
+        return;
+    }
+
+    Stream& stream = it->second;
+    if (stream.headerBlock.length() + header.length > kMaxHeaderBlockSize)
+    {
+        connectionError(HTTP2Error::EnhanceYourCalm, "Header block too large");
+        return;
+    }
+    stream.headerBlock.append(reinterpret_cast<const char*>(payload), header.length);
+
+    if (header.hasFlag(FrameFlag::EndHeaders))
+    {
+        m_continuationStreamId = 0;
+        onHeaderBlockComplete(header.streamId);
+    }
+}
+
+void HTTP2Session::onHeaderBlockComplete(uint32_t streamId)
+{
+    Stream& stream = m_streams[streamId];
+    std::vector<HeaderField> fields;
+
+    try
+    {
+        fields = m_decoder.decode(
+            reinterpret_cast<const uint8_t*>(stream.headerBlock.data()), stream.headerBlock.length());
+    }
+    catch (const std::invalid_argument& e)
+    {
+        connectionError(HTTP2Error::CompressionError, e.what());
+        return;
+    }
+    stream.headerBlock.clear();
+
+    if (stream.refused)
+    {
+        resetStream(streamId, HTTP2Error::RefusedStream);
+        return;
+    }
+
+    // Trailer fields are decoded for HPACK but not surfaced to handlers
+    if (!stream.trailers)
+    {
+        bool hasMethod = false, hasPath = false;
+        try
+        {
+            for (auto& [name, value] : fields)
+            {
+                if (name == ":method")
+                {
+                    stream.request.setMethod(http::utils::toMethod(value));
+                    hasMethod = true;
+                }
+                else if (name == ":path")
+                {
+                    stream.request.setTarget(value);
+                    hasPath = !value.empty();
+                }
+                else if (name == ":authority")
+                    stream.request.setHeader("host", value);
+                else if (name.starts_with(':'))
+                    continue;
+                else
+                {
+                    // Repeated fields are folded, cookies use their own separator
+                    std::string existing(stream.request.header(name));
+                    if (existing.empty())
+                        stream.request.setHeader(name, value);
+                    else
+                        stream.request.setHeader(name,
+                            existing + (name == "cookie" ? "; " : ", ") + value);
+                }
+            }
+            stream.request.resolveAuthority();
+        }
+        catch (const std::invalid_argument&)
+        {
+            hasMethod = false;
+        }
+
+        if (!hasMethod || !hasPath)
+        {
+            resetStream(streamId, HTTP2Error::ProtocolError);
+            return;
+        }
+    }
+
+    if (stream.endStream)
+    {
+        stream.remoteClosed = true;
+        dispatch(streamId, stream);
+    }
+}
+
+void HTTP2Session::onSettings(const FrameHeader& header, const uint8_t* payload)
+{
+    if (header.streamId != 0)
+    {
+        connectionError(HTTP2Error::ProtocolError, "SETTINGS on a stream");
+        return;
+    }
+
+    if (header.hasFlag(FrameFlag::Ack))
+    {
+        if (header.length != 0)
+            connectionError(HTTP2Error::FrameSizeError, "SETTINGS ACK with payload");
+        return;
+    }
+
+    if (applySettings(payload, header.length))
+        writeFrame(FrameType::Settings, FrameFlag::Ack, 0);
+}
+
+bool HTTP2Session::applySettings(const uint8_t* payload, size_t length)
+{
+    if (length % 6 != 0)
+    {
+        connectionError(HTTP2Error::FrameSizeError, "Invalid SETTINGS length");
+        return false;
+    }
+
+    for (size_t i = 0; i < length; i += 6)
+    {
+        auto id = static_cast<SettingId>((payload[i] << 8) | payload[i + 1]);
+        uint32_t value = http2::readUint32(payload + i + 2);
+
+        switch (id)
+        {
+        case SettingId::HeaderTableSize:
+            m_encoder.setMaxTableSize(value);
+            break;
+
+        case SettingId::InitialWindowSize:
+        {
+            if (value > k_http2MaxWindowSize)
+            {
+                connectionError(HTTP2Error::FlowControlError, "Invalid initial window size");
+                return false;
+            }
+
+            // Applies retroactively to every open stream
+            int64_t delta = int64_t(value) - m_peerInitialWindow;
+            for (auto& [id, stream] : m_streams)
+                stream.sendWindow += delta;
+            m_peerInitialWindow = value;
+            break;
+        }
+
+        case SettingId::MaxFrameSize:
+            if (value < k_http2DefaultMaxFrameSize || value > 0xffffff)
+            {
+                connectionError(HTTP2Error::ProtocolError, "Invalid max frame size");
+                return false;
+            }
+            m_peerMaxFrameSize = value;
+            break;
+
+        case SettingId::EnablePush:
+            if (value > 1)
+            {
+                connectionError(HTTP2Error::ProtocolError, "Invalid enable push");
+                return false;
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+void HTTP2Session::onWindowUpdate(const FrameHeader& header, const uint8_t* payload)
+{
+    if (header.length != 4)
+    {
+        connectionError(HTTP2Error::FrameSizeError, "Invalid WINDOW_UPDATE length");
+        return;
+    }
+
+    uint32_t increment = http2::readUint32(payload) & 0x7fffffff;
+
+    if (header.streamId == 0)
+    {
+        if (increment == 0)
+            connectionError(HTTP2Error::ProtocolError, "Zero WINDOW_UPDATE increment");
+        else if ((m_sendWindow += increment) > k_http2MaxWindowSize)
+            connectionError(HTTP2Error::FlowControlError, "Connection window overflow");
+        return;
+    }
+
+    // Updates may race with a stream we already finished
+    auto it = m_streams.find(header.streamId);
+    if (it == m_streams.end())
+        return;
+
+    if (increment == 0)
+        resetStream(header.streamId, HTTP2Error::ProtocolError);
+    else if ((it->second.sendWindow += increment) > k_http2MaxWindowSize)
+        resetStream(header.streamId, HTTP2Error::FlowControlError);
+}
+
+void HTTP2Session::dispatch(uint32_t streamId, Stream& stream)
+{
+    if (m_admissionCheck)
+    {
+        StatusCode status = m_admissionCheck();
+        if (status != StatusCode::Ok)
+        {
+            std::string block;
+            m_encoder.encode({ { ":status", std::to_string(static_cast<int>(status)) },
+                { "retry-after", "1" }, { "content-length", "0" } }, block);
+            writeHeaders(streamId, block, true);
+            m_streams.erase(streamId);
+            return;
+        }
+        stream.admitted = true;
+        m_admittedStreams++;
+    }
+
+    if (!stream.body.empty())
+        stream.request.setContent(stream.body);
+
+    // The request was assembled across frames and stays on the heap, the
+    // response only lives until it is encoded below
+    RequestArena::Scope arena;
+    PhaseTrace::nextRequest();
+    Response response = m_router.dispatch(stream.request, arena.resource());
+    bool sendBody = stream.request.method() != Method::HEAD && !response.content().empty();
+
+    std::vector<HeaderField> headers;
+    headers.emplace_back(":status", std::to_string(static_cast<int>(response.statusCode())));
+    if (response.statusCode() != StatusCode::NotModified)
+        headers.emplace_back("content-length", std::to_string(response.contentLength()));
+    if (!response.hasHeader("Date"))
+        headers.emplace_back("date", http::utils::currentHttpDate());
+
+    for (const auto& [key, value] : response.headers())
+    {
+        // HTTP/2 field names are lowercase
+        std::string name;
+        std::transform(key.begin(), key.end(), std::back_inserter(name),
+            [](char c) { return tolower(c); });
+        if (!isConnectionHeader(name))
+            headers.emplace_back(std::move(name), value);
+    }
+
+    std::string block;
+    m_encoder.encode(headers, block);
+    writeHeaders(streamId, block, !sendBody);
+
+    if (!sendBody)
+    {
+        closeStream(streamId);
+        return;
+    }
+
+    stream.response = response.content();
+    stream.responseCursor = 0;
+    m_sendQueue.push_back(streamId);
+}
+
+void HTTP2Session::flushStreams()
+{
+    // Round-robin one frame per stream so large bodies don't starve small ones,
+    // stopping once a full round is blocked on flow control
+    bool progress = true;
+    while (progress && m_sendWindow > 0 && !m_sendQueue.empty())
+    {
+        progress = false;
+        for (size_t n = m_sendQueue.size(); n > 0 && m_sendWindow > 0; n--)
+        {
+            uint32_t streamId = m_sendQueue.front();
+            m_sendQueue.pop_front();
+
+            // Reset by the peer in the meantime
+            auto it = m_streams.find(streamId);
+            if (it == m_streams.end())
+                continue;
+
+            Stream& stream = it->second;
+            size_t remaining = stream.response.length() - stream.responseCursor;
+            int64_t window = std::min(m_sendWindow, stream.sendWindow);
+            if (window <= 0)
+            {
+                m_sendQueue.push_back(streamId);
+                continue;
+            }
+
+            size_t length = std::min({ remaining, size_t(m_peerMaxFrameSize), size_t(window) });
+            bool last = length == remaining;
+            writeFrame(FrameType::Data, last ? FrameFlag::EndStream : 0, streamId,
+                stream.response.data() + stream.responseCursor, length);
+
+            stream.responseCursor += length;
+            stream.sendWindow -= length;
+            m_sendWindow -= length;
+            progress = true;
+
+            if (last)
+                closeStream(streamId);
+            else
+                m_sendQueue.push_back(streamId);
+        }
+    }
+}
+
+void HTTP2Session::writeFrame(FrameType type, uint8_t flags, uint32_t streamId,
+    const char* payload, size_t length)
+{
+    http2::appendFrameHeader(m_outbound, length, type, flags, streamId);
+    if (length > 0)
+        m_outbound.append(payload, length);
+}
+
+void HTTP2Session::writeHeaders(uint32_t streamId, const std::string& block, bool endStream)
+{
+    // Blocks larger than a frame continue in CONTINUATION frames
+    size_t length = std::min(block.length(), size_t(m_peerMaxFrameSize));
+    uint8_t flags = (endStream ? FrameFlag::EndStream : 0)
+        | (length == block.length() ? FrameFlag::EndHeaders : 0);
+    writeFrame(FrameType::Headers, flags, streamId, block.data(), length);
+
+    for (size_t offset = length; offset < block.length(); offset += length)
+    {
+        length = std::min(block.length() - offset, size_t(m_peerMaxFrameSize));
+        flags = offset + length == block.length() ? FrameFlag::EndHeaders : 0;
+        writeFrame(FrameType::Continuation, flags, streamId, block.data() + offset, length);
+    }
+}
+
+void HTTP2Session::writeWindowUpdate(uint32_t streamId, uint32_t increment)
+{
+    std::string payload;
+    http2::appendUint32(payload, increment);
+    writeFrame(FrameType::WindowUpdate, 0, streamId, payload.data(), payload.length());
+}
+
+void HTTP2Session::resetStream(uint32_t streamId, HTTP2Error error)
+{
+    std::string payload;
+    http2::appendUint32(payload, static_cast<uint32_t>(error));
+    writeFrame(FrameType::RstStream, 0, streamId, payload.data(), payload.length());
+    closeStream(streamId);
+}
+
+void HTTP2Session::closeStream(uint32_t streamId)
+{
+    auto it = m_streams.find(streamId);
+    if (it == m_streams.end())
+        return;
+
+    if (it->second.admitted)
+    {
+        m_releaseStreams(1);
+        m_admittedStreams--;
+    }
+    m_streams.erase(it);
+}
+
+void HTTP2Session::connectionError(HTTP2Error error, const char* reason)
+{
+    spdlog::error("HTTP/2 connection error {}: {}", static_cast<int>(error), reason);
+
+    std::string payload;
+    http2::appendUint32(payload, m_lastStreamId);
+    http2::appendUint32(payload, static_cast<uint32_t>(error));
+    payload.append(reason);
+    writeFrame(FrameType::GoAway, 0, 0, payload.data(), payload.length());
+
+    m_goAwaySent = true;
+    if (m_admittedStreams > 0)
+        m_releaseStreams(m_admittedStreams);
+    m_admittedStreams = 0;
+    m_streams.clear();
+    m_sendQueue.clear();
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "HPACK.hpp"
+#include "HTTP2Frame.hpp"
+#include "Request.hpp"
+
+class Router;
+
+// HTTP/2 cleartext (h2c) connection engine, entered either with prior
+// knowledge (client preface) or through an HTTP/1.1 "Upgrade: h2c" request.
+//
+// Bytes read from the socket are fed to receive(). Each stream is dispatched
+// to the Router once its request is complete, and all frames produced while
+// handling a read (ACKs, headers, DATA within the flow-control windows) are
+// batched into one outbound buffer so they go out in a single send().
+class HTTP2Session
+{
+private:
+    static constexpr uint32_t kMaxConcurrentStreams = 1000;
+    static constexpr int64_t kStreamWindowSize = 1 << 20;       // advertised per stream
+    static constexpr int64_t kConnectionWindowSize = 1 << 24;   // advertised per connection
+    static constexpr size_t kMaxHeaderBlockSize = 64 * 1024;
+    static constexpr size_t kMaxRequestBodySize = 1 << 20;
+
+    struct Stream
+    {
+        std::string headerBlock;        // HEADERS + CONTINUATION fragments
+        Request request;
+        std::string body;
+        bool trailers{false};           // current header block is a trailer section
+        bool refused{false};            // over the concurrency limit, reset once decoded
+        bool endStream{false};          // END_STREAM seen on the header block
+        bool remoteClosed{false};
+        bool admitted{false};           // holds an in-flight slot until answered
+        int64_t recvWindow{kStreamWindowSize};
+        int64_t sendWindow;
+        std::string response;           // DATA still to send
+        size_t responseCursor{0};
+    };
+
+    Router& m_router;
+    std::function<StatusCode()> m_admissionCheck;
+    std::function<void(int)> m_releaseStreams;
+    int m_admittedStreams{0};
+    HPACKDecoder m_decoder;
+    HPACKEncoder m_encoder;
+
+    std::string m_inbound;              // partial frame carried over between reads
+    std::string m_outbound;
+    size_t m_outboundCursor{0};
+
+    std::unordered_map<uint32_t, Stream> m_streams;
+    std::deque<uint32_t> m_sendQueue;   // streams with DATA pending, served round-robin
+
+    bool m_prefaceReceived{false};
+    bool m_goAwaySent{false};
+    bool m_peerGoAway{false};
+    uint32_t m_lastStreamId{0};
+    uint32_t m_continuationStreamId{0}; // stream whose header block is still open
+
+    uint32_t m_peerInitialWindow{k_http2DefaultWindowSize};
+    uint32_t m_peerMaxFrameSize{k_http2DefaultMaxFrameSize};
+    int64_t m_sendWindow{k_http2DefaultWindowSize};
+    int64_t m_recvWindow{kConnectionWindowSize};
+
+    size_t processInput(std::string_view input);
+    void handleFrame(const FrameHeader& header, const uint8_t* payload);
+    void onData(const FrameHeader& header, const uint8_t* payload);
+    void onHeaders(const FrameHeader& header, const uint8_t* payload);
+    void onContinuation(const FrameHeader& header, const uint8_t* payload);
+    void onSettings(const FrameHeader& header, const uint8_t* payload);
+    void onWindowUpdate(const FrameHeader& header, const uint8_t* payload);
+    void onHeaderBlockComplete(uint32_t streamId);
+
+    bool applySettings(const uint8_t* payload, size_t length);
+    void dispatch(uint32_t streamId, Stream& stream);
+    void closeStream(uint32_t streamId);
+    void flushStreams();
+
+    void writeFrame(FrameType type, uint8_t flags, uint32_t streamId,
+        const char* payload = nullptr, size_t length = 0);
+    void writeHeaders(uint32_t streamId, const std::string& block, bool endStream);
+    void writeWindowUpdate(uint32_t streamId, uint32_t increment);
+    void resetStream(uint32_t streamId, HTTP2Error error);
+    void connectionError(HTTP2Error error, const char* reason);
+
+public:
+    explicit HTTP2Session(Router& router);
+
+    static bool hasPreface(const char* data, size_t length);
+    static bool isUpgradeRequest(const Request& request);
+
+    // Consulted before each stream is routed, a refused stream is answered
+    // with the returned status. Admitted streams are handed back to release
+    // once their response is queued or they are reset.
+    void setAdmission(std::function<StatusCode()> check, std::function<void(int)> release)
+    {
+        m_admissionCheck = std::move(check);
+        m_releaseStreams = std::move(release);
+    }
+
+    // Admitted streams not yet released, for the connection's teardown
+    int admittedStreams() const { return m_admittedStreams; }
+
+    // Prior knowledge: queue the server preface
+    void start();
+
+    // h2c upgrade: queue the 101, the server preface and the response to
+    // the upgraded request on stream 1
+    void upgrade(const Request& request);
+
+    // Feed bytes read from the socket, returns false once the connection failed
+    bool receive(const char* data, size_t length);
+
+    const char* pendingData() const { return m_outbound.data() + m_outboundCursor; }
+    size_t pendingSize() const { return m_outbound.length() - m_outboundCursor; }
+    void consume(size_t length);
+
+    // Close after the pending output was flushed
+    bool wantsClose() const
+    {
+        return pendingSize() == 0 && (m_goAwaySent || (m_peerGoAway && m_streams.empty()));
+    }
+};
\ No newline at end of file
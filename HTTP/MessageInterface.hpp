@@ -1,32 +1,85 @@
 #pragma once
 
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <strings.h>
 #include <unordered_map>
 
 #include "Enum.hpp"
 
+// Header names are case-insensitive, so are their hash and comparison: any
+// spelling finds a header in one lookup, by string_view without building a key
+struct HeaderHash
+{
+    using is_transparent = void;
+    size_t operator()(std::string_view key) const
+    {
+        // FNV-1a, with the case bit set on every byte
+        size_t hash = 14695981039346656037ull;
+        for (unsigned char c : key)
+            hash = (hash ^ (c | 0x20)) * 1099511628211ull;
+        return hash;
+    }
+};
+
+struct HeaderEqual
+{
+    using is_transparent = void;
+    bool operator()(std::string_view a, std::string_view b) const
+    {
+        return a.length() == b.length() && strncasecmp(a.data(), b.data(), a.length()) == 0;
+    }
+};
+
+// Headers and body use the message's allocator, so a message built inside a
+// RequestArena::Scope lives entirely in the worker's arena
 class MessageInterface
 {
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+    using HeaderMap = std::pmr::unordered_map<std::pmr::string, std::pmr::string, HeaderHash, HeaderEqual>;
+
 protected:
     Version m_version;
-    std::unordered_map<std::string, std::string> m_headers;
-    std::string m_content;
+    HeaderMap m_headers;
+    std::pmr::string m_content;
     int m_contentLength = 0;
 
 public:
-    MessageInterface() : m_version(Version::HTTP_1_1) {}
+    explicit MessageInterface(allocator_type alloc = {})
+        : m_version(Version::HTTP_1_1), m_headers(alloc), m_content(alloc) {}
     virtual ~MessageInterface() = default;
 
-    void setHeader(const std::string& key, const std::string& value) { m_headers[key] = value; }
-    void removeHeader(const std::string& key) { m_headers.erase(key); }
+    allocator_type get_allocator() const { return m_content.get_allocator(); }
+
+    void setVersion(Version version) { m_version = version; }
+    void setHeader(std::string_view key, std::string_view value)
+    {
+        m_headers.insert_or_assign(std::pmr::string(key, get_allocator()),
+            std::pmr::string(value, get_allocator()));
+    }
+    void removeHeader(std::string_view key)
+    {
+        if (auto it = m_headers.find(key); it != m_headers.end())
+            m_headers.erase(it);
+    }
     void clearHeader() { m_headers.clear(); }
-    void setContent(const std::string& body) { m_content = body; m_contentLength = body.length(); }
+    void setContent(std::string_view body) { m_content.assign(body); m_contentLength = body.length(); }
     void clearContent() { m_content.clear(); }
 
     Version version() const { return m_version; }
-    std::string header(const std::string& key);
-    std::unordered_map<std::string, std::string> headers() const { return m_headers; }
-    std::string content() const { return m_content; }
+
+    // Empty if missing. Valid until the header is changed
+    std::string_view header(std::string_view key) const
+    {
+        if (auto it = m_headers.find(key); it != m_headers.end())
+            return it->second;
+        return std::string_view();
+    }
+    bool hasHeader(std::string_view key) const { return !header(key).empty(); }
+    const HeaderMap& headers() const { return m_headers; }
+    std::string_view content() const { return m_content; }
     int contentLength() const { return m_content.length(); }
 
 };
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "PhaseTrace.hpp"
+
+namespace
+{
+
+constexpr size_t kCapacity = 1 << 16;   // spans per worker, power of 2
+
+struct Record
+{
+    std::atomic<uint64_t> start{0};
+    std::atomic<uint64_t> end{0};
+    std::atomic<uint64_t> info{0};      // request << 32 | fd << 8 | phase
+};
+
+struct Ring
+{
+    std::unique_ptr<Record[]> records{std::make_unique<Record[]>(kCapacity)};
+    std::atomic<uint64_t> next{0};      // spans ever written, published after each one
+};
+
+constexpr const char* kPhaseNames[] =
+{
+    "read", "write", "queued", "recv", "parse", "route", "compress", "serialize", "send"
+};
+
+// Rings outlive their workers, so a trace can be exported after stop()
+std::mutex s_ringsMutex;
+std::vector<std::unique_ptr<Ring>> s_rings;
+
+// Ticks to nanoseconds, fixed by the first enable()
+std::once_flag s_calibrated;
+double s_nsPerTick = 1.0;
+uint64_t s_epoch = 0;
+
+// The calling worker's ring and current event
+thread_local Ring* t_ring = nullptr;
+thread_local uint64_t t_events = 0;
+thread_local uint64_t t_request = 0;
+thread_local int t_fd = -1;
+thread_local Phase t_eventPhase = Phase::ReadEvent;
+thread_local uint64_t t_eventStart = 0;
+
+void calibrate()
+{
+    auto wallStart = std::chrono::steady_clock::now();
+    uint64_t ticksStart = PhaseTrace::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t ticks = PhaseTrace::now() - ticksStart;
+    auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wallStart);
+
+    if (ticks > 0)
+        s_nsPerTick = static_cast<double>(wall.count()) / ticks;
+    s_epoch = ticksStart;
+}
+
+}
+
+std::atomic<int> PhaseTrace::s_sampleEvery{0};
+
+void PhaseTrace::enable(int sampleEvery)
+{
+    if (sampleEvery > 0)
+        std::call_once(s_calibrated, calibrate);
+    s_sampleEvery.store(sampleEvery, std::memory_order_release);
+}
+
+void PhaseTrace::attachWorker(int worker)
+{
+    t_ring = nullptr;
+    t_sampled = false;
+    if (!enabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(s_ringsMutex);
+    if (s_rings.size() <= static_cast<size_t>(worker))
+        s_rings.resize(worker + 1);
+    if (!s_rings[worker])
+        s_rings[worker] = std::make_unique<Ring>();
+    t_ring = s_rings[worker].get();
+}
+
+void PhaseTrace::beginEvent(Phase phase, int fd, uint64_t polledAt)
+{
+    int every = s_sampleEvery.load(std::memory_order_relaxed);
+    if (every == 0 || !t_ring || ++t_events % every != 0)
+        return;
+
+    t_sampled = true;
+    t_fd = fd;
+    t_eventPhase = phase;
+    t_eventStart = now();
+    record(Phase::Queued, polledAt, t_eventStart);
+}
+
+void PhaseTrace::endEvent()
+{
+    if (!t_sampled)
+        return;
+
+    record(t_eventPhase, t_eventStart, now());
+    t_sampled = false;
+}
+
+void PhaseTrace::nextRequest()
+{
+    if (t_sampled)
+        t_request++;
+}
+
+void PhaseTrace::record(Phase phase, uint64_t start, uint64_t end)
+{
+    Ring& ring = *t_ring;
+    uint64_t index = ring.next.load(std::memory_order_relaxed);
+    Record& slot = ring.records[index & (kCapacity - 1)];
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.info.store((t_request & 0xFFFFFFFF) << 32 | (static_cast<uint64_t>(t_fd) & 0xFFFFFF) << 8
+        | static_cast<uint64_t>(phase), std::memory_order_relaxed);
+    ring.next.store(index + 1, std::memory_order_release);
+}
+
+std::string PhaseTrace::exportJson()
+{
+    struct Copy
+    {
+        uint64_t start, end, info;
+    };
+
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    char buffer[256];
+
+    std::lock_guard<std::mutex> lock(s_ringsMutex);
+    for (size_t worker = 0; worker < s_rings.size(); worker++)
+    {
+        if (!s_rings[worker])
+            continue;
+        Ring& ring = *s_rings[worker];
+
+        snprintf(buffer, sizeof(buffer), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,"
+            "\"args\":{\"name\":\"worker %zu\"}}", first ? "" : ",", worker, worker);
+        out.append(buffer);
+        first = false;
+
+        // Copy the newest spans, then drop any the worker overwrote meanwhile,
+        // including the slot it may be writing right now
+        uint64_t end = ring.next.load(std::memory_order_acquire);
+        uint64_t begin = end > kCapacity ? end - kCapacity : 0;
+        std::vector<Copy> spans;
+        spans.reserve(end - begin);
+        for (uint64_t i = begin; i < end; i++)
+        {
+            const Record& slot = ring.records[i & (kCapacity - 1)];
+            spans.push_back(Copy{slot.start.load(std::memory_order_relaxed),
+                slot.end.load(std::memory_order_relaxed), slot.info.load(std::memory_order_relaxed)});
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = ring.next.load(std::memory_order_relaxed);
+        uint64_t firstValid = after + 1 > kCapacity ? after + 1 - kCapacity : 0;
+
+        for (uint64_t i = std::max(begin, firstValid); i < end; i++)
+        {
+            const Copy& span = spans[i - begin];
+            if (span.start < s_epoch)
+                continue;
+
+            auto phase = static_cast<size_t>(span.info & 0xFF);
+            double ts = (span.start - s_epoch) * s_nsPerTick / 1000.0;
+            double dur = (span.end - span.start) * s_nsPerTick / 1000.0;
+            snprintf(buffer, sizeof(buffer), ",{\"name\":\"%s\",\"cat\":\"http\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,"
+                "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"fd\":%llu,\"request\":%llu}}",
+                phase < std::size(kPhaseNames) ? kPhaseNames[phase] : "unknown", worker, ts, dur,
+                static_cast<unsigned long long>((span.info >> 8) & 0xFFFFFF),
+                static_cast<unsigned long long>(span.info >> 32));
+            out.append(buffer);
+        }
+    }
+
+    out.append("]}");
+    return out;
+}
\ No newline at end of file
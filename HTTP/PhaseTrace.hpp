@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Where a request spends its time on a worker, sampled per connection event
+enum class Phase : uint8_t
+{
+    ReadEvent,      // a read event on the connection, encloses the phases below
+    WriteEvent,
+    Queued,         // from kevent() returning to the event being handled
+    Recv,
+    Parse,          // toRequest, HTTP/1.1 only
+    Route,          // Router::getResponse and conditional/range handling
+    Compress,
+    Serialize,      // toString, HTTP/1.1 only
+    Send,
+};
+
+// Low-overhead phase timing, exported in the Chrome trace-event format for
+// chrome://tracing or Perfetto. Timestamps come from the TSC (or the ARM
+// virtual counter), converted to time only on export.
+//
+// Each worker writes its own ring of the latest kCapacity spans, lock-free;
+// export may run on any thread and skips spans overwritten while copying.
+// One in sampleEvery connection events is traced, the rest cost a
+// thread-local check per span.
+class PhaseTrace
+{
+public:
+    static uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        uint64_t ticks;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+        return ticks;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Turn tracing on for all workers, 0 = off. Calibrates the clock once.
+    static void enable(int sampleEvery);
+    static bool enabled() { return s_sampleEvery.load(std::memory_order_relaxed) > 0; }
+
+    // Worker side: the calling thread records into worker's ring
+    static void attachWorker(int worker);
+
+    // Around each connection event. Decides whether it is sampled, and if so
+    // records the time it waited since kevent() returned (polledAt).
+    static void beginEvent(Phase phase, int fd, uint64_t polledAt);
+    static void endEvent();
+
+    // Requests served within a sampled event are numbered in its spans
+    static void nextRequest();
+
+    // Times one phase if the current event is sampled
+    class Span
+    {
+    private:
+        Phase m_phase;
+        uint64_t m_start;
+
+    public:
+        explicit Span(Phase phase) : m_phase(phase), m_start(t_sampled ? now() : 0) {}
+        ~Span()
+        {
+            if (m_start)
+                record(m_phase, m_start, now());
+        }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+    };
+
+    // Every worker's ring as {"traceEvents": [...]}
+    static std::string exportJson();
+
+private:
+    static std::atomic<int> s_sampleEvery;
+    static inline thread_local bool t_sampled{false};    // the current event is traced
+
+    static void record(Phase phase, uint64_t start, uint64_t end);
+};
\ No newline at end of file
@@ -11,14 +11,29 @@ private:
     Uri m_uri;
 
 public:
-    Request() : m_method(Method::GET) {}
+    explicit Request(allocator_type alloc = {}) : MessageInterface(alloc), m_method(Method::GET), m_uri(alloc) {}
     ~Request() = default;
 
     void setMethod(Method method) {m_method = method; }
-    void setUri(const Uri& uri) { m_uri = std::move(uri); }
+    void setUri(const Uri& uri) { m_uri = uri; }
+    // The request-target as sent, throws std::invalid_argument if malformed
+    void setTarget(std::string_view target) { m_uri.parse(target); }
+
+    // Origin-form targets take their host and port from the Host header
+    void resolveAuthority()
+    {
+        if (m_uri.host().empty())
+            m_uri.setAuthority(header("Host"));
+    }
 
     Method method() const { return m_method; }
-    Uri uri() const { return m_uri; }
+    const Uri& uri() const { return m_uri; }
+    std::string_view path() const { return m_uri.path(); }
+
+    // Query parameters, see Uri
+    bool hasQueryParam(std::string_view name) const { return m_uri.hasQueryParam(name); }
+    std::string_view rawQueryParam(std::string_view name) const { return m_uri.rawQueryParam(name); }
+    std::string queryParam(std::string_view name) const { return m_uri.queryParam(name); }
 
     friend std::string toString(const Request& request);
     friend std::string toRequest(const std::string& string);
@@ -0,0 +1,36 @@
+#include "RequestArena.hpp"
+
+RequestArena::RequestArena()
+    : m_initial(std::make_unique<std::byte[]>(kInitialSize))
+    , m_resource(m_initial.get(), kInitialSize, std::pmr::new_delete_resource())
+{
+}
+
+RequestArena& RequestArena::local()
+{
+    // Created lazily by the worker itself, after it was pinned
+    thread_local RequestArena arena;
+    return arena;
+}
+
+void* RequestArena::do_allocate(size_t bytes, size_t alignment)
+{
+    m_used += bytes;
+    return m_resource.allocate(bytes, alignment);
+}
+
+RequestArena::Scope::Scope()
+    : m_arena(local())
+{
+    m_arena.m_depth++;
+}
+
+RequestArena::Scope::~Scope()
+{
+    if (--m_arena.m_depth > 0)
+        return;
+
+    // Keeps the initial buffer, drops any overflow blocks
+    m_arena.m_resource.release();
+    m_arena.m_used = 0;
+}
\ No newline at end of file
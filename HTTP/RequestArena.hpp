@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+// Per-worker monotonic arena for everything built while serving one request:
+// the parsed Request, the Response and any handler scratch memory (through
+// request.get_allocator()). Nothing is freed individually, the whole arena is
+// rewound once the response has been serialized.
+class RequestArena : public std::pmr::memory_resource
+{
+private:
+    static constexpr size_t kInitialSize = 64 * 1024;
+
+    std::unique_ptr<std::byte[]> m_initial;
+    std::pmr::monotonic_buffer_resource m_resource;
+    size_t m_used{0};
+    int m_depth{0};
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+public:
+    RequestArena();
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    // The calling worker's arena
+    static RequestArena& local();
+
+    // Bytes handed out since the last reset
+    size_t used() const { return m_used; }
+
+    // Marks the lifetime of one request. Scopes nest (an h2c upgrade serves
+    // its first stream from inside the HTTP/1.1 request), the arena is only
+    // rewound when the outermost one ends, so it must outlive every object
+    // allocated within it.
+    class Scope
+    {
+    private:
+        RequestArena& m_arena;
+
+    public:
+        Scope();
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        std::pmr::memory_resource* resource() { return &m_arena; }
+    };
+};
\ No newline at end of file
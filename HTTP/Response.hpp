@@ -2,6 +2,7 @@
 
 #include "MessageInterface.hpp"
 #include "Enum.hpp"
+#include "HTTPUtils.hpp"
 
 #include <string>
 
@@ -9,14 +10,24 @@ class Response : public MessageInterface
 {
 private:
     StatusCode m_statusCode;
+    bool m_cacheable = false; // body is reused across requests (e.g. static content)
+    http::utils::Sha256Digest m_contentDigest{};   // of the body, when computed in advance
+    bool m_hasContentDigest = false;
 
 public:
-    Response() : m_statusCode(StatusCode::Ok) {}
-    Response(StatusCode code) : m_statusCode(code) {}
+    explicit Response(allocator_type alloc = {}) : MessageInterface(alloc), m_statusCode(StatusCode::Ok) {}
+    Response(StatusCode code, allocator_type alloc = {}) : MessageInterface(alloc), m_statusCode(code) {}
     ~Response() = default;
 
     StatusCode statusCode() const { return m_statusCode; }
     void setStatusCode(StatusCode code) { m_statusCode = code; }
+    bool cacheable() const { return m_cacheable; }
+    void setCacheable(bool cacheable) { m_cacheable = cacheable; }
+    const http::utils::Sha256Digest* contentDigest() const { return m_hasContentDigest ? &m_contentDigest : nullptr; }
+    void setContentDigest(const http::utils::Sha256Digest& digest) { m_contentDigest = digest; m_hasContentDigest = true; }
+
+    // A new body invalidates the digest
+    void setContent(std::string_view body) { MessageInterface::setContent(body); m_hasContentDigest = false; }
 
     friend std::string toString(const Response& request, bool sendBody);
     // friend std::string toResponse(const std::string& string);
@@ -0,0 +1,61 @@
+#include <ctime>
+
+#include "RouteTable.hpp"
+#include "HTTPUtils.hpp"
+
+void RouteTable::addHandler(const std::string& path, Method method, RequestHandler callback)
+{
+    Route& route = routes[path];
+    route.handlers[method] = std::move(callback);
+    if (!route.arenaPeak)
+        route.arenaPeak = std::make_shared<std::atomic<size_t>>(0);
+}
+
+void RouteTable::addStaticResponse(const std::string& path, Response response)
+{
+    response.setCacheable(true);
+    response.setContentDigest(http::utils::sha256(response.content()));
+    if (!response.hasHeader("ETag"))
+        response.setHeader("ETag", http::utils::makeETag(response.content()));
+    if (!response.hasHeader("Last-Modified"))
+        response.setHeader("Last-Modified", http::utils::formatHttpDate(std::time(nullptr)));
+    response.setHeader("Accept-Ranges", "bytes");
+
+    // The table outlives any request, so the stored copy must not live in the
+    // arena of one (a response built from request.get_allocator())
+    auto copy = std::make_shared<Response>(Response::allocator_type(std::pmr::get_default_resource()));
+    *copy = response;
+
+    // dispatch() serves GET/HEAD from the map, the handlers keep 405s for other methods
+    std::shared_ptr<const Response> stored = std::move(copy);
+    staticResponses[path] = stored;
+    RequestHandler handler = [stored](const Request&)
+    {
+        return *stored;
+    };
+
+    addHandler(path, Method::GET, handler);
+    addHandler(path, Method::HEAD, std::move(handler));
+}
+
+void RouteTable::addWebSocket(const std::string& path, WebSocketHandler handler)
+{
+    webSockets[path] = std::move(handler);
+}
+
+void RouteTable::addSingleFlight(const std::string& path, std::vector<std::string> keyHeaders)
+{
+    singleFlights[path] = std::move(keyHeaders);
+}
+
+void RouteTable::remove(std::string_view path)
+{
+    if (auto it = routes.find(path); it != routes.end())
+        routes.erase(it);
+    if (auto it = webSockets.find(path); it != webSockets.end())
+        webSockets.erase(it);
+    if (auto it = staticResponses.find(path); it != staticResponses.end())
+        staticResponses.erase(it);
+    if (auto it = singleFlights.find(path); it != singleFlights.end())
+        singleFlights.erase(it);
+}
\ No newline at end of file
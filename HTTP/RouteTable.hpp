@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Request.hpp"
+#include "Response.hpp"
+#include "WebSocket.hpp"
+
+using RequestHandler = std::function<Response(const Request&)>;
+
+// One version of the routes. Router publishes a new table for every change
+// and never modifies a published one, so workers read it without locks.
+// Tables are built by copying the current one and editing the copy.
+//
+// Every map is keyed by the undecoded path, looked up with a view into the request.
+struct RouteTable
+{
+    struct Route
+    {
+        std::map<Method, RequestHandler> handlers;
+        std::shared_ptr<std::atomic<size_t>> arenaPeak;     // carried over while the route exists
+    };
+
+    uint64_t version{0};
+    std::map<std::string, Route, std::less<>> routes;
+    std::map<std::string, WebSocketHandler, std::less<>> webSockets;
+    std::map<std::string, std::shared_ptr<const Response>, std::less<>> staticResponses;   // GET/HEAD, without a handler
+
+    // Coalesced routes, with the request headers beyond the defaults that
+    // tell their requests apart
+    std::map<std::string, std::vector<std::string>, std::less<>> singleFlights;
+
+    void addHandler(const std::string& path, Method method, RequestHandler callback);
+
+    // Sets the response's ETag, Last-Modified and Accept-Ranges, and 405s
+    // for methods other than GET and HEAD
+    void addStaticResponse(const std::string& path, Response response);
+    void addWebSocket(const std::string& path, WebSocketHandler handler);
+    void addSingleFlight(const std::string& path, std::vector<std::string> keyHeaders);
+
+    // Everything registered on path, of any kind
+    void remove(std::string_view path);
+};
\ No newline at end of file
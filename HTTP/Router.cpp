@@ -1,41 +1,303 @@
+#include <algorithm>
+#include <ctime>
 #include <string>
+#include <vector>
 
 #include "Router.hpp"
 #include "Enum.hpp"
 #include "Request.hpp"
 #include "Response.hpp"
 #include "HTTPUtils.hpp"
+#include "CompressionUtils.hpp"
+#include "HTTP2Session.hpp"
+#include "RequestArena.hpp"
+#include "PhaseTrace.hpp"
 #include "spdlog/spdlog.h"
 
+namespace
+{
+
+// The calling reader thread's slot in the Router it serves
+thread_local std::atomic<uint64_t>* t_readerEpoch = nullptr;
+
+}
+
+Router::Router()
+    : m_table(new RouteTable())
+{
+}
+
+Router::~Router()
+{
+    for (auto& [table, epoch] : m_retired)
+        delete table;
+    delete m_table.load();
+}
+
+void Router::update(const std::function<void(RouteTable&)>& edit)
+{
+    std::lock_guard<std::mutex> lock(m_publishMutex);
+
+    auto table = std::make_unique<RouteTable>(*m_table.load(std::memory_order_relaxed));
+    edit(*table);
+    table->version++;
+
+    // Readers that pass a quiescent state after the bump can no longer see the old table
+    const RouteTable* old = m_table.exchange(table.release(), std::memory_order_seq_cst);
+    uint64_t epoch = m_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    m_retired.emplace_back(old, epoch);
+    reclaim();
+}
+
+void Router::reclaim()
+{
+    // The oldest epoch any attached reader may still be reading in
+    uint64_t oldest = UINT64_MAX;
+    for (const auto& slot : m_readers)
+    {
+        uint64_t epoch = slot->epoch.load(std::memory_order_seq_cst);
+        if (epoch != 0)
+            oldest = std::min(oldest, epoch);
+    }
+
+    std::erase_if(m_retired, [oldest](const std::pair<const RouteTable*, uint64_t>& retired)
+    {
+        if (retired.second > oldest)
+            return false;
+        delete retired.first;
+        return true;
+    });
+}
+
+void Router::attachReader()
+{
+    std::lock_guard<std::mutex> lock(m_publishMutex);
+
+    ReaderSlot* slot = nullptr;
+    for (auto& candidate : m_readers)
+    {
+        if (!candidate->attached)
+        {
+            slot = candidate.get();
+            break;
+        }
+    }
+    if (!slot)
+        slot = m_readers.emplace_back(std::make_unique<ReaderSlot>()).get();
+
+    slot->attached = true;
+    slot->epoch.store(m_epoch.load(), std::memory_order_seq_cst);
+    t_readerEpoch = &slot->epoch;
+}
+
+void Router::detachReader()
+{
+    std::lock_guard<std::mutex> lock(m_publishMutex);
+    for (auto& slot : m_readers)
+    {
+        if (&slot->epoch == t_readerEpoch)
+        {
+            slot->epoch.store(0, std::memory_order_seq_cst);
+            slot->attached = false;
+        }
+    }
+    t_readerEpoch = nullptr;
+    reclaim();
+}
+
+void Router::quiescent()
+{
+    // Ordered before this thread's next table load
+    if (!t_readerEpoch)
+        return;
+    t_readerEpoch->store(m_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
 void Router::registerHandler(const std::string& path, Method method, RequestHandler callback)
 {
-    Uri uri(path);
-    m_handlers[uri][method] = std::move(callback);
+    update([&](RouteTable& table)
+    {
+        table.addHandler(path, method, std::move(callback));
+    });
+}
+
+void Router::removeRoute(std::string_view path)
+{
+    update([path](RouteTable& table)
+    {
+        table.remove(path);
+    });
+}
+
+void Router::registerStaticResponse(const std::string& path, Response response)
+{
+    update([&](RouteTable& table)
+    {
+        table.addStaticResponse(path, std::move(response));
+    });
+}
+
+void Router::registerWebSocket(const std::string& path, WebSocketHandler handler)
+{
+    update([&](RouteTable& table)
+    {
+        table.addWebSocket(path, std::move(handler));
+    });
+}
+
+void Router::registerSingleFlight(const std::string& path, std::vector<std::string> keyHeaders)
+{
+    update([&](RouteTable& table)
+    {
+        table.addSingleFlight(path, std::move(keyHeaders));
+    });
 }
 
-Response Router::getResponse(const Request& request)
+bool Router::singleFlightKey(const RouteTable& table, const Request& request, std::string& key) const
 {
-    auto it = m_handlers.find(request.uri());
-    if (it == m_handlers.end())
+    if (request.method() != Method::GET && request.method() != Method::HEAD)
+        return false;
+    auto it = table.singleFlights.find(request.path());
+    if (it == table.singleFlights.end())
+        return false;
+
+    key.append(http::utils::toString(request.method())).append(" ");
+    key.append(request.uri().decodedPath());
+    if (request.uri().hasQuery())
+        key.append("?").append(request.uri().query());
+
+    // Everything the response may depend on, a missing header counts as empty
+    auto appendHeader = [&key, &request](std::string_view name)
+    {
+        key.append("\n").append(name).append(": ").append(request.header(name));
+    };
+    for (std::string_view name : {"Accept-Encoding", "Range", "If-Range", "If-None-Match", "If-Modified-Since"})
+        appendHeader(name);
+    for (const std::string& name : it->second)
+        appendHeader(name);
+    return true;
+}
+
+Response Router::getResponse(const RouteTable& table, const Request& request)
+{
+    auto it = table.routes.find(request.path());
+    if (it == table.routes.end())
         return Response(StatusCode::NotFound);
     
-    auto callbackIt = it->second.find(request.method());
-    if (callbackIt == it->second.end())
+    auto callbackIt = it->second.handlers.find(request.method());
+    if (callbackIt == it->second.handlers.end())
         return Response(StatusCode::MethodNotAllowed);
     
     return callbackIt->second(request);
 }
 
-void Router::populateResponse(ClientContext* request, ClientContext* response)
+Response Router::dispatch(const Request& request)
+{
+    return dispatch(request, request.get_allocator());
+}
+
+Response Router::dispatch(const Request& request, Response::allocator_type alloc)
 {
-    std::string requestStr(request->buffer), responseStr;
-    Request httpRequest;
-    Response httpResponse;
+    Response response(alloc);
+    const RouteTable& table = routes();
 
     try
     {
-        httpRequest = http::utils::toRequest(requestStr);
-        httpResponse = getResponse(httpRequest);
+        auto staticIt = table.staticResponses.end();
+        if (request.method() == Method::GET || request.method() == Method::HEAD)
+            staticIt = table.staticResponses.find(request.path());
+
+        if (staticIt != table.staticResponses.end())
+        {
+            PhaseTrace::Span span(Phase::Route);
+            if (!answerConditional(request, *staticIt->second, response))
+                response = *staticIt->second;
+        }
+        else
+        {
+            PhaseTrace::Span span(Phase::Route);
+            response = getResponse(table, request);
+            addValidators(request, response);
+
+            Response partial(alloc);
+            if (answerConditional(request, response, partial))
+                response = partial;
+        }
+    }
+    catch(const std::exception &e)
+    {
+        response = Response(StatusCode::InternalServerError);
+        response.setContent(e.what());
+    }
+
+    applyContentEncoding(request, response);
+    recordArenaUsage(table, request.path(), RequestArena::local().used());
+    return response;
+}
+
+void Router::recordArenaUsage(const RouteTable& table, std::string_view path, size_t bytes)
+{
+    auto it = table.routes.find(path);
+    if (it == table.routes.end())
+        return;
+
+    std::atomic<size_t>& peak = *it->second.arenaPeak;
+    size_t current = peak.load(std::memory_order_relaxed);
+    while (bytes > current && !peak.compare_exchange_weak(current, bytes, std::memory_order_relaxed));
+}
+
+void Router::logArenaUsage()
+{
+    // Holding the writers' lock keeps the current table alive
+    std::lock_guard<std::mutex> lock(m_publishMutex);
+    for (const auto& [path, route] : m_table.load()->routes)
+        spdlog::info("Peak request arena usage for {}: {} bytes", path, route.arenaPeak->load());
+}
+
+void Router::populateResponse(ClientContext* ctx, std::string_view request)
+{
+    // Everything below lives in the worker's arena, rewound once serialized
+    RequestArena::Scope arena;
+    Request httpRequest(arena.resource());
+    Response httpResponse(arena.resource());
+    size_t outputLength = ctx->output.length();
+    std::string flightKey;
+    const RouteTable& table = routes();
+    PhaseTrace::nextRequest();
+
+    try
+    {
+        {
+            PhaseTrace::Span span(Phase::Parse);
+            http::utils::parseRequest(request, httpRequest);
+        }
+
+        // Upgrade: h2c, the session answers this request on stream 1
+        if (HTTP2Session::isUpgradeRequest(httpRequest))
+        {
+            ctx->http2 = new HTTP2Session(*this);
+            ctx->http2->upgrade(httpRequest);
+            return;
+        }
+
+        // Upgrade: websocket, on a registered route only
+        if (WebSocketSession::isUpgradeRequest(httpRequest))
+        {
+            auto it = table.webSockets.find(httpRequest.path());
+            if (it != table.webSockets.end())
+            {
+                ctx->output.append(WebSocketSession::handshakeResponse(httpRequest));
+                ctx->websocket = new WebSocketSession(it->second, it->first);
+                return;
+            }
+        }
+
+        // A duplicate of a request already being served waits for its response
+        if (m_singleFlight && singleFlightKey(table, httpRequest, flightKey) && !m_singleFlight->join(flightKey, ctx))
+            return;
+
+        httpResponse = dispatch(httpRequest);
     }
     catch(const std::invalid_argument &e)
     {
@@ -53,10 +315,175 @@ void Router::populateResponse(ClientContext* request, ClientContext* response)
         httpResponse.setContent(e.what());
     }
     
-    responseStr = http::utils::toString(httpResponse, httpRequest.method() != Method::HEAD);
-    memcpy(response->buffer, responseStr.c_str(), k_maxBufferSize);
-    response->length = responseStr.length();
+    {
+        PhaseTrace::Span span(Phase::Serialize);
+        http::utils::appendResponse(ctx->output, httpResponse, httpRequest.method() != Method::HEAD
+            && httpResponse.statusCode() != StatusCode::NotModified);
+    }
+
+    // Waiters get the same bytes, copied once
+    if (!flightKey.empty())
+        m_singleFlight->complete(flightKey, std::make_shared<const std::string>(ctx->output, outputLength));
+
+    spdlog::debug("[fd {}] Response created, buffer size = {}",
+        ctx->fd, ctx->output.length() - outputLength);
+}
+
+void Router::applyContentEncoding(const Request& request, Response& response)
+{
+    if (request.method() == Method::HEAD
+        || response.statusCode() == StatusCode::PartialContent
+        || static_cast<size_t>(response.contentLength()) < http::utils::k_minCompressSize
+        || response.hasHeader("Content-Encoding")
+        || !http::utils::isCompressibleType(response.header("Content-Type")))
+        return;
+
+    // Intermediaries must not transform these
+    std::string_view cacheControl = response.header("Cache-Control");
+    if (cacheControl.find("no-transform") != std::string_view::npos)
+        return;
+
+    response.setHeader("Vary", "Accept-Encoding");
+
+    PhaseTrace::Span span(Phase::Compress);
+    ContentEncoding encoding = http::utils::negotiateEncoding(request.header("Accept-Encoding"));
+    if (encoding == ContentEncoding::Identity)
+        return;
+
+    // Static and publicly cacheable bodies are compressed once and reused
+    bool cacheable = response.cacheable()
+        || ((cacheControl.find("public") != std::string_view::npos
+                || cacheControl.find("max-age") != std::string_view::npos)
+            && cacheControl.find("no-store") == std::string_view::npos
+            && cacheControl.find("private") == std::string_view::npos);
+
+    std::string compressed = cacheable
+        ? m_compressionCache.compress(response.content(), encoding, response.contentDigest())
+        : http::utils::compress(response.content(), encoding);
+
+    // Incompressible after all, identity is cheaper for the client
+    size_t originalLength = response.contentLength();
+    if (compressed.length() >= originalLength)
+        return;
+
+    response.setContent(compressed);
+    response.setHeader("Content-Encoding", http::utils::toString(encoding));
+
+    // Same content, different bytes: the tag only holds for weak comparison
+    std::string etag(response.header("ETag"));
+    if (!etag.empty() && !etag.starts_with("W/"))
+        response.setHeader("ETag", "W/" + etag);
+
+    spdlog::debug("Compressed response body with {}, {} -> {} bytes",
+        http::utils::toString(encoding), originalLength, compressed.length());
+}
+
+void Router::addValidators(const Request& request, Response& response)
+{
+    if ((request.method() != Method::GET && request.method() != Method::HEAD)
+        || response.statusCode() != StatusCode::Ok
+        || response.hasHeader("ETag")
+        || response.header("Cache-Control").find("no-store") != std::string_view::npos)
+        return;
+
+    response.setHeader("ETag", http::utils::makeETag(response.content()));
+    response.setHeader("Accept-Ranges", "bytes");
+}
+
+bool Router::answerConditional(const Request& request, const Response& full, Response& out)
+{
+    if ((request.method() != Method::GET && request.method() != Method::HEAD)
+        || full.statusCode() != StatusCode::Ok)
+        return false;
+
+    std::string_view etag = full.header("ETag");
+    std::string_view lastModified = full.header("Last-Modified");
+
+    // If-None-Match takes precedence over If-Modified-Since
+    bool notModified = false;
+    if (std::string_view ifNoneMatch = request.header("If-None-Match"); !ifNoneMatch.empty())
+        notModified = !etag.empty() && http::utils::matchesETag(ifNoneMatch, etag, false);
+    else if (std::string_view ifModifiedSince = request.header("If-Modified-Since");
+        !ifModifiedSince.empty() && !lastModified.empty())
+    {
+        std::time_t since = http::utils::parseHttpDate(ifModifiedSince);
+        std::time_t modified = http::utils::parseHttpDate(lastModified);
+        notModified = since >= 0 && modified >= 0 && modified <= since;
+    }
+
+    if (notModified)
+    {
+        out.setStatusCode(StatusCode::NotModified);
+        for (std::string_view name : {"ETag", "Last-Modified", "Cache-Control", "Expires", "Vary"})
+        {
+            if (std::string_view value = full.header(name); !value.empty())
+                out.setHeader(name, value);
+        }
+        if (static_cast<size_t>(full.contentLength()) >= http::utils::k_minCompressSize
+            && http::utils::isCompressibleType(full.header("Content-Type")))
+            out.setHeader("Vary", "Accept-Encoding");
+        return true;
+    }
+
+    std::string_view range = request.header("Range");
+    if (range.empty() || request.method() != Method::GET)
+        return false;
+
+    // Ranges of an older representation are useless, send all of this one
+    if (std::string_view ifRange = request.header("If-Range"); !ifRange.empty())
+    {
+        bool current = ifRange.front() == '"' || ifRange.starts_with("W/")
+            ? !etag.empty() && http::utils::matchesETag(ifRange, etag, true)
+            : !lastModified.empty() && http::utils::parseHttpDate(ifRange) >= 0
+                && http::utils::parseHttpDate(ifRange) == http::utils::parseHttpDate(lastModified);
+        if (!current)
+            return false;
+    }
+
+    std::string_view content = full.content();
+    std::vector<http::utils::ByteRange> ranges;
+    if (!http::utils::parseRange(range, content.length(), ranges))
+        return false;
+
+    std::string total = std::to_string(content.length());
+    if (ranges.empty())
+    {
+        out.setStatusCode(StatusCode::RangeNotSatisfiable);
+        out.setHeader("Content-Range", "bytes */" + total);
+        return true;
+    }
+
+    out.setStatusCode(StatusCode::PartialContent);
+    for (const auto& [name, value] : full.headers())
+        out.setHeader(name, value);
+
+    auto contentRange = [&total](const http::utils::ByteRange& r)
+    {
+        return "bytes " + std::to_string(r.first) + "-" + std::to_string(r.last) + "/" + total;
+    };
+
+    if (ranges.size() == 1)
+    {
+        out.setHeader("Content-Range", contentRange(ranges[0]));
+        out.setContent(content.substr(ranges[0].first, ranges[0].last - ranges[0].first + 1));
+        return true;
+    }
+
+    // Several ranges, one multipart/byteranges body
+    std::string boundary = "byteranges-" + std::to_string(std::hash<std::string_view>{}(etag.empty() ? content : etag));
+    std::string_view type = full.header("Content-Type");
+    std::pmr::string body(out.get_allocator());
+    for (const http::utils::ByteRange& r : ranges)
+    {
+        body.append("\r\n--").append(boundary).append("\r\n");
+        if (!type.empty())
+            body.append("Content-Type: ").append(type).append("\r\n");
+        body.append("Content-Range: ").append(contentRange(r)).append("\r\n\r\n");
+        body.append(content.substr(r.first, r.last - r.first + 1));
+    }
+    body.append("\r\n--").append(boundary).append("--\r\n");
 
-    spdlog::info("[fd {}] Response struct created, buffer size = {}",
-        request->fd, response->length);
+    out.setHeader("Content-Type", "multipart/byteranges; boundary=" + boundary);
+    out.setContent(body);
+    return true;
 }
\ No newline at end of file
@@ -1,24 +1,112 @@
 #pragma once
 
 #include <utility>
-#include <map>
+#include <string_view>
+#include <string>
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "ClientContext.hpp"
 #include "Request.hpp"
 #include "Response.hpp"
-#include "Uri.hpp"
-
-using RequestHandler = std::function<Response(const Request&)>;
+#include "CompressionCache.hpp"
+#include "RouteTable.hpp"
+#include "SingleFlight.hpp"
 
+// Routes requests through the current RouteTable. Routes may be added and
+// removed at any time, from any thread: each change publishes a new table
+// with one atomic pointer swap, and workers read whichever table is current
+// without locks or waiting.
+//
+// Replaced tables are reclaimed once every reader thread has passed a
+// quiescent state, i.e. finished the requests it was serving when the swap
+// happened. Workers announce one per event loop iteration.
 class Router
 {
 private:
-    std::map<Uri, std::map<Method, RequestHandler>> m_handlers;
-    Response getResponse(const Request& request);
+    // A reader thread's view of m_epoch at its last quiescent state, 0 = not reading
+    struct alignas(64) ReaderSlot
+    {
+        std::atomic<uint64_t> epoch{0};
+        bool attached{false};
+    };
+
+    std::atomic<const RouteTable*> m_table;
+    std::atomic<uint64_t> m_epoch{1};
+
+    // Writers only
+    std::mutex m_publishMutex;
+    std::vector<std::unique_ptr<ReaderSlot>> m_readers;
+    std::vector<std::pair<const RouteTable*, uint64_t>> m_retired;     // with the epoch they were replaced in
+
+    CompressionCache m_compressionCache;
+    SingleFlight* m_singleFlight{nullptr};
+
+    const RouteTable& routes() const { return *m_table.load(std::memory_order_acquire); }
+    void reclaim();
+
+    bool singleFlightKey(const RouteTable& table, const Request& request, std::string& key) const;
+    Response getResponse(const RouteTable& table, const Request& request);
+    void recordArenaUsage(const RouteTable& table, std::string_view path, size_t bytes);
+
+    // Negotiate Accept-Encoding and compress the body in place
+    void applyContentEncoding(const Request& request, Response& response);
+
+    // ETag and Accept-Ranges on a 200 to GET/HEAD that has no validator yet
+    static void addValidators(const Request& request, Response& response);
+
+    // 304, 206 or 416 built into out from the full 200 response, copying
+    // only the requested ranges. False if the full response should be sent.
+    static bool answerConditional(const Request& request, const Response& full, Response& out);
 
 public:
-    Router() = default;
+    Router();
+    ~Router();
+    Router(const Router&) = delete;
+    Router& operator=(const Router&) = delete;
+
+    // Publish a copy of the current table with edit applied, as one version.
+    // Several changes in one edit take effect together.
+    void update(const std::function<void(RouteTable&)>& edit);
+    uint64_t version() const { return routes().version; }
+
+    // Single changes, each publishes a new version
     void registerHandler(const std::string& path, Method method, RequestHandler callback);
-    void populateResponse(ClientContext* request, ClientContext* response);
+    void removeRoute(std::string_view path);
+
+    // Route a parsed request (from any protocol) and negotiate its encoding.
+    // The response uses alloc, by default the request's allocator.
+    Response dispatch(const Request& request);
+    Response dispatch(const Request& request, Response::allocator_type alloc);
+
+    // Serve a fixed response for GET/HEAD, its compressed variants are cached.
+    // Its ETag and Last-Modified are fixed here, so conditional and range
+    // requests are answered without copying the body.
+    void registerStaticResponse(const std::string& path, Response response);
+    // Accept WebSocket upgrades on path, the connection then stays open and
+    // subscribed to broadcasts on that path
+    void registerWebSocket(const std::string& path, WebSocketHandler handler);
+
+    // Coalesce concurrent identical HTTP/1.1 GET and HEAD requests to path:
+    // the first runs the handler, the others, on any worker, share its
+    // serialized response. Requests are identical when their method, decoded
+    // path, query, Accept-Encoding, Range and If-* headers and keyHeaders match.
+    // Needs setSingleFlight(), HTTPServer provides it.
+    void registerSingleFlight(const std::string& path, std::vector<std::string> keyHeaders = {});
+    void setSingleFlight(SingleFlight* singleFlight) { m_singleFlight = singleFlight; }
+
+    // Reader threads, i.e. workers. Attach before serving requests, and call
+    // quiescent() whenever no request is in progress on the thread.
+    void attachReader();
+    void detachReader();
+    void quiescent();
+
+    // Parse one HTTP/1.1 request and append its serialized response to ctx->output
+    void populateResponse(ClientContext* ctx, std::string_view request);
+
+    // Peak RequestArena usage seen per route
+    void logArenaUsage();
 };
\ No newline at end of file
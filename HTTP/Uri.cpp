@@ -0,0 +1,300 @@
+#include <stdexcept>
+
+#include "Uri.hpp"
+#include "HTTPUtils.hpp"
+
+namespace
+{
+
+bool isControl(char c)
+{
+    return static_cast<unsigned char>(c) <= ' ' || c == 0x7F;
+}
+
+bool isUnreserved(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')
+        || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+}
+
+void Uri::parse(std::string_view target)
+{
+    m_target.assign(target);
+    m_targetLength = target.length();
+    m_scheme = m_host = m_path = m_query = m_fragment = Span{};
+    m_port = 0;
+    m_hasQuery = false;
+    m_params.clear();
+    m_paramsIndexed = false;
+
+    if (target.empty())
+        throw std::invalid_argument("Empty request target");
+    if (target.length() > UINT32_MAX)
+        throw std::invalid_argument("Request target too long");
+
+    // OPTIONS * HTTP/1.1
+    if (target == "*")
+    {
+        m_path = span(0, 1);
+        return;
+    }
+
+    size_t pos = 0;
+    if (target.front() != '/')
+    {
+        // absolute-form: the scheme ends before any '/', '?' or '#'
+        size_t schemeEnd = target.find("://");
+        if (schemeEnd == std::string_view::npos || schemeEnd == 0
+            || target.find_first_of("/?#") < schemeEnd)
+        {
+            // authority-form, CONNECT host:port
+            parseAuthority(0, target.length());
+            return;
+        }
+
+        m_scheme = span(0, schemeEnd);
+        size_t authorityStart = schemeEnd + 3;
+        size_t authorityEnd = target.find_first_of("/?#", authorityStart);
+        if (authorityEnd == std::string_view::npos)
+            authorityEnd = target.length();
+        parseAuthority(authorityStart, authorityEnd - authorityStart);
+        pos = authorityEnd;
+    }
+
+    // Path, then query, then fragment, in one pass
+    size_t i = pos;
+    while (i < target.length() && target[i] != '?' && target[i] != '#')
+    {
+        if (isControl(target[i]))
+            throw std::invalid_argument("Invalid character in request target");
+        i++;
+    }
+    m_path = span(pos, i - pos);
+
+    if (i < target.length() && target[i] == '?')
+    {
+        size_t queryStart = ++i;
+        while (i < target.length() && target[i] != '#')
+        {
+            if (isControl(target[i]))
+                throw std::invalid_argument("Invalid character in request target");
+            i++;
+        }
+        m_query = span(queryStart, i - queryStart);
+        m_hasQuery = true;
+    }
+
+    if (i < target.length())
+        m_fragment = span(i + 1, target.length() - i - 1);
+}
+
+void Uri::parseAuthority(size_t offset, size_t length)
+{
+    std::string_view authority = std::string_view(m_target).substr(offset, length);
+
+    // userinfo is deprecated in http(s) URIs, it is skipped
+    size_t at = authority.rfind('@');
+    if (at != std::string_view::npos)
+    {
+        offset += at + 1;
+        authority.remove_prefix(at + 1);
+    }
+
+    // An IPv6 literal keeps its brackets
+    size_t hostLength = authority.length();
+    if (authority.starts_with('['))
+    {
+        size_t close = authority.find(']');
+        if (close == std::string_view::npos)
+            throw std::invalid_argument("Invalid IPv6 host");
+        hostLength = close + 1;
+    }
+    else if (size_t colon = authority.rfind(':'); colon != std::string_view::npos)
+        hostLength = colon;
+
+    for (char c : authority.substr(0, hostLength))
+    {
+        if (isControl(c))
+            throw std::invalid_argument("Invalid character in host");
+    }
+    m_host = span(offset, hostLength);
+    m_port = 0;
+
+    if (hostLength == authority.length())
+        return;
+    if (authority[hostLength] != ':')
+        throw std::invalid_argument("Invalid authority");
+
+    // An empty port is allowed and means the scheme's default
+    std::string_view port = authority.substr(hostLength + 1);
+    unsigned value = 0;
+    for (char c : port)
+    {
+        if (c < '0' || c > '9' || (value = value * 10 + (c - '0')) > 65535)
+            throw std::invalid_argument("Invalid port");
+    }
+    m_port = static_cast<uint16_t>(value);
+}
+
+void Uri::setAuthority(std::string_view authority)
+{
+    if (authority.empty())
+        return;
+
+    size_t offset = m_target.length();
+    m_target.append(authority);
+    parseAuthority(offset, authority.length());
+}
+
+std::string_view Uri::path() const
+{
+    // "http://host" and "http://host?x" address the root
+    if (m_path.length == 0 && m_scheme.length > 0)
+        return "/";
+    return view(m_path);
+}
+
+std::string Uri::decodedPath() const
+{
+    return http::utils::percentDecode(path(), false);
+}
+
+std::string Uri::normalizedPath() const
+{
+    std::string_view raw = path();
+    std::string decoded;
+    decoded.reserve(raw.length());
+    for (size_t i = 0; i < raw.length(); i++)
+    {
+        int high, low;
+        if (raw[i] != '%' || i + 2 >= raw.length()
+            || (high = hexValue(raw[i + 1])) < 0 || (low = hexValue(raw[i + 2])) < 0)
+        {
+            decoded.push_back(raw[i]);
+            continue;
+        }
+
+        char c = static_cast<char>(high * 16 + low);
+        if (isUnreserved(c))
+            decoded.push_back(c);
+        else
+        {
+            constexpr char kHex[] = "0123456789ABCDEF";
+            decoded.push_back('%');
+            decoded.push_back(kHex[high]);
+            decoded.push_back(kHex[low]);
+        }
+        i += 2;
+    }
+
+    // "*" and authority-form have no segments
+    if (!decoded.starts_with('/'))
+        return decoded;
+
+    // Segment by segment, each output segment starts with its '/'
+    std::string normalized;
+    normalized.reserve(decoded.length());
+    std::vector<size_t> starts;
+    for (size_t pos = 0; pos < decoded.length(); )
+    {
+        size_t next = decoded.find('/', pos + 1);
+        if (next == std::string::npos)
+            next = decoded.length();
+        std::string_view segment = std::string_view(decoded).substr(pos + 1, next - pos - 1);
+        bool last = next == decoded.length();
+
+        if (segment == "..")
+        {
+            if (!starts.empty())
+            {
+                normalized.resize(starts.back());
+                starts.pop_back();
+            }
+            if (last)
+                normalized.push_back('/');
+        }
+        else if (segment == ".")
+        {
+            if (last)
+                normalized.push_back('/');
+        }
+        else
+        {
+            starts.push_back(normalized.length());
+            normalized.push_back('/');
+            normalized.append(segment);
+        }
+        pos = next;
+    }
+    return normalized.empty() ? "/" : normalized;
+}
+
+void Uri::indexParams() const
+{
+    m_paramsIndexed = true;
+
+    size_t start = m_query.offset;
+    size_t end = m_query.offset + m_query.length;
+    while (start < end)
+    {
+        size_t next = m_target.find('&', start);
+        if (next == std::string::npos || next > end)
+            next = end;
+
+        if (next > start)
+        {
+            size_t eq = m_target.find('=', start);
+            if (eq == std::string::npos || eq > next)
+                m_params.emplace_back(span(start, next - start), span(next, 0));
+            else
+                m_params.emplace_back(span(start, eq - start), span(eq + 1, next - eq - 1));
+        }
+        start = next + 1;
+    }
+}
+
+bool Uri::hasQueryParam(std::string_view name) const
+{
+    return findParam(name) != nullptr;
+}
+
+std::string_view Uri::rawQueryParam(std::string_view name) const
+{
+    const std::pair<Span, Span>* param = findParam(name);
+    return param ? view(param->second) : std::string_view();
+}
+
+std::string Uri::queryParam(std::string_view name) const
+{
+    return http::utils::percentDecode(rawQueryParam(name), true);
+}
+
+const std::pair<Uri::Span, Uri::Span>* Uri::findParam(std::string_view name) const
+{
+    if (!m_paramsIndexed)
+        indexParams();
+
+    for (const auto& param : m_params)
+    {
+        // Names are only decoded when they are encoded
+        std::string_view key = view(param.first);
+        if (key == name)
+            return &param;
+        if (key.find_first_of("%+") != std::string_view::npos && http::utils::percentDecode(key, true) == name)
+            return &param;
+    }
+    return nullptr;
+}
\ No newline at end of file
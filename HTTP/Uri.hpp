@@ -1,39 +1,84 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
-#include <algorithm>
+#include <string_view>
+#include <memory_resource>
+#include <vector>
 
+// A request-target split in a single pass: origin-form ("/path?query"),
+// absolute-form ("http://host:port/path?query"), authority-form ("host:port",
+// for CONNECT) or asterisk-form ("*"). The target is copied once, components
+// are offsets into that copy and stay percent-encoded until decoded on request.
 class Uri
 {
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
 private:
-    std::string m_path;
-    std::string m_scheme;
-    std::string m_host;
-    std::uint16_t m_port;
+    struct Span
+    {
+        uint32_t offset{0};
+        uint32_t length{0};
+    };
 
-public:
-    Uri() = default;
-    explicit Uri(const std::string& path) : m_path(path) { setPathToLowercase(); }
-    ~Uri() = default;
+    std::pmr::string m_target;      // the request-target, then any authority set from Host
+    size_t m_targetLength{0};
+    Span m_scheme;
+    Span m_host;
+    Span m_path;
+    Span m_query;
+    Span m_fragment;
+    uint16_t m_port{0};
+    bool m_hasQuery{false};
 
-    bool operator<(const Uri& other) const { return m_path < other.m_path; }
-    bool operator==(const Uri& other) const { return m_path == other.m_path; }
+    // name/value spans of the query, split on the first parameter lookup
+    mutable std::pmr::vector<std::pair<Span, Span>> m_params;
+    mutable bool m_paramsIndexed{false};
 
-    void setPath(const std::string& path)
+    std::string_view view(Span span) const { return std::string_view(m_target).substr(span.offset, span.length); }
+    Span span(size_t offset, size_t length) const
     {
-        m_path = std::move(path);
-        setPathToLowercase();
+        return Span{static_cast<uint32_t>(offset), static_cast<uint32_t>(length)};
     }
+    void parseAuthority(size_t offset, size_t length);
+    void indexParams() const;
+    const std::pair<Span, Span>* findParam(std::string_view name) const;
 
-    std::string path() const { return m_path; }
-    std::string scheme() const { return m_scheme; }
-    std::string host() const { return m_host; }
-    std::uint16_t port() const { return m_port; }
-
-private:
-    void setPathToLowercase()
+public:
+    explicit Uri(allocator_type alloc = {}) : m_target(alloc), m_params(alloc) {}
+    explicit Uri(std::string_view target, allocator_type alloc = {}) : m_target(alloc), m_params(alloc)
     {
-        std::transform(m_path.begin(), m_path.end(), m_path.begin(),
-                            [](char c) { return tolower(c); });
+        parse(target);
     }
+
+    // Throws std::invalid_argument on a malformed target
+    void parse(std::string_view target);
+
+    // host[:port] for targets without one, e.g. from the Host header
+    void setAuthority(std::string_view authority);
+
+    std::string_view target() const { return std::string_view(m_target).substr(0, m_targetLength); }
+    std::string_view scheme() const { return view(m_scheme); }
+    std::string_view host() const { return view(m_host); }
+    uint16_t port() const { return m_port; }
+
+    // Still percent-encoded, routes match on this
+    std::string_view path() const;
+    std::string_view query() const { return view(m_query); }
+    std::string_view fragment() const { return view(m_fragment); }
+    bool hasQuery() const { return m_hasQuery; }
+
+    std::string decodedPath() const;
+
+    // The path with percent-encoded unreserved characters decoded, other
+    // escapes in upper case and dot segments removed (RFC 3986 6.2.2), so
+    // "/a/%2E%2e/b" is "/b". Still encoded otherwise.
+    std::string normalizedPath() const;
+
+    // Query parameters, the first occurrence of name. The raw value is a view
+    // into the target, queryParam() decodes it ('+' is a space).
+    bool hasQueryParam(std::string_view name) const;
+    std::string_view rawQueryParam(std::string_view name) const;
+    std::string queryParam(std::string_view name) const;
 };
\ No newline at end of file
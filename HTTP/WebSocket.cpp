@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <strings.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "WebSocket.hpp"
+#include "HTTPUtils.hpp"
+#include "spdlog/spdlog.h"
+
+namespace
+{
+
+constexpr std::string_view kAcceptGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// Case-insensitive search for a comma-separated token, e.g. "keep-alive, Upgrade"
+bool hasToken(std::string_view value, std::string_view token)
+{
+    size_t start = 0;
+    while (start <= value.length())
+    {
+        size_t end = value.find(',', start);
+        if (end == std::string_view::npos)
+            end = value.length();
+
+        std::string_view item = value.substr(start, end - start);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t'))
+            item.remove_prefix(1);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t'))
+            item.remove_suffix(1);
+
+        if (item.length() == token.length() && strncasecmp(item.data(), token.data(), token.length()) == 0)
+            return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+void appendHeader(std::string& out, uint8_t opcode, uint64_t length)
+{
+    out.push_back(static_cast<char>(0x80 | opcode));
+    if (length < 126)
+        out.push_back(static_cast<char>(length));
+    else if (length <= 0xFFFF)
+    {
+        out.push_back(126);
+        out.push_back(static_cast<char>(length >> 8));
+        out.push_back(static_cast<char>(length));
+    }
+    else
+    {
+        out.push_back(127);
+        for (int shift = 56; shift >= 0; shift -= 8)
+            out.push_back(static_cast<char>(length >> shift));
+    }
+}
+
+}
+
+WebSocketSession::WebSocketSession(WebSocketHandler handler, std::string_view channel)
+    : m_handler(std::move(handler))
+    , m_channel(channel)
+{
+}
+
+bool WebSocketSession::isUpgradeRequest(const Request& request)
+{
+    return request.method() == Method::GET
+        && hasToken(request.header("Upgrade"), "websocket")
+        && hasToken(request.header("Connection"), "upgrade");
+}
+
+std::string WebSocketSession::handshakeResponse(const Request& request)
+{
+    if (request.header("Sec-WebSocket-Version") != "13")
+        throw std::invalid_argument("Unsupported WebSocket version, expected 13");
+
+    std::string_view key = request.header("Sec-WebSocket-Key");
+    if (http::utils::decodeBase64(key).length() != 16)
+        throw std::invalid_argument("Invalid Sec-WebSocket-Key");
+
+    std::string accept = http::utils::encodeBase64(http::utils::sha1(std::string(key) + std::string(kAcceptGuid)));
+
+    std::string response =
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: ";
+    response.append(accept);
+    response.append("\r\n\r\n");
+    return response;
+}
+
+SharedFrame WebSocketSession::encodeFrame(std::string_view message, bool binary)
+{
+    auto frame = std::make_shared<std::string>();
+    frame->reserve(message.length() + 10);
+    appendHeader(*frame, binary ? Binary : Text, message.length());
+    frame->append(message);
+    return frame;
+}
+
+void WebSocketSession::unmask(char* out, const char* in, size_t length, const uint8_t mask[4], uint64_t offset)
+{
+    // The key rotated so that its first byte applies to in[0]
+    uint8_t key[4];
+    for (int i = 0; i < 4; i++)
+        key[i] = mask[(offset + i) & 3];
+    uint32_t key32;
+    std::memcpy(&key32, key, sizeof(key32));
+
+    // Every step below is a multiple of 4 bytes, the key stays aligned
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i key256 = _mm256_set1_epi32(static_cast<int>(key32));
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_xor_si256(block, key256));
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i key128 = _mm_set1_epi32(static_cast<int>(key32));
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(block, key128));
+    }
+#elif defined(__ARM_NEON)
+    uint8x16_t key128 = vreinterpretq_u8_u32(vdupq_n_u32(key32));
+    for (; i + 16 <= length; i += 16)
+    {
+        uint8x16_t block = vld1q_u8(reinterpret_cast<const uint8_t*>(in + i));
+        vst1q_u8(reinterpret_cast<uint8_t*>(out + i), veorq_u8(block, key128));
+    }
+#endif
+
+    uint64_t key64 = static_cast<uint64_t>(key32) << 32 | key32;
+    for (; i + 8 <= length; i += 8)
+    {
+        uint64_t block;
+        std::memcpy(&block, in + i, sizeof(block));
+        block ^= key64;
+        std::memcpy(out + i, &block, sizeof(block));
+    }
+    for (; i < length; i++)
+        out[i] = static_cast<char>(in[i] ^ key[i & 3]);
+}
+
+size_t WebSocketSession::headerSize() const
+{
+    // 2 fixed bytes, extended length, masking key
+    size_t size = 2;
+    if (m_headerLength >= 2)
+    {
+        uint8_t length7 = m_header[1] & 0x7F;
+        if (length7 == 126)
+            size += 2;
+        else if (length7 == 127)
+            size += 8;
+        if (m_header[1] & 0x80)
+            size += 4;
+    }
+    return size;
+}
+
+bool WebSocketSession::receive(const char* data, size_t length)
+{
+    while (length > 0 && !m_closeSent)
+    {
+        if (!m_inPayload)
+        {
+            // The header size is known once its first two bytes are in
+            size_t needed;
+            while (length > 0 && m_headerLength < (needed = headerSize()))
+            {
+                size_t take = std::min(length, needed - m_headerLength);
+                std::memcpy(m_header + m_headerLength, data, take);
+                m_headerLength += take;
+                data += take;
+                length -= take;
+            }
+            if (m_headerLength < headerSize())
+                break;
+
+            if (!startFrame())
+                break;
+            if (m_payloadLength == 0)
+                endFrame();
+            continue;
+        }
+
+        // Control frames are never fragmented, data frames build up the message
+        size_t take = static_cast<size_t>(std::min<uint64_t>(length, m_payloadLength - m_payloadReceived));
+        std::string& target = m_opcode >= Close ? m_control : m_message;
+        size_t used = target.length();
+        target.resize(used + take);
+        unmask(target.data() + used, data, take, m_mask, m_payloadReceived);
+
+        m_payloadReceived += take;
+        data += take;
+        length -= take;
+        if (m_payloadReceived == m_payloadLength)
+            endFrame();
+    }
+
+    return !m_failed;
+}
+
+bool WebSocketSession::startFrame()
+{
+    uint8_t first = m_header[0];
+    uint8_t second = m_header[1];
+    m_fin = first & 0x80;
+    m_opcode = first & 0x0F;
+
+    // No extensions are negotiated, and clients must mask
+    if ((first & 0x70) || !(second & 0x80))
+    {
+        fail(1002);
+        return false;
+    }
+
+    uint8_t length7 = second & 0x7F;
+    size_t offset = 2;
+    if (length7 == 126)
+    {
+        m_payloadLength = uint64_t(m_header[2]) << 8 | m_header[3];
+        offset = 4;
+    }
+    else if (length7 == 127)
+    {
+        m_payloadLength = 0;
+        for (int i = 0; i < 8; i++)
+            m_payloadLength = m_payloadLength << 8 | m_header[2 + i];
+        offset = 10;
+    }
+    else
+        m_payloadLength = length7;
+    std::memcpy(m_mask, m_header + offset, sizeof(m_mask));
+
+    switch (m_opcode)
+    {
+    case Close:
+    case Ping:
+    case Pong:
+        if (!m_fin || m_payloadLength > 125)
+        {
+            fail(1002);
+            return false;
+        }
+        m_control.clear();
+        break;
+
+    case Continuation:
+        if (!m_fragmented)
+        {
+            fail(1002);
+            return false;
+        }
+        break;
+
+    case Text:
+    case Binary:
+        if (m_fragmented)
+        {
+            fail(1002);
+            return false;
+        }
+        m_fragmented = true;
+        m_binary = m_opcode == Binary;
+        m_message.clear();
+        break;
+
+    default:
+        fail(1002);
+        return false;
+    }
+
+    if (m_opcode < Close && m_payloadLength > kMaxMessageSize - m_message.length())
+    {
+        fail(1009);
+        return false;
+    }
+
+    m_inPayload = true;
+    m_payloadReceived = 0;
+    return true;
+}
+
+void WebSocketSession::endFrame()
+{
+    m_inPayload = false;
+    m_headerLength = 0;
+
+    switch (m_opcode)
+    {
+    case Ping:
+        sendControl(Pong, m_control);
+        return;
+
+    case Pong:
+        return;
+
+    case Close:
+        // Echo the status code, or nothing, and stop reading
+        if (m_control.length() == 1)
+            fail(1002);
+        else
+            sendControl(Close, std::string_view(m_control).substr(0, 2));
+        m_closeSent = true;
+        return;
+
+    default:
+        break;
+    }
+
+    if (!m_fin)
+        return;
+
+    m_fragmented = false;
+    try
+    {
+        m_handler(*this, m_message, m_binary);
+    }
+    catch (const std::exception& e)
+    {
+        spdlog::error("WebSocket handler on {} failed: {}", m_channel, e.what());
+        fail(1011);
+    }
+
+    // Keep the capacity for the next message, unless it was a large one
+    if (m_message.capacity() > 64 * 1024)
+        std::string().swap(m_message);
+    else
+        m_message.clear();
+}
+
+void WebSocketSession::fail(uint16_t code)
+{
+    m_failed = true;
+    close(code);
+}
+
+void WebSocketSession::sendControl(uint8_t opcode, std::string_view payload)
+{
+    if (m_closeSent)
+        return;
+
+    auto frame = std::make_shared<std::string>();
+    appendHeader(*frame, opcode, payload.length());
+    frame->append(payload);
+    send(SharedFrame(std::move(frame)));
+}
+
+void WebSocketSession::send(std::string_view message, bool binary)
+{
+    send(encodeFrame(message, binary));
+}
+
+void WebSocketSession::send(SharedFrame frame)
+{
+    // Nothing may follow a close frame
+    if (m_closeSent)
+        return;
+
+    m_queuedBytes += frame->length();
+    m_outbound.push_back(std::move(frame));
+}
+
+void WebSocketSession::close(uint16_t code)
+{
+    char payload[2] = {static_cast<char>(code >> 8), static_cast<char>(code)};
+    sendControl(Close, std::string_view(payload, sizeof(payload)));
+    m_closeSent = true;
+}
+
+size_t WebSocketSession::pendingBuffers(struct iovec* iov, size_t count) const
+{
+    size_t filled = 0;
+    size_t cursor = m_outboundCursor;
+    for (auto it = m_outbound.begin(); it != m_outbound.end() && filled < count; ++it)
+    {
+        iov[filled].iov_base = const_cast<char*>((*it)->data() + cursor);
+        iov[filled].iov_len = (*it)->length() - cursor;
+        filled++;
+        cursor = 0;
+    }
+    return filled;
+}
+
+void WebSocketSession::consume(size_t length)
+{
+    m_queuedBytes -= length;
+    while (length > 0)
+    {
+        size_t remaining = m_outbound.front()->length() - m_outboundCursor;
+        if (length < remaining)
+        {
+            m_outboundCursor += length;
+            return;
+        }
+
+        length -= remaining;
+        m_outbound.pop_front();
+        m_outboundCursor = 0;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+
+#include "Request.hpp"
+
+class WebSocketSession;
+
+// A serialized frame, shared by every connection it is queued on
+using SharedFrame = std::shared_ptr<const std::string>;
+
+// Called once per complete message, text or binary
+using WebSocketHandler = std::function<void(WebSocketSession& session, std::string_view message, bool binary)>;
+
+// Server side of an upgraded RFC 6455 connection.
+//
+// Bytes read from the socket are fed to receive(). Frame headers are parsed
+// incrementally and payloads are unmasked straight into the message being
+// assembled, so a frame split across reads is never buffered twice. Control
+// frames are answered here: pings get a pong, a close is echoed.
+//
+// Outbound frames are queued as shared buffers, a broadcast is serialized
+// once and the same bytes are queued on every subscriber.
+class WebSocketSession
+{
+private:
+    static constexpr size_t kMaxMessageSize = 1 << 20;
+    static constexpr size_t kMaxHeaderSize = 14;
+
+    enum Opcode : uint8_t
+    {
+        Continuation = 0x0,
+        Text = 0x1,
+        Binary = 0x2,
+        Close = 0x8,
+        Ping = 0x9,
+        Pong = 0xA
+    };
+
+    WebSocketHandler m_handler;
+    std::string m_channel;
+
+    // Frame being parsed
+    uint8_t m_header[kMaxHeaderSize];
+    size_t m_headerLength{0};
+    bool m_inPayload{false};
+    bool m_fin{false};
+    uint8_t m_opcode{0};
+    uint64_t m_payloadLength{0};
+    uint64_t m_payloadReceived{0};
+    uint8_t m_mask[4];
+
+    std::string m_message;              // data frames of the current message, unmasked
+    std::string m_control;              // payload of the current control frame
+    bool m_fragmented{false};           // a message is open, continuation frames expected
+    bool m_binary{false};
+
+    std::deque<SharedFrame> m_outbound;
+    size_t m_outboundCursor{0};         // bytes of the front frame already sent
+    size_t m_queuedBytes{0};
+
+    bool m_closeSent{false};
+    bool m_failed{false};
+    size_t m_subscriberSlot{0};
+
+    size_t headerSize() const;
+    bool startFrame();
+    void endFrame();
+    void fail(uint16_t code);
+    void sendControl(uint8_t opcode, std::string_view payload);
+
+public:
+    WebSocketSession(WebSocketHandler handler, std::string_view channel);
+
+    static bool isUpgradeRequest(const Request& request);
+
+    // The 101 answering a valid upgrade. Throws std::invalid_argument if the
+    // key or version is not acceptable.
+    static std::string handshakeResponse(const Request& request);
+
+    // One unmasked server frame
+    static SharedFrame encodeFrame(std::string_view message, bool binary);
+
+    // out[i] = in[i] ^ mask[(offset + i) % 4], 16 bytes at a time where SIMD is available.
+    // out may equal in.
+    static void unmask(char* out, const char* in, size_t length, const uint8_t mask[4], uint64_t offset);
+
+    // The route the connection upgraded on, broadcasts to it reach this session
+    const std::string& channel() const { return m_channel; }
+
+    // Index in the owning worker's subscriber list, kept by the server
+    size_t subscriberSlot() const { return m_subscriberSlot; }
+    void setSubscriberSlot(size_t slot) { m_subscriberSlot = slot; }
+
+    // Feed bytes read from the socket, returns false once the connection failed
+    bool receive(const char* data, size_t length);
+
+    void send(std::string_view message, bool binary = false);
+    void send(SharedFrame frame);
+    void close(uint16_t code = 1000);
+
+    // Unsent frames as iovecs, up to count of them, for writev()
+    size_t pendingBuffers(struct iovec* iov, size_t count) const;
+    size_t queuedBytes() const { return m_queuedBytes; }
+    void consume(size_t length);
+
+    // Close after the pending output was flushed
+    bool wantsClose() const { return m_closeSent && m_queuedBytes == 0; }
+};
\ No newline at end of file
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+#include "AdmissionControl.hpp"
+
+namespace
+{
+
+uint64_t packState(uint64_t tokens, uint32_t timestamp)
+{
+    return (tokens << 32) | timestamp;
+}
+
+}
+
+AdmissionControl::AdmissionControl(const ServerConfig& config)
+    : m_epoch(std::chrono::steady_clock::now())
+    , m_rate(config.rateLimit)
+    , m_burst(static_cast<uint64_t>(config.rateBurst > 0 ? config.rateBurst : config.rateLimit) * 1000)
+    , m_maxConnections(config.maxConnections)
+    , m_maxInFlight(config.maxInFlight)
+{
+    if (m_rate > 0)
+        m_shards = std::make_unique<Shard[]>(kShards);
+}
+
+uint32_t AdmissionControl::nowMs() const
+{
+    // Wraps after ~49 days, refills only look at differences
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - m_epoch).count());
+}
+
+uint64_t AdmissionControl::clientKey(const sockaddr_storage& addr)
+{
+    // +1 keeps 0 free as the empty slot marker
+    if (addr.ss_family == AF_INET)
+        return static_cast<uint64_t>(ntohl(reinterpret_cast<const sockaddr_in&>(addr).sin_addr.s_addr)) + 1;
+
+    if (addr.ss_family == AF_INET6)
+    {
+        const in6_addr& ip = reinterpret_cast<const sockaddr_in6&>(addr).sin6_addr;
+        if (IN6_IS_ADDR_V4MAPPED(&ip))
+        {
+            uint32_t v4;
+            std::memcpy(&v4, ip.s6_addr + 12, sizeof(v4));
+            return static_cast<uint64_t>(ntohl(v4)) + 1;
+        }
+
+        uint64_t prefix = 0;
+        for (int i = 0; i < 8; i++)
+            prefix = prefix << 8 | ip.s6_addr[i];
+        return prefix | 1ull << 63;
+    }
+
+    return kUnixClientKey;
+}
+
+AdmissionControl::Slot& AdmissionControl::findSlot(uint64_t key, uint32_t now)
+{
+    // Fibonacci hashing spreads neighbouring addresses over the shards
+    Shard& shard = m_shards[(key * 0x9e3779b97f4a7c15ull) >> 50];
+    Slot* oldest = &shard.slots[0];
+    int32_t oldestAge = -1;
+
+    for (Slot& slot : shard.slots)
+    {
+        uint64_t current = slot.key.load(std::memory_order_acquire);
+        if (current == key)
+            return slot;
+
+        if (current == 0)
+        {
+            if (slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel))
+            {
+                slot.state.store(packState(m_burst, now), std::memory_order_release);
+                return slot;
+            }
+            if (current == key)
+                return slot;
+        }
+
+        int32_t age = static_cast<int32_t>(now - static_cast<uint32_t>(slot.state.load(std::memory_order_relaxed)));
+        if (age > oldestAge)
+        {
+            oldest = &slot;
+            oldestAge = age;
+        }
+    }
+
+    // Shard full, recycle the stalest bucket. A racing client may see a fresh
+    // bucket once, which errs on the side of admitting.
+    oldest->key.store(key, std::memory_order_release);
+    oldest->state.store(packState(m_burst, now), std::memory_order_release);
+    return *oldest;
+}
+
+bool AdmissionControl::admitConnection()
+{
+    int connections = m_connections.fetch_add(1, std::memory_order_relaxed);
+    if (m_maxConnections > 0 && connections >= m_maxConnections)
+    {
+        m_connections.fetch_sub(1, std::memory_order_relaxed);
+        m_shedConnections.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void AdmissionControl::releaseConnection()
+{
+    m_connections.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool AdmissionControl::admitRequest(uint64_t clientKey)
+{
+    if (m_rate == 0 || clientKey == 0)
+        return true;
+
+    uint32_t now = nowMs();
+    Slot& slot = findSlot(clientKey, now);
+
+    uint64_t state = slot.state.load(std::memory_order_relaxed);
+    while (true)
+    {
+        uint64_t tokens = state >> 32;
+        uint32_t last = static_cast<uint32_t>(state);
+
+        // Another worker may have refilled with a later timestamp than ours
+        int32_t elapsed = std::max(static_cast<int32_t>(now - last), 0);
+
+        // Refill, capped at the burst size
+        tokens = std::min(m_burst, tokens + static_cast<uint64_t>(elapsed) * m_rate);
+        if (tokens < 1000)
+        {
+            m_throttled.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        if (slot.state.compare_exchange_weak(state, packState(tokens - 1000, elapsed > 0 ? now : last),
+                std::memory_order_relaxed))
+            return true;
+    }
+}
+
+bool AdmissionControl::acquireInFlight()
+{
+    if (m_maxInFlight <= 0)
+        return true;
+
+    if (m_inFlight.fetch_add(1, std::memory_order_relaxed) >= m_maxInFlight)
+    {
+        m_inFlight.fetch_sub(1, std::memory_order_relaxed);
+        m_shedRequests.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void AdmissionControl::releaseInFlight(int count)
+{
+    if (m_maxInFlight > 0 && count > 0)
+        m_inFlight.fetch_sub(count, std::memory_order_relaxed);
+}
+
+void AdmissionControl::logStats() const
+{
+    spdlog::info("Admission control: {} connections shed, {} requests shed, {} requests throttled",
+        m_shedConnections.load(), m_shedRequests.load(), m_throttled.load());
+}
\ No newline at end of file
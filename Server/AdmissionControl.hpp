@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "ServerConfig.hpp"
+
+// Load shedding that runs before any parsing: at accept time and for each
+// framed request. Every check is a handful of atomics, so overload is turned
+// away with a pre-serialized response instead of going through the Router.
+//
+//  - max-connections: new connections beyond it get a 503 and are closed
+//  - max-in-flight: requests whose responses are still unsent, across all
+//    workers, beyond it a request gets a 503
+//  - rate-limit/rate-burst: a token bucket per client IP, charged once per
+//    connection and once per request, 429 when empty
+class AdmissionControl
+{
+private:
+    // Buckets live in a fixed open-addressed table, never resized or locked.
+    // Each shard is one cache line of slots, a client probes only its shard
+    // and evicts the least recently refilled slot when all are taken.
+    struct Slot
+    {
+        std::atomic<uint64_t> key{0};       // 0 = free
+        std::atomic<uint64_t> state{0};     // milli-tokens << 32 | last refill (ms)
+    };
+
+    struct alignas(64) Shard
+    {
+        static constexpr size_t kSlots = 64 / sizeof(Slot);
+        Slot slots[kSlots];
+    };
+
+    static constexpr size_t kShards = 16384;
+
+    std::unique_ptr<Shard[]> m_shards;
+    std::chrono::steady_clock::time_point m_epoch;
+    uint64_t m_rate;            // milli-tokens per ms == requests per second
+    uint64_t m_burst;           // bucket capacity in milli-tokens
+
+    int m_maxConnections;
+    int m_maxInFlight;
+    std::atomic<int> m_connections{0};
+    std::atomic<int> m_inFlight{0};
+
+    std::atomic<uint64_t> m_shedConnections{0};
+    std::atomic<uint64_t> m_shedRequests{0};
+    std::atomic<uint64_t> m_throttled{0};
+
+    uint32_t nowMs() const;
+    Slot& findSlot(uint64_t key, uint32_t now);
+
+public:
+    static constexpr std::string_view kServiceUnavailable =
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Content-Length: 0\r\n"
+        "Retry-After: 1\r\n\r\n";
+    static constexpr std::string_view kConnectionRejected =
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Content-Length: 0\r\n"
+        "Retry-After: 1\r\n"
+        "Connection: close\r\n\r\n";
+    static constexpr std::string_view kConnectionThrottled =
+        "HTTP/1.1 429 Too Many Requests\r\n"
+        "Content-Length: 0\r\n"
+        "Retry-After: 1\r\n"
+        "Connection: close\r\n\r\n";
+    static constexpr std::string_view kTooManyRequests =
+        "HTTP/1.1 429 Too Many Requests\r\n"
+        "Content-Length: 0\r\n"
+        "Retry-After: 1\r\n\r\n";
+
+    explicit AdmissionControl(const ServerConfig& config);
+
+    // IPv4 clients are keyed by address + 1, IPv6 clients by their /64 with
+    // the top bit set (a host usually owns the whole /64). Unix socket clients
+    // share one key, as loopback TCP clients share 127.0.0.1.
+    static constexpr uint64_t kUnixClientKey = 1ull << 62;
+    static uint64_t clientKey(const sockaddr_storage& addr);
+
+    // Connection accounting, every admitted connection must be released
+    bool admitConnection();
+    void releaseConnection();
+
+    // Take a token from the client's bucket, keys of 0 are never limited
+    bool admitRequest(uint64_t clientKey);
+
+    // In-flight accounting, every acquired request must be released
+    bool acquireInFlight();
+    void releaseInFlight(int count);
+
+    void logStats() const;
+};
\ No newline at end of file
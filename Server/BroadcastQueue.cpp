@@ -0,0 +1,16 @@
+#include "BroadcastQueue.hpp"
+
+bool BroadcastQueue::push(const std::string& channel, const SharedFrame& frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back(Broadcast{channel, frame});
+    }
+    return !m_wakePending.exchange(true, std::memory_order_seq_cst);
+}
+
+void BroadcastQueue::drain(std::vector<Broadcast>& out)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    out.swap(m_pending);
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "WebSocket.hpp"
+
+// A message for the WebSocket subscribers of a channel, serialized once
+struct Broadcast
+{
+    std::string channel;
+    SharedFrame frame;
+};
+
+// Messages published to one worker's subscribers. Any thread may push, the
+// worker drains the queue when woken through its kqueue. Like HandoffQueue,
+// the worker is only signalled for the first push since its last drain.
+class BroadcastQueue
+{
+private:
+    std::mutex m_mutex;
+    std::vector<Broadcast> m_pending;
+    std::atomic<bool> m_wakePending{false};
+
+public:
+    BroadcastQueue() = default;
+    BroadcastQueue(const BroadcastQueue&) = delete;
+    BroadcastQueue& operator=(const BroadcastQueue&) = delete;
+
+    // Returns true if the worker must be woken
+    bool push(const std::string& channel, const SharedFrame& frame);
+
+    // Worker side, clear before draining so later pushes wake it again.
+    // Swaps the pending messages into out, which should be empty.
+    void clearWake() { m_wakePending.exchange(false, std::memory_order_seq_cst); }
+    void drain(std::vector<Broadcast>& out);
+};
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include <cstring>
+
+#include "BufferPool.hpp"
+
+std::atomic<size_t> BufferPool::s_attached{0};
+std::atomic<size_t> BufferPool::s_pooled{0};
+
+BufferPool::~BufferPool()
+{
+    for (size_t index = 0; index < kClasses; index++)
+    {
+        for (char* block : m_blocks[index])
+            delete[] block;
+        s_pooled.fetch_sub(m_blocks[index].size() * classSize(index), std::memory_order_relaxed);
+    }
+}
+
+BufferPool& BufferPool::local()
+{
+    thread_local BufferPool pool;
+    return pool;
+}
+
+size_t BufferPool::classOf(size_t size)
+{
+    size_t index = 0;
+    while (index < kClasses && classSize(index) < size)
+        index++;
+    return index;
+}
+
+void BufferPool::reserve(InputBuffer& buffer, size_t size)
+{
+    if (size <= buffer.capacity)
+        return;
+
+    size_t index = classOf(size);
+    size_t capacity = index < kClasses ? classSize(index) : size;
+
+    char* data;
+    if (index < kClasses && !m_blocks[index].empty())
+    {
+        data = m_blocks[index].back();
+        m_blocks[index].pop_back();
+        s_pooled.fetch_sub(capacity, std::memory_order_relaxed);
+    }
+    else
+        data = new char[capacity];
+
+    if (buffer.length > 0)
+        std::memcpy(data, buffer.data, buffer.length);
+
+    size_t length = buffer.length;
+    release(buffer);
+    buffer.data = data;
+    buffer.length = length;
+    buffer.capacity = capacity;
+    s_attached.fetch_add(capacity, std::memory_order_relaxed);
+}
+
+void BufferPool::release(InputBuffer& buffer)
+{
+    if (!buffer.data)
+        return;
+
+    s_attached.fetch_sub(buffer.capacity, std::memory_order_relaxed);
+
+    size_t index = classOf(buffer.capacity);
+    if (index < kClasses && classSize(index) == buffer.capacity
+        && (m_blocks[index].size() + 1) * buffer.capacity <= kMaxPooledPerClass)
+    {
+        m_blocks[index].push_back(buffer.data);
+        s_pooled.fetch_add(buffer.capacity, std::memory_order_relaxed);
+    }
+    else
+        delete[] buffer.data;
+
+    buffer = InputBuffer{};
+}
+
+void BufferPool::acquire(std::string& output)
+{
+    // Already holds storage, or nothing to hand out
+    if (output.capacity() > std::string().capacity() || m_outputs.empty())
+        return;
+
+    output.swap(m_outputs.back());
+    m_outputs.pop_back();
+}
+
+void BufferPool::release(std::string& output)
+{
+    output.clear();
+    if (output.capacity() <= std::string().capacity())
+        return;
+
+    if (m_outputs.size() < kMaxPooledOutputs && output.capacity() <= kMaxPooledOutputSize)
+        m_outputs.push_back(std::move(output));
+
+    // Moved-from strings are left valid but unspecified
+    std::string().swap(output);
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// The unparsed bytes of a connection, only allocated while it holds part of a request
+struct InputBuffer
+{
+    char* data{nullptr};
+    size_t length{0};
+    size_t capacity{0};
+};
+
+// Per-worker free lists of connection memory. Reads land in the worker's
+// scratch buffer, so an idle connection holds neither input nor output
+// storage: a partial request borrows an input block, unsent responses borrow
+// an output string, and both are returned as soon as they are consumed.
+//
+// Input blocks come in size classes of 4KB, 16KB, 64KB, 256KB and 1MB. A
+// request outgrowing its block moves up a class, so parsers always see one
+// contiguous span. Larger requests get exact allocations that are not pooled.
+class BufferPool
+{
+private:
+    static constexpr size_t kMinBlock = 4 * 1024;
+    static constexpr size_t kClasses = 5;
+    static constexpr size_t kMaxPooledPerClass = 1024 * 1024;     // bytes, per worker
+    static constexpr size_t kMaxPooledOutputs = 64;
+    static constexpr size_t kMaxPooledOutputSize = 256 * 1024;
+
+    std::array<std::vector<char*>, kClasses> m_blocks;
+    std::vector<std::string> m_outputs;
+
+    // Across workers, for reporting
+    static std::atomic<size_t> s_attached;
+    static std::atomic<size_t> s_pooled;
+
+    static size_t classOf(size_t size);
+    static size_t classSize(size_t index) { return kMinBlock << (2 * index); }
+
+public:
+    BufferPool() = default;
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // The calling worker's pool
+    static BufferPool& local();
+
+    // Room for at least size bytes, the current contents are kept
+    void reserve(InputBuffer& buffer, size_t size);
+    void release(InputBuffer& buffer);
+
+    // Swap recycled storage into an empty output, and take it back once sent
+    void acquire(std::string& output);
+    void release(std::string& output);
+
+    // Input bytes held by connections, and kept for reuse
+    static size_t attachedBytes() { return s_attached.load(std::memory_order_relaxed); }
+    static size_t pooledBytes() { return s_pooled.load(std::memory_order_relaxed); }
+};
\ No newline at end of file
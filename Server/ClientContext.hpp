@@ -1,15 +1,42 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
 #include <utility>
 
-constexpr size_t k_maxBufferSize = 4096;
+#include "BufferPool.hpp"
 
-struct ClientContext
+class HTTP2Session;
+class WebSocketSession;
+struct UpstreamConnection;
+struct ssl_st;
+
+// Anything registered with a worker's kqueue, the kevent udata points at one
+struct EventSource
+{
+    int fd{0};                  // -1 once closed, later events in the batch are skipped
+    bool upstream{false};       // an UpstreamConnection rather than a ClientContext
+};
+
+// One per connection, registered with the worker's kqueue for its lifetime
+struct ClientContext : EventSource
 {
-    int fd;
-    size_t length;
-    size_t cursor;
-    char buffer[k_maxBufferSize];
+    InputBuffer input;          // partial request, pooled, empty between requests
+    size_t cursor;              // output bytes already sent
+    std::string output;         // serialized responses waiting to be sent
+    HTTP2Session* http2;        // set once the connection speaks HTTP/2, owned
+    WebSocketSession* websocket;    // set once upgraded to WebSocket, owned
+    bool writeArmed;            // one-shot EVFILT_WRITE pending
+    uint64_t clientKey;         // admission control bucket, 0 = not limited
+    int inFlight;               // admitted requests whose responses are unsent
+    UpstreamConnection* proxy;  // proxied request in progress, later requests wait for it
+    size_t requestBody;         // body bytes still to arrive, relayed to proxy or skipped
+    uint64_t flightTicket;      // coalesced request waiting in SingleFlight, 0 = none
+    bool closeAfterWrite;       // response is delimited by closing the connection
+    ssl_st* tls;                // HTTPS session, owned, null for plain HTTP
+    bool handshaking;           // TLS handshake not yet complete
 
-    ClientContext() : fd(0), length(0), cursor(0), buffer() {}
+    ClientContext() : cursor(0), http2(nullptr), websocket(nullptr), writeArmed(false),
+        clientKey(0), inFlight(0), proxy(nullptr), requestBody(0), flightTicket(0), closeAfterWrite(false),
+        tls(nullptr), handshaking(false) {}
 };
\ No newline at end of file
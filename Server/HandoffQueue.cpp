@@ -0,0 +1,35 @@
+#include "HandoffQueue.hpp"
+
+HandoffQueue::HandoffQueue()
+    : m_slots(std::make_unique<Handoff[]>(kCapacity))
+{
+}
+
+bool HandoffQueue::push(const Handoff& handoff)
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == kCapacity)
+        return false;
+
+    m_slots[tail & (kCapacity - 1)] = handoff;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool HandoffQueue::needsWake()
+{
+    // Pairs with clearWake(): either the worker sees this push while
+    // draining, or the flag is clear and the worker gets a new wakeup
+    return !m_wakePending.exchange(true, std::memory_order_seq_cst);
+}
+
+bool HandoffQueue::pop(Handoff& handoff)
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+        return false;
+
+    handoff = m_slots[head & (kCapacity - 1)];
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// A connection accepted but not yet owned by a worker
+struct Handoff
+{
+    int fd;
+    uint64_t clientKey;
+};
+
+// Bounded single-producer/single-consumer ring from the acceptor to one
+// worker. The worker allocates and registers the connections it pops, so
+// their state is created on the core, and NUMA node, that serves them.
+//
+// Wakeups are batched: the acceptor signals the worker's kqueue only for the
+// first push after the worker last drained the queue.
+class HandoffQueue
+{
+private:
+    static constexpr size_t kCapacity = 4096;   // power of 2
+
+    std::unique_ptr<Handoff[]> m_slots;
+
+    // Producer and consumer indices on their own cache lines
+    alignas(64) std::atomic<size_t> m_head{0};  // next pop, written by the worker
+    alignas(64) std::atomic<size_t> m_tail{0};  // next push, written by the acceptor
+    alignas(64) std::atomic<bool> m_wakePending{false};
+
+public:
+    HandoffQueue();
+    HandoffQueue(const HandoffQueue&) = delete;
+    HandoffQueue& operator=(const HandoffQueue&) = delete;
+
+    // Acceptor side. Returns false when the queue is full.
+    bool push(const Handoff& handoff);
+
+    // True if the worker must be woken for what was pushed since its last drain
+    bool needsWake();
+
+    // Worker side, call before draining so later pushes wake it again
+    void clearWake() { m_wakePending.exchange(false, std::memory_order_seq_cst); }
+    bool pop(Handoff& handoff);
+};
\ No newline at end of file
@@ -1,33 +1,142 @@
 #include <sys/socket.h> // socket()
+#include <sys/stat.h> // lstat()
+#include <sys/un.h> // sockaddr_un
+#include <netinet/in.h> // IPV6_V6ONLY
+#include <netinet/tcp.h> // TCP_DEFER_ACCEPT, TCP_FASTOPEN
 #include <arpa/inet.h> // htons(), inet_pton()
 #include <unistd.h> // close()
 #include <spdlog/spdlog.h>
 #include "ListenerSocket.hpp"
 #include "ServerUtils.hpp"
 
-ListenerSocket::ListenerSocket(const std::string& host, int port)
+ListenerSocket::ListenerSocket(const ServerConfig::ListenerConfig& config, int defaultBacklog)
+    : m_backlog(config.backlog > 0 ? config.backlog : defaultBacklog)
+    , m_address(config.address)
 {
-    if ((m_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
-        throw std::runtime_error("Failed to create a TCP socket");
+    sockaddr_storage addr;
+    socklen_t length = server::utils::createSockAddr(config.address, addr);
+    m_family = addr.ss_family;
+    if (m_family == AF_UNIX)
+        m_unixPath = reinterpret_cast<const sockaddr_un&>(addr).sun_path;
 
-    server::utils::setNonBlocking(m_fd);
-    auto addr = server::utils::createSockAddr(host, port);
+    if ((m_fd = socket(m_family, SOCK_STREAM, 0)) < 0)
+        throw std::runtime_error("Failed to create a socket for " + m_address);
 
-    if (bind(m_fd, (sockaddr*)&addr, sizeof(addr)) < 0)
-        throw std::runtime_error("Failed to bind socket to address");
+    try
+    {
+        server::utils::setNonBlocking(m_fd);
+        if (m_family == AF_UNIX)
+            removeStaleSocket();
+        else
+            setTcpOptions(config);
 
-    spdlog::info("[fd {}] Socket bound to {}:{}", m_fd, host, port);
+        if (bind(m_fd, (sockaddr*)&addr, length) < 0)
+            throw std::runtime_error("Failed to bind socket to " + m_address + ": " + strerror(errno));
+    }
+    catch (const std::exception&)
+    {
+        ::close(m_fd);
+        throw;
+    }
+
+    spdlog::info("[fd {}] Socket bound to {}", m_fd, m_address);
+}
+
+ListenerSocket::ListenerSocket(const std::string& host, int port, int backlog)
+    : ListenerSocket(ServerConfig::ListenerConfig{host + ":" + std::to_string(port)}, backlog)
+{
 }
 
 ListenerSocket::~ListenerSocket()
 {
-    if (m_fd >= 0)
-        close(m_fd);
+    close();
+}
+
+void ListenerSocket::setTcpOptions(const ServerConfig::ListenerConfig& config)
+{
+    int one = 1;
+
+    // A restart can bind while the last run's connections are in TIME_WAIT
+    setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    // [::]:port and 0.0.0.0:port can then listen side by side
+    if (m_family == AF_INET6)
+        setsockopt(m_fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof(one));
+
+    m_deferAccept = config.deferAccept;
+    if (m_deferAccept)
+    {
+#if defined(TCP_DEFER_ACCEPT)
+        int seconds = kDeferAcceptSeconds;
+        if (setsockopt(m_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds, sizeof(seconds)) < 0)
+            spdlog::warn("[fd {}] TCP_DEFER_ACCEPT refused on {}: {}", m_fd, m_address, strerror(errno));
+#elif defined(SO_ACCEPTFILTER)
+        // The accept filter can only be attached once listening
+#else
+        spdlog::warn("[fd {}] defer-accept is not supported on this platform, ignored for {}", m_fd, m_address);
+#endif
+    }
+
+    if (config.fastOpen > 0)
+    {
+#if defined(TCP_FASTOPEN)
+        // Linux takes the queue length, the BSDs and macOS an on/off switch
+#if defined(__linux__)
+        int value = config.fastOpen;
+#else
+        int value = 1;
+#endif
+        if (setsockopt(m_fd, IPPROTO_TCP, TCP_FASTOPEN, &value, sizeof(value)) < 0)
+            spdlog::warn("[fd {}] TCP_FASTOPEN refused on {}: {}", m_fd, m_address, strerror(errno));
+#else
+        spdlog::warn("[fd {}] fastopen is not supported on this platform, ignored for {}", m_fd, m_address);
+#endif
+    }
+}
+
+void ListenerSocket::removeStaleSocket() const
+{
+    struct stat info;
+    if (lstat(m_unixPath.c_str(), &info) < 0 || !S_ISSOCK(info.st_mode))
+        return;
+
+    // Left behind by a server that is gone if nobody accepts on it
+    sockaddr_storage addr;
+    socklen_t length = server::utils::createSockAddr(m_address, addr);
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool live = probe >= 0 && connect(probe, (sockaddr*)&addr, length) == 0;
+    if (probe >= 0)
+        ::close(probe);
+
+    if (live)
+        throw std::runtime_error("Another server is listening on " + m_address);
+    unlink(m_unixPath.c_str());
 }
 
 void ListenerSocket::listen()
 {
-    if (::listen(m_fd, kBacklogSize) < 0)
+    if (::listen(m_fd, m_backlog) < 0)
         spdlog::error("Sever socket listen failed: {} ({})",
             strerror(errno), errno);
+
+#if defined(SO_ACCEPTFILTER)
+    if (m_deferAccept)
+    {
+        accept_filter_arg filter{};
+        std::strncpy(filter.af_name, "dataready", sizeof(filter.af_name) - 1);
+        if (setsockopt(m_fd, SOL_SOCKET, SO_ACCEPTFILTER, &filter, sizeof(filter)) < 0)
+            spdlog::warn("[fd {}] dataready accept filter refused on {}: {}", m_fd, m_address, strerror(errno));
+    }
+#endif
+}
+
+void ListenerSocket::close()
+{
+    if (m_fd < 0)
+        return;
+
+    ::close(m_fd);
+    m_fd = -1;
+    if (!m_unixPath.empty())
+        unlink(m_unixPath.c_str());
 }
\ No newline at end of file
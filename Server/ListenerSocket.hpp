@@ -2,15 +2,35 @@
 
 #include <string>
 
+#include "ServerConfig.hpp"
+
+// One listening socket: TCP over IPv4 or IPv6, or a Unix domain stream socket.
+// A Unix socket's file is replaced if stale, and removed again on close().
 class ListenerSocket
 {
 private:
     static constexpr int kBacklogSize = 1000;
-    int m_fd{0};
+    static constexpr int kDeferAcceptSeconds = 1;   // Linux drops deferred clients that stay silent longer
+    int m_fd{-1};
+    int m_backlog;
+    int m_family{0};
+    bool m_deferAccept{false};
+    std::string m_address;
+    std::string m_unixPath;
+
+    void setTcpOptions(const ServerConfig::ListenerConfig& config);
+    void removeStaleSocket() const;
 
 public:
-    ListenerSocket(const std::string& host, int port = 8080);
+    ListenerSocket(const ServerConfig::ListenerConfig& config, int defaultBacklog = kBacklogSize);
+    ListenerSocket(const std::string& host, int port = 8080, int backlog = kBacklogSize);
     ~ListenerSocket();
+    ListenerSocket(const ListenerSocket&) = delete;
+    ListenerSocket& operator=(const ListenerSocket&) = delete;
+
     int fd() const { return m_fd; }
+    int family() const { return m_family; }
+    const std::string& address() const { return m_address; }
     void listen();
+    void close();
 };
\ No newline at end of file
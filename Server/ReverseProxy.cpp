@@ -0,0 +1,566 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <strings.h>
+
+#include "ReverseProxy.hpp"
+#include "ServerUtils.hpp"
+#include "HTTPUtils.hpp"
+#include "Uri.hpp"
+
+namespace
+{
+
+bool isHeader(std::string_view name, std::string_view key)
+{
+    return name.length() == key.length() && strncasecmp(name.data(), key.data(), key.length()) == 0;
+}
+
+// Meant for the next hop only, never forwarded (RFC 9110 7.6.1)
+bool isHopByHop(std::string_view name)
+{
+    for (std::string_view header : {"Connection", "Keep-Alive", "Proxy-Connection", "Proxy-Authenticate",
+            "Proxy-Authorization", "TE", "Trailer", "Transfer-Encoding", "Upgrade"})
+    {
+        if (isHeader(name, header))
+            return true;
+    }
+    return false;
+}
+
+}
+
+Upstream* ProxyRoute::pick() const
+{
+    Upstream* best = upstreams.front().get();
+    int bestOutstanding = best->outstanding.load(std::memory_order_relaxed);
+
+    for (const auto& upstream : upstreams)
+    {
+        int outstanding = upstream->outstanding.load(std::memory_order_relaxed);
+        if (outstanding < bestOutstanding)
+        {
+            best = upstream.get();
+            bestOutstanding = outstanding;
+        }
+    }
+    return best;
+}
+
+void ResponseFramer::reset(bool headRequest, ContentEncoding encoding)
+{
+    m_state = State::Headers;
+    m_headRequest = headRequest;
+    m_keepAlive = true;
+    m_line.clear();
+    m_remaining = 0;
+    m_encoding = encoding;
+    m_compressor.reset();
+}
+
+size_t ResponseFramer::feed(const char* data, size_t length, std::string& out)
+{
+    // Nothing is relayed from a malformed read, a 502 may still replace it
+    size_t before = out.length();
+    size_t offset = 0;
+
+    while (offset < length)
+    {
+        switch (m_state)
+        {
+        case State::Headers:
+            offset += feedHeaders(data + offset, length - offset, out);
+            break;
+
+        case State::Body:
+        case State::ChunkData:
+        {
+            size_t n = std::min(m_remaining, length - offset);
+            relay(data + offset, n, out);
+            offset += n;
+            m_remaining -= n;
+            if (m_remaining == 0)
+                m_state = m_state == State::Body ? State::Done : State::ChunkEnd;
+            break;
+        }
+
+        case State::ChunkSize:
+            if (!m_compressor)
+                out.push_back(data[offset]);
+            if (feedLine(data[offset++]))
+            {
+                char* end;
+                m_remaining = std::strtoul(m_line.c_str(), &end, 16);
+                if (end == m_line.c_str())
+                    m_state = State::Failed;
+                else
+                    m_state = m_remaining == 0 ? State::Trailers : State::ChunkData;
+                m_line.clear();
+            }
+            break;
+
+        case State::ChunkEnd:
+            // CRLF after the chunk data
+            if (!m_compressor)
+                out.push_back(data[offset]);
+            if (feedLine(data[offset++]))
+            {
+                m_state = m_line.empty() ? State::ChunkSize : State::Failed;
+                m_line.clear();
+            }
+            break;
+
+        case State::Trailers:
+            // Dropped when recompressing, they may describe the upstream's body
+            if (!m_compressor)
+                out.push_back(data[offset]);
+            if (feedLine(data[offset++]))
+            {
+                if (m_line.empty())
+                    m_state = State::Done;
+                m_line.clear();
+            }
+            break;
+
+        case State::UntilClose:
+            relay(data + offset, length - offset, out);
+            offset = length;
+            break;
+
+        case State::Done:
+        case State::Failed:
+            break;
+        }
+
+        if (m_state == State::Done || m_state == State::Failed)
+            break;
+    }
+
+    if (m_state == State::Failed)
+        out.resize(before);
+    else if (m_compressor && m_state == State::Done)
+        finish(out);
+    else if (m_compressor)
+    {
+        // Whatever arrived reaches the client now, not when the deflater fills a block
+        writeChunk(m_compressor->compressChunk({}, true), out);
+    }
+    return offset;
+}
+
+void ResponseFramer::finish(std::string& out)
+{
+    if (!m_compressor)
+        return;
+    writeChunk(m_compressor->finish(), out);
+    out.append("0\r\n\r\n");
+    m_compressor.reset();
+}
+
+void ResponseFramer::relay(const char* data, size_t length, std::string& out)
+{
+    if (m_compressor)
+        writeChunk(m_compressor->compressChunk(std::string_view(data, length), false), out);
+    else
+        out.append(data, length);
+}
+
+void ResponseFramer::writeChunk(std::string_view data, std::string& out)
+{
+    if (data.empty())
+        return;
+    char size[20];
+    auto [end, ec] = std::to_chars(size, size + sizeof(size), data.length(), 16);
+    out.append(size, end).append("\r\n").append(data).append("\r\n");
+}
+
+size_t ResponseFramer::feedHeaders(const char* data, size_t length, std::string& out)
+{
+    // The terminator may straddle two reads
+    size_t previous = m_line.length();
+    m_line.append(data, length);
+
+    size_t end = m_line.find("\r\n\r\n", previous >= 3 ? previous - 3 : 0);
+    if (end == std::string::npos)
+    {
+        if (m_line.length() > kMaxHeaderSize)
+            m_state = State::Failed;
+        else if (!holdsHead())
+            out.append(data, length);
+        return length;
+    }
+
+    size_t used = end + 4 - previous;
+    m_line.resize(end + 2);
+    parseHeaders();
+    if (m_compressor)
+        writeHead(out);
+    else if (holdsHead())
+        out.append(m_line).append("\r\n");
+    else
+        out.append(data, used);
+    m_line.clear();
+    return used;
+}
+
+void ResponseFramer::parseHeaders()
+{
+    // HTTP/1.x SSS reason
+    if (m_line.length() < 12 || !m_line.starts_with("HTTP/1."))
+    {
+        m_state = State::Failed;
+        return;
+    }
+
+    int status = std::atoi(m_line.c_str() + 9);
+    m_keepAlive = m_line[7] == '1';
+
+    bool chunked = false, hasLength = false, encoded = false, noTransform = false;
+    size_t contentLength = 0;
+    std::string_view contentType;
+
+    size_t lpos = m_line.find("\r\n") + 2;
+    while (lpos < m_line.length())
+    {
+        size_t rpos = m_line.find("\r\n", lpos);
+        std::string_view line(m_line.data() + lpos, rpos - lpos);
+        lpos = rpos + 2;
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos)
+            continue;
+
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = http::utils::trimWhitespace(line.substr(colon + 1));
+        auto is = [&name](std::string_view key)
+        {
+            return isHeader(name, key);
+        };
+        auto contains = [&value](const char* token)
+        {
+            return strcasestr(std::string(value).c_str(), token) != nullptr;
+        };
+
+        if (is("Content-Length"))
+        {
+            // Where the response ends decides what the pooled connection reads next
+            size_t parsed = 0;
+            auto [end, ec] = std::from_chars(value.data(), value.data() + value.length(), parsed);
+            if (ec != std::errc() || end != value.data() + value.length() || (hasLength && parsed != contentLength))
+            {
+                m_state = State::Failed;
+                return;
+            }
+            hasLength = true;
+            contentLength = parsed;
+        }
+        else if (is("Transfer-Encoding"))
+            chunked = contains("chunked");
+        else if (is("Connection"))
+        {
+            if (contains("close"))
+                m_keepAlive = false;
+            else if (contains("keep-alive"))
+                m_keepAlive = true;
+        }
+        else if (is("Content-Encoding"))
+            encoded = !isHeader(value, "identity");
+        else if (is("Content-Type"))
+            contentType = value;
+        else if (is("Cache-Control"))
+            noTransform = contains("no-transform");
+    }
+
+    // The request never asks for an upgrade, the connection would no longer be HTTP
+    if (status == 101)
+    {
+        m_keepAlive = false;
+        m_state = State::Failed;
+        return;
+    }
+
+    // Interim responses are relayed, the final one follows
+    if (status >= 100 && status < 200)
+    {
+        m_state = State::Headers;
+        return;
+    }
+
+    // Framed both ways, only closing is certain to end it
+    if (chunked && hasLength)
+        m_keepAlive = false;
+
+    // No body, whatever the headers say
+    if (m_headRequest || status == 204 || status == 304)
+        m_state = State::Done;
+    else if (chunked)
+        m_state = State::ChunkSize;
+    else if (hasLength)
+    {
+        m_remaining = contentLength;
+        m_state = contentLength == 0 ? State::Done : State::Body;
+    }
+    else
+    {
+        m_keepAlive = false;
+        m_state = State::UntilClose;
+    }
+
+    // The same rules as Router::applyContentEncoding(), a length is only known
+    // when the upstream sent one
+    using namespace http::utils;
+    bool hasBody = m_state == State::Body || m_state == State::ChunkSize || m_state == State::UntilClose;
+    if (holdsHead() && hasBody && status != 206 && !encoded && !noTransform && isCompressibleType(contentType)
+        && (!hasLength || contentLength >= k_minCompressSize))
+        m_compressor = std::make_unique<StreamCompressor>(m_encoding);
+}
+
+void ResponseFramer::writeHead(std::string& out) const
+{
+    // The upstream's framing is replaced by chunks of the compressed body
+    size_t lpos = m_line.find("\r\n") + 2;
+    out.append(m_line, 0, lpos);
+
+    bool vary = false;
+    while (lpos < m_line.length())
+    {
+        size_t rpos = m_line.find("\r\n", lpos);
+        std::string_view line(m_line.data() + lpos, rpos - lpos);
+        lpos = rpos + 2;
+
+        size_t colon = line.find(':');
+        std::string_view name = line.substr(0, colon);
+        if (colon == std::string_view::npos || isHeader(name, "Content-Length")
+            || isHeader(name, "Transfer-Encoding") || isHeader(name, "Trailer"))
+            continue;
+
+        // Not byte-identical to the upstream's representation any more
+        std::string_view value = http::utils::trimWhitespace(line.substr(colon + 1));
+        if (isHeader(name, "ETag") && !value.starts_with("W/"))
+            out.append("ETag: W/").append(value).append("\r\n");
+        else if (isHeader(name, "Vary"))
+        {
+            vary = true;
+            out.append("Vary: ").append(value);
+            if (value != "*" && strcasestr(std::string(value).c_str(), "Accept-Encoding") == nullptr)
+                out.append(value.empty() ? "Accept-Encoding" : ", Accept-Encoding");
+            out.append("\r\n");
+        }
+        else
+            out.append(line).append("\r\n");
+    }
+
+    if (!vary)
+        out.append("Vary: Accept-Encoding\r\n");
+    out.append("Content-Encoding: ").append(http::utils::toString(m_encoding)).append("\r\n");
+    out.append("Transfer-Encoding: chunked\r\n\r\n");
+}
+
+bool ResponseFramer::feedLine(char c)
+{
+    if (c == '\n')
+    {
+        if (!m_line.empty() && m_line.back() == '\r')
+            m_line.pop_back();
+        return true;
+    }
+
+    m_line.push_back(c);
+    if (m_line.length() > kMaxHeaderSize)
+        m_state = State::Failed;
+    return false;
+}
+
+void ReverseProxy::addRoute(const std::string& prefix, const std::vector<std::string>& upstreams)
+{
+    if (prefix.empty() || prefix[0] != '/')
+        throw std::invalid_argument("Proxy prefix must start with '/': " + prefix);
+    if (upstreams.empty())
+        throw std::invalid_argument("Proxy route " + prefix + " has no upstreams");
+
+    auto route = std::make_unique<ProxyRoute>();
+    route->prefix = prefix;
+
+    for (const std::string& address : upstreams)
+    {
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos)
+            throw std::invalid_argument("Upstream must be host:port: " + address);
+
+        auto upstream = std::make_unique<Upstream>();
+        upstream->name = address;
+        try
+        {
+            upstream->addr = server::utils::createSockAddr(address.substr(0, colon),
+                std::stoi(address.substr(colon + 1)));
+        }
+        catch (const std::exception&)
+        {
+            throw std::invalid_argument("Invalid upstream address: " + address);
+        }
+        route->upstreams.push_back(std::move(upstream));
+    }
+
+    m_routes.push_back(std::move(route));
+}
+
+bool ReverseProxy::match(std::string_view request, ProxyTarget& target) const
+{
+    if (m_routes.empty())
+        return false;
+
+    // METHOD SP request-target SP ...
+    size_t start = request.find(' ');
+    if (start == std::string_view::npos)
+        return false;
+    size_t end = request.find_first_of(" \r", start + 1);
+
+    // Matched and forwarded as the upstream will resolve it, so "/api/../admin" is "/admin"
+    Uri uri;
+    std::string path;
+    try
+    {
+        uri.parse(request.substr(start + 1, end - start - 1));
+        path = uri.normalizedPath();
+    }
+    catch (const std::invalid_argument&)
+    {
+        // Served locally, which answers 400
+        return false;
+    }
+
+    ProxyRoute* best = nullptr;
+    for (const auto& route : m_routes)
+    {
+        const std::string& prefix = route->prefix;
+        bool boundary = path.length() == prefix.length() || prefix.ends_with('/') || path[prefix.length()] == '/';
+        if (path.starts_with(prefix) && boundary
+            && (best == nullptr || prefix.length() > best->prefix.length()))
+            best = route.get();
+    }
+    if (!best)
+        return false;
+
+    target.route = best;
+    target.target = std::move(path);
+    if (uri.hasQuery())
+        target.target.append("?").append(uri.query());
+    target.host.clear();
+    if (!uri.scheme().empty())
+    {
+        target.host = uri.host();
+        if (uri.port() != 0)
+            target.host.append(":").append(std::to_string(uri.port()));
+    }
+    return true;
+}
+
+bool ReverseProxy::isHeadRequest(std::string_view request)
+{
+    return request.starts_with("HEAD ");
+}
+
+ContentEncoding ReverseProxy::acceptedEncoding(std::string_view request)
+{
+    size_t lineEnd = request.find("\r\n");
+    size_t headerEnd = request.find("\r\n\r\n");
+    if (lineEnd == std::string_view::npos || headerEnd == std::string_view::npos
+        || !request.substr(0, lineEnd).ends_with(" HTTP/1.1"))
+        return ContentEncoding::Identity;
+
+    for (size_t lpos = lineEnd + 2; lpos < headerEnd; )
+    {
+        size_t rpos = request.find("\r\n", lpos);
+        std::string_view line = request.substr(lpos, rpos - lpos);
+        lpos = rpos + 2;
+
+        size_t colon = line.find(':');
+        if (colon != std::string_view::npos && isHeader(line.substr(0, colon), "Accept-Encoding"))
+            return http::utils::negotiateEncoding(http::utils::trimWhitespace(line.substr(colon + 1)));
+    }
+    return ContentEncoding::Identity;
+}
+
+bool ReverseProxy::isRetryable(std::string_view request)
+{
+    // PUT and DELETE are idempotent by the spec, but not every upstream honours it
+    for (std::string_view method : {"GET ", "HEAD ", "OPTIONS ", "TRACE "})
+    {
+        if (request.starts_with(method))
+            return true;
+    }
+    return false;
+}
+
+std::string ReverseProxy::forwardRequest(std::string_view request, const ProxyTarget& target, uint64_t clientKey)
+{
+    // The head is complete, requestHeadLength() found its end. The body may
+    // be partial, the rest is relayed as it arrives.
+    size_t lineEnd = request.find("\r\n");
+    size_t headerEnd = request.find("\r\n\r\n");
+    std::string_view requestLine = request.substr(0, lineEnd);
+    std::string_view headers = request.substr(lineEnd + 2, headerEnd + 2 - (lineEnd + 2));
+
+    std::string forwarded;
+    forwarded.reserve(request.length() + target.target.length() + 40);
+    forwarded.append(requestLine.substr(0, requestLine.find(' ') + 1));
+    forwarded.append(target.target);
+    forwarded.append(requestLine.substr(requestLine.rfind(' ')));
+    forwarded.append("\r\n");
+
+    // Connection may name further headers meant for this hop only
+    std::vector<std::string_view> connectionHeaders;
+    for (size_t lpos = 0; lpos < headers.length(); )
+    {
+        size_t rpos = headers.find("\r\n", lpos);
+        std::string_view line = headers.substr(lpos, rpos - lpos);
+        lpos = rpos + 2;
+
+        size_t colon = line.find(':');
+        if (!isHeader(line.substr(0, colon), "Connection"))
+            continue;
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty())
+        {
+            size_t comma = value.find(',');
+            if (std::string_view token = http::utils::trimWhitespace(value.substr(0, comma)); !token.empty())
+                connectionHeaders.push_back(token);
+            value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+        }
+    }
+
+    for (size_t lpos = 0; lpos < headers.length(); )
+    {
+        size_t rpos = headers.find("\r\n", lpos);
+        std::string_view line = headers.substr(lpos, rpos + 2 - lpos);
+        lpos = rpos + 2;
+
+        std::string_view name = line.substr(0, line.find(':'));
+        if (isHopByHop(name)
+            || (!target.host.empty() && isHeader(name, "Host"))
+            || std::any_of(connectionHeaders.begin(), connectionHeaders.end(),
+                [name](std::string_view header) { return isHeader(name, header); }))
+            continue;
+        forwarded.append(line);
+    }
+
+    // An absolute-form target's authority overrides Host
+    if (!target.host.empty())
+        forwarded.append("Host: ").append(target.host).append("\r\n");
+
+    // Only IPv4 keys still hold the whole address, as address + 1
+    if (clientKey != 0 && clientKey <= 0x100000000ull)
+    {
+        in_addr addr;
+        addr.s_addr = htonl(static_cast<uint32_t>(clientKey - 1));
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+        forwarded.append("X-Forwarded-For: ").append(ip).append("\r\n");
+    }
+
+    forwarded.append("\r\n");
+    forwarded.append(request.substr(headerEnd + 4));
+    return forwarded;
+}
\ No newline at end of file
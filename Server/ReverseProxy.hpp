@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <netinet/in.h>
+
+#include "ClientContext.hpp"
+#include "CompressionUtils.hpp"
+
+// An upstream server, shared by all workers
+struct Upstream
+{
+    std::string name;                   // host:port, for logs
+    sockaddr_in addr;
+    std::atomic<int> outstanding{0};    // requests in progress, across all workers
+};
+
+struct ProxyRoute
+{
+    std::string prefix;
+    std::vector<std::unique_ptr<Upstream>> upstreams;
+
+    // Least outstanding requests, the first such upstream on ties
+    Upstream* pick() const;
+};
+
+// Where a proxied request goes, and the request-target it is sent with
+struct ProxyTarget
+{
+    ProxyRoute* route{nullptr};
+    std::string target;     // origin-form: the normalized path, then the query
+    std::string host;       // authority of an absolute-form target, replaces Host
+};
+
+// Follows an upstream HTTP/1.1 response as its bytes are relayed to the client,
+// to find where it ends (Content-Length, chunked or close). Relayed untouched,
+// unless the client accepts a coding the upstream did not apply: then the body
+// is compressed as it arrives and relayed chunked.
+class ResponseFramer
+{
+private:
+    static constexpr size_t kMaxHeaderSize = 16 * 1024;
+
+    enum class State { Headers, Body, ChunkSize, ChunkData, ChunkEnd, Trailers, UntilClose, Done, Failed };
+
+    State m_state{State::Headers};
+    bool m_headRequest{false};
+    bool m_keepAlive{true};
+    std::string m_line;                 // response headers, then the current chunk/trailer line
+    size_t m_remaining{0};              // body or chunk bytes left
+    ContentEncoding m_encoding{ContentEncoding::Identity};
+    std::unique_ptr<http::utils::StreamCompressor> m_compressor;    // set while recompressing the body
+
+    // With a coding to offer, the head is held back until it is complete
+    bool holdsHead() const { return m_encoding != ContentEncoding::Identity; }
+
+    void parseHeaders();
+    size_t feedHeaders(const char* data, size_t length, std::string& out);
+    bool feedLine(char c);
+    void relay(const char* data, size_t length, std::string& out);
+    void writeHead(std::string& out) const;
+    static void writeChunk(std::string_view data, std::string& out);
+
+public:
+    // Encoding is the client's choice from negotiateEncoding(), Identity relays untouched
+    void reset(bool headRequest, ContentEncoding encoding = ContentEncoding::Identity);
+
+    // Returns how many bytes belong to this response, anything after is not
+    // ours. What the client gets for them is appended to out.
+    size_t feed(const char* data, size_t length, std::string& out);
+
+    // The upstream closed a response that ends there
+    void finish(std::string& out);
+
+    bool complete() const { return m_state == State::Done; }
+    bool failed() const { return m_state == State::Failed; }
+    bool untilClose() const { return m_state == State::UntilClose; }
+    bool keepAlive() const { return m_keepAlive; }
+};
+
+// A connection to an upstream, owned by one worker. Idle connections are
+// kept in that worker's pool and registered with its kqueue.
+struct UpstreamConnection : EventSource
+{
+    Upstream* target{nullptr};
+    ClientContext* client{nullptr};     // request being served, null while idle
+    std::string output;                 // request bytes still to send
+    size_t cursor{0};
+    ResponseFramer framer;
+    bool connected{false};
+    bool writeArmed{false};
+    bool reused{false};                 // taken from the pool, may have gone stale
+    bool responseStarted{false};        // bytes were relayed, no retry or 502 possible
+    bool trimmed{false};                // sent request bytes were dropped, no retry possible
+    bool timerArmed{false};             // connect or response timeout pending, ident is the fd
+
+    UpstreamConnection() { upstream = true; }
+};
+
+// Prefix routes forwarded to upstream servers, configured with
+// "proxy = <prefix>=<host:port>[,<host:port>...]"
+class ReverseProxy
+{
+private:
+    std::vector<std::unique_ptr<ProxyRoute>> m_routes;
+
+public:
+    static constexpr std::string_view kBadGateway =
+        "HTTP/1.1 502 Bad Gateway\r\n"
+        "Content-Length: 0\r\n\r\n";
+    static constexpr std::string_view kGatewayTimeout =
+        "HTTP/1.1 504 Gateway Timeout\r\n"
+        "Content-Length: 0\r\n\r\n";
+
+    // Throws std::invalid_argument on a bad upstream address
+    void addRoute(const std::string& prefix, const std::vector<std::string>& upstreams);
+    bool empty() const { return m_routes.empty(); }
+
+    // Longest prefix of the request's normalized path that ends at a segment
+    // boundary, "/api" takes "/api" and "/api/x" but not "/apiary". Peeked
+    // from the request line without parsing the request.
+    bool match(std::string_view request, ProxyTarget& target) const;
+
+    static bool isHeadRequest(std::string_view request);
+
+    // What a response may be recompressed with, from the request's
+    // Accept-Encoding. Identity for HTTP/1.0 clients, which cannot take chunked.
+    static ContentEncoding acceptedEncoding(std::string_view request);
+
+    // Safe methods, the only ones resent after a stale pooled connection failed
+    static bool isRetryable(std::string_view request);
+
+    // The request as sent upstream: with the target's request-target, without
+    // hop-by-hop headers or those named in Connection, and with X-Forwarded-For
+    // added for IPv4 clients
+    static std::string forwardRequest(std::string_view request, const ProxyTarget& target, uint64_t clientKey);
+};
\ No newline at end of file
@@ -1,18 +1,80 @@
+#include <algorithm>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <unordered_map>
+
 #include "Server.hpp"
 #include "ServerUtils.hpp"
 #include "Logger.hpp"
 #include "ClientContext.hpp"
 #include "Router.hpp"
+#include "HTTP2Session.hpp"
+#include "WebSocket.hpp"
+#include "HTTPUtils.hpp"
+#include "PhaseTrace.hpp"
 
-HTTPServer::HTTPServer(const std::string& host, int port)
+// Contexts killed during the current batch of kevents. Freed once the batch
+// is done, as a later event in the same batch may still reference them.
+thread_local std::vector<ClientContext*> t_closedContexts;
+
+// The worker's kqueue changes, submitted in bulk with its next kevent() wait
+thread_local std::vector<struct kevent> t_pendingChanges;
+
+// The worker's scratch buffer, every read lands here first
+thread_local char* t_readBuffer;
+
+// The worker's idle keep-alive connections to each upstream, and upstream
+// connections closed during the current batch, freed like t_closedContexts
+thread_local std::unordered_map<Upstream*, std::vector<UpstreamConnection*>> t_idleUpstreams;
+thread_local std::vector<UpstreamConnection*> t_closedUpstreams;
+
+// The worker's WebSocket connections by channel, each session knows its slot
+thread_local std::unordered_map<std::string, std::vector<ClientContext*>> t_subscribers;
+
+// The worker run by this thread, -1 if none
+thread_local int t_workerNum = -1;
+
+HTTPServer::HTTPServer(const ServerConfig& config, ServerHooks hooks)
 try
-    : m_active(false)
-    , m_listenerSocket(host, port)
+    : m_config(config)
+    , m_hooks(std::move(hooks))
+    , m_admission(config)
+    , m_active(false)
     , m_initializedThreads(0)
     , m_rng(std::chrono::steady_clock::now().time_since_epoch().count())
     , m_sleepTimes(10, 100)
 {
-    spdlog::info("HTTPServer construction successful");
+    m_config.validate();
+
+    for (const ServerConfig::ListenerConfig& listener : m_config.listenAddresses())
+        m_listeners.push_back(std::make_unique<ListenerSocket>(listener, m_config.backlog));
+
+    m_workers = std::vector<Worker>(m_config.workers);
+    for (int i = 0; i < m_config.workers; i++)
+    {
+        m_workers[i].cpu = m_config.workerCpu(i);
+        m_workers[i].handoff = std::make_unique<HandoffQueue>();
+        m_workers[i].broadcasts = std::make_unique<BroadcastQueue>();
+    }
+    m_toWake.reserve(m_config.workers);
+
+    if (!m_config.tlsCert.empty())
+        m_tls = std::make_unique<TLSContext>(m_config);
+
+    m_singleFlight = std::make_unique<SingleFlight>(m_config.workers, [this](int worker)
+    {
+        server::utils::triggerKqUser(m_workers[worker].kqFd, kFlightIdent);
+    });
+    m_router.setSingleFlight(m_singleFlight.get());
+
+    for (const ServerConfig::ProxyConfig& proxy : m_config.proxies)
+    {
+        m_proxy.addRoute(proxy.prefix, proxy.upstreams);
+        spdlog::info("Proxying {} to {} upstream(s)", proxy.prefix, proxy.upstreams.size());
+    }
+
+    spdlog::info("HTTPServer construction successful, {} workers, {} events per wait",
+        m_config.workers, m_config.maxEvents);
 }
 catch (const std::exception& ex)
 {
@@ -20,6 +82,17 @@ catch (const std::exception& ex)
     throw;
 }
 
+HTTPServer::HTTPServer(const std::string& host, int port)
+    : HTTPServer([&]
+    {
+        ServerConfig config;
+        config.host = host;
+        config.port = port;
+        return config;
+    }())
+{
+}
+
 HTTPServer::~HTTPServer()
 {
     if (m_active)
@@ -36,36 +109,85 @@ void HTTPServer::stop()
         spdlog::info("stop() called, but m_active = false");
         return;
     }
-    
+
+    if (m_hooks.onStop)
+        m_hooks.onStop(*this);
     m_active.store(false);
 
+    // Busy-poll workers may be blocked in kevent()
+    for (Worker& worker : m_workers)
+        server::utils::triggerKqUser(worker.kqFd, kWakeIdent);
+
     spdlog::info("Active clients on shutdown: {}", m_clientFds.size());
+    m_router.logArenaUsage();
+    m_admission.logStats();
+    m_singleFlight->logStats();
+    if (m_tls)
+        m_tls->logStats();
+    logConnectionMemory();
+    spdlog::info("WebSocket: {} broadcasts, {} frames delivered, {} slow consumers closed",
+        m_wsBroadcasts.load(), m_wsDelivered.load(), m_wsSlowConsumers.load());
     for (auto& entry : m_clientFds)
     {
         close(entry.first);
         spdlog::info("Closing active fd {}", entry.first);
     }
 
-    // spdlog::info("Closing listener socket fd {}", m_listenerSocket.fd());
-    close(m_listenerSocket.fd());
+    // A worker polled by this thread is done here, the caller's other
+    // threads see pollWorker() or runEventLoop() return
+    if (t_workerNum >= 0)
+        detachWorker(t_workerNum);
 
     // spdlog::info("Joining listener thread");
-    m_listenerThread.join();
+    if (m_listenerThread.joinable())
+        m_listenerThread.join();
 
     // spdlog::info("Joining worker threads");
-    for (int i = 0; i < kThreadPoolSize; i++)
-        m_workerThreads[i].join();
+    for (Worker& worker : m_workers)
+    {
+        if (worker.thread.joinable())
+            worker.thread.join();
+    }
+    {
+        std::unique_lock<std::mutex> lock(m_initMutex);
+        m_initCondVar.wait(lock, [this]
+        {
+            return m_runningWorkers == 0 && !m_acceptorRunning;
+        });
+    }
+
+    // Only once the acceptor is done with them, Unix socket files are removed too
+    for (auto& listener : m_listeners)
+        listener->close();
+    if (m_config.busyPoll)
+        logPollStats();
     
     // spdlog::info("Closing worker kqueue fds");
-    for (int i = 0; i < kThreadPoolSize; i++)
-        close(m_workerKqFds[i]);
+    for (Worker& worker : m_workers)
+        close(worker.kqFd);
+
+    // Connections still waiting to be adopted
+    for (int fd : m_loopbackPending)
+        close(fd);
+    m_loopbackPending.clear();
+
+    Handoff handoff;
+    for (Worker& worker : m_workers)
+    {
+        while (worker.handoff->pop(handoff))
+        {
+            close(handoff.fd);
+            m_admission.releaseConnection();
+        }
+    }
 }
 
 void HTTPServer::start()
 {
     try
     {
-        m_listenerSocket.listen();
+        for (auto& listener : m_listeners)
+            listener->listen();
     }
     catch(const std::exception& ex)
     {
@@ -74,122 +196,299 @@ void HTTPServer::start()
     }
 
     // Set up KQueue
-    for (int i = 0; i < kThreadPoolSize; i++)
+    for (Worker& worker : m_workers)
     {
-        if ((m_workerKqFds[i] = kqueue()) < 0)
+        if ((worker.kqFd = kqueue()) < 0)
             throw std::runtime_error("Failed to create kqueue fd for worker");
+
+        // Before any thread runs, so the acceptor never triggers an unregistered event
+        server::utils::registerKqUser(worker.kqFd, kWakeIdent);
+        server::utils::registerKqUser(worker.kqFd, kBroadcastIdent);
+        server::utils::registerKqUser(worker.kqFd, kFlightIdent);
         
-        // spdlog::info("[fd {}] Created a new kq instance", m_workerKqFds[i]);
+        // spdlog::info("[fd {}] Created a new kq instance", worker.kqFd);
     }
 
-    // Setup callbacks for HTTP handling
-    m_router.registerHandler("/hello", Method::GET, [](const Request&)
+    // Chrome trace-event JSON of the sampled phases, for Perfetto
+    if (m_config.traceSample > 0)
     {
-        Response res(StatusCode::Ok);
-        res.setContent("Hello, Optiver!");
-        return res;
-    });
-    
+        PhaseTrace::enable(m_config.traceSample);
+        m_router.registerHandler("/debug/trace", Method::GET, [](const Request&)
+        {
+            Response res(StatusCode::Ok);
+            res.setHeader("Content-Type", "application/json");
+            res.setHeader("Cache-Control", "no-store");
+            res.setContent(PhaseTrace::exportJson());
+            return res;
+        });
+    }
+
+    // A peer closing mid-write must not kill the process, send() and
+    // SSL_write() report EPIPE instead
+    std::signal(SIGPIPE, SIG_IGN);
+
     // Setup threads
     m_active.store(true);
 
+    if (m_hooks.callerThreads)
+    {
+        if (m_hooks.onStart)
+            m_hooks.onStart(*this);
+        return;
+    }
+
     m_listenerThread = std::thread(&HTTPServer::listen, this);
 
-    for (int i = 0; i < kThreadPoolSize; i++)
+    for (int i = 0; i < m_config.workers; i++)
     {
-        m_workerThreads[i] = std::thread(&HTTPServer::runEventLoop, this, i);
+        m_workers[i].thread = std::thread(&HTTPServer::runEventLoop, this, i);
     }
 
     {
         std::unique_lock<std::mutex> lock(m_initMutex);
         m_initCondVar.wait(lock, [this]
         {
-            return m_initializedThreads == kThreadPoolSize + 1;
+            return m_initializedThreads == m_workers.size() + 1;
         });
     }
+
+    if (m_hooks.onStart)
+        m_hooks.onStart(*this);
     // spdlog::info("All threads initialized, HTTPServer::start completed");
 }
 
 void HTTPServer::listen()
 {
-    spdlog::info("[fd {}] Listener socket thread started", m_listenerSocket.fd());
+    spdlog::info("Listener socket thread started, accepting on {} socket(s)", m_listeners.size());
+
+    if (m_config.acceptorCpu >= 0 && !server::utils::pinCurrentThread(m_config.acceptorCpu))
+        spdlog::warn("Failed to pin the acceptor thread to CPU {}", m_config.acceptorCpu);
 
     {
         std::lock_guard<std::mutex> lock(m_initMutex);
         m_initializedThreads++;
-        m_initCondVar.notify_one();
+        m_acceptorRunning = true;
+        m_initCondVar.notify_all();
+    }
+
+    while (m_active.load())
+    {
+        if (pollAcceptor() == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(m_sleepTimes(m_rng)));
     }
 
-    ClientContext* clientData;
-    sockaddr_in clientAddr;
+    std::lock_guard<std::mutex> lock(m_initMutex);
+    m_acceptorRunning = false;
+    m_initCondVar.notify_all();
+}
+
+std::vector<int> HTTPServer::listenerFds() const
+{
+    std::vector<int> fds;
+    for (const auto& listener : m_listeners)
+        fds.push_back(listener->fd());
+    return fds;
+}
+
+int HTTPServer::pollAcceptor()
+{
+    sockaddr_storage clientAddr;
     socklen_t clientLen = sizeof(clientAddr);
     int clientFd = 0;
-    int workerNum = 0;  // the worker thread to register the client fd with
-    bool accepting = true;
 
-    while (m_active.load())
+    // Accept a batch from each listener, then wake each worker that
+    // received connections once
+    int accepted = 0;
+    for (const auto& listener : m_listeners)
     {
-        if (accepting)
+        int batch = 0;
+        while (batch < kAcceptBatch
+            && (clientFd = accept(listener->fd(), (sockaddr*)&clientAddr, &clientLen)) >= 0)
         {
-            // spdlog::info("Accept failed. Sleeping for random time.");
-            std::this_thread::sleep_for(std::chrono::microseconds(m_sleepTimes(m_rng)));
+            batch++;
+            clientLen = sizeof(clientAddr);
+
+            // Shed before any per-connection state exists
+            uint64_t clientKey = AdmissionControl::clientKey(clientAddr);
+            if (!m_admission.admitConnection())
+            {
+                rejectClient(clientFd, AdmissionControl::kConnectionRejected);
+                continue;
+            }
+            if (!m_admission.admitRequest(clientKey))
+            {
+                m_admission.releaseConnection();
+                rejectClient(clientFd, AdmissionControl::kConnectionThrottled);
+                continue;
+            }
+
+            handOff(clientFd, clientKey, m_nextWorker, m_toWake);
         }
+        accepted += batch;
+    }
 
-        clientFd = accept(m_listenerSocket.fd(), (sockaddr*)&clientAddr, &clientLen);
-        if (clientFd < 0)
+    // In-process connections skip the per-client limits, they all share one key
+    std::vector<int> local;
+    {
+        std::lock_guard<std::mutex> lock(m_loopbackMutex);
+        local.swap(m_loopbackPending);
+    }
+    for (int fd : local)
+    {
+        if (!m_admission.admitConnection())
         {
-            accepting = false;
+            rejectClient(fd, AdmissionControl::kConnectionRejected);
             continue;
         }
+        handOff(fd, 0, m_nextWorker, m_toWake);
+    }
+    accepted += local.size();
+
+    for (int num : m_toWake)
+        server::utils::triggerKqUser(m_workers[num].kqFd, kWakeIdent);
+    m_toWake.clear();
+    return accepted;
+}
 
-        accepting = true;
-        server::utils::setNonBlocking(clientFd);
-        clientData = new ClientContext();
-        clientData->fd = clientFd;
+void HTTPServer::handOff(int clientFd, uint64_t clientKey, int& workerNum, std::vector<int>& toWake)
+{
+    // Round robin, skipping workers whose queue is full
+    bool queued = false;
+    for (int attempt = 0; attempt < m_config.workers && !queued; attempt++)
+    {
+        HandoffQueue& queue = *m_workers[workerNum].handoff;
+        queued = queue.push(Handoff{clientFd, clientKey});
+        if (queued && queue.needsWake())
+            toWake.push_back(workerNum);
 
-        m_clientFds.insert({clientFd, clientData});
-        spdlog::info("m_clientFd size: {}", m_clientFds.size());
+        workerNum++;
+        if (workerNum == m_config.workers) workerNum = 0;
+    }
 
-        spdlog::info("[fd {}] New client connection accepted", clientFd);
+    if (!queued)
+    {
+        spdlog::warn("[fd {}] All worker handoff queues full, rejecting connection", clientFd);
+        m_admission.releaseConnection();
+        rejectClient(clientFd, AdmissionControl::kConnectionRejected);
+    }
+}
 
-        server::utils::registerKqFd(m_workerKqFds[workerNum],
-            clientFd, true, false, clientData);
+int HTTPServer::openLoopback()
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+        throw std::runtime_error(std::string("Failed to create loopback connection: ") + strerror(errno));
 
-        workerNum++;
-        if (workerNum == HTTPServer::kThreadPoolSize) workerNum = 0;
+    // The acceptor adopts the server end on its next round
+    {
+        std::lock_guard<std::mutex> lock(m_loopbackMutex);
+        m_loopbackPending.push_back(fds[0]);
     }
+    return fds[1];
 }
 
-void HTTPServer::runEventLoop(int workerNum)
+void HTTPServer::attachWorker(int workerNum)
 {
-    // spdlog::info("[fd {}] Worker thread started", m_workerKqFds[workerNum]);
+    if (t_workerNum >= 0)
+        throw std::logic_error("A thread can only run one worker");
+    t_workerNum = workerNum;
+    Worker& worker = m_workers[workerNum];
+
+    // Pin first, so the worker's allocations below are local to its CPU
+    if (worker.cpu >= 0)
+    {
+        if (server::utils::pinCurrentThread(worker.cpu))
+            spdlog::info("[fd {}] Worker {} pinned to CPU {}", worker.kqFd, workerNum, worker.cpu);
+        else
+            spdlog::warn("[fd {}] Failed to pin worker {} to CPU {}", worker.kqFd, workerNum, worker.cpu);
+    }
+
+    worker.events = static_cast<struct kevent*>(
+        server::utils::allocateLocal(sizeof(struct kevent) * m_config.maxEvents));
+    worker.readBuffer = static_cast<char*>(server::utils::allocateLocal(kReadBufferSize));
+    t_readBuffer = worker.readBuffer;
+    t_pendingChanges.reserve(64);
+    SingleFlight::bindWorker(workerNum);
+    PhaseTrace::attachWorker(workerNum);
+    m_router.attachReader();
+    worker.spinBudgetNs = m_config.busyPollBudget * 1000ull;
+
+    if (m_hooks.onWorkerStart)
+        m_hooks.onWorkerStart(workerNum);
+
+    // spdlog::info("[fd {}] Worker thread started", worker.kqFd);
     {
         std::lock_guard<std::mutex> lock(m_initMutex);
         m_initializedThreads++;
-        m_initCondVar.notify_one();
+        m_runningWorkers++;
+        m_initCondVar.notify_all();
+    }
+}
+
+void HTTPServer::detachWorker(int workerNum)
+{
+    Worker& worker = m_workers[workerNum];
+    if (m_hooks.onWorkerStop)
+        m_hooks.onWorkerStop(workerNum);
+
+    for (auto& [target, idle] : t_idleUpstreams)
+    {
+        for (UpstreamConnection* conn : idle)
+        {
+            close(conn->fd);
+            delete conn;
+        }
     }
+    t_idleUpstreams.clear();
+    t_subscribers.clear();
+    m_router.detachReader();
+
+    server::utils::freeLocal(worker.events, sizeof(struct kevent) * m_config.maxEvents);
+    worker.events = nullptr;
+    server::utils::freeLocal(worker.readBuffer, kReadBufferSize);
+    worker.readBuffer = nullptr;
+    t_workerNum = -1;
+
+    std::lock_guard<std::mutex> lock(m_initMutex);
+    m_runningWorkers--;
+    m_initCondVar.notify_all();
+}
 
-    ClientContext* data;
-    int kqFd = m_workerKqFds[workerNum];
+void HTTPServer::runEventLoop(int workerNum)
+{
+    attachWorker(workerNum);
+    Worker& worker = m_workers[workerNum];
+    int kqFd = worker.kqFd;
     struct timespec timeout{0, 0};
     bool looping = true;
 
     while (m_active.load())
     {
-        if (!looping)
+        // Nothing from the previous batch still points into a route table
+        m_router.quiescent();
+
+        int noEvents;
+        if (m_config.busyPoll)
+            noEvents = pollEvents(worker);
+        else
         {
-            // spdlog::info("[fd {}] No kevents to process. Sleeping for random time.", kqFd);
-            std::this_thread::sleep_for(std::chrono::microseconds(m_sleepTimes(m_rng)));
+            if (!looping)
+            {
+                // spdlog::info("[fd {}] No kevents to process. Sleeping for random time.", kqFd);
+                std::this_thread::sleep_for(std::chrono::microseconds(m_sleepTimes(m_rng)));
+            }
+
+            // Changes queued while handling the previous batch ride along with this wait
+            noEvents = kevent(
+                kqFd,
+                t_pendingChanges.data(),    // changelist
+                t_pendingChanges.size(),
+                worker.events,              // returned events stored in the worker's event array
+                m_config.maxEvents,
+                &timeout                    // 0 trimeout
+            );
+            t_pendingChanges.clear();
         }
-        
-        int noEvents = kevent(
-            kqFd,
-            nullptr,                    // changelist (no changes)
-            0,                          // no changes
-            m_workerEvents[workerNum],  // returned events stored in the worker's event array
-            kMaxEvents,
-            &timeout                    // 0 trimeout
-        );
 
         if (noEvents <= 0)
         {
@@ -198,130 +497,1297 @@ void HTTPServer::runEventLoop(int workerNum)
         }
 
         looping = true;
-        spdlog::info("[fd {}] Worker thread received {} events", kqFd, noEvents);
-        for (int i = 0; i < noEvents; i++)
-        {
-            const struct kevent& event = m_workerEvents[workerNum][i];
-            data = reinterpret_cast<ClientContext*>(event.udata);
+        handleEvents(worker, noEvents);
+    }
+
+    // stop() may already have detached it, when called from this thread
+    if (t_workerNum == workerNum)
+        detachWorker(workerNum);
+}
+
+bool HTTPServer::pollWorker(int workerNum)
+{
+    if (t_workerNum != workerNum)
+    {
+        if (!m_active.load())
+            return false;
+        attachWorker(workerNum);
+    }
+
+    Worker& worker = m_workers[workerNum];
+    if (!m_active.load())
+    {
+        detachWorker(workerNum);
+        return false;
+    }
 
-            // Socket was closed by peer, or error occured
-            if ((event.flags & EV_EOF) || (event.flags & EV_ERROR))
-                killClient(kqFd, data->fd, data);
+    m_router.quiescent();
+    const struct timespec noWait{0, 0};
+    int noEvents = kevent(worker.kqFd, t_pendingChanges.data(), t_pendingChanges.size(),
+        worker.events, m_config.maxEvents, &noWait);
+    t_pendingChanges.clear();
 
-            // If we receive read or write notification
-            else if (event.filter == EVFILT_READ || event.filter == EVFILT_WRITE)
-                handleEvent(kqFd, data, event); // TODO
+    if (noEvents > 0)
+        handleEvents(worker, noEvents);
+    return true;
+}
 
-            // Fallback for unexpected event
+void HTTPServer::handleEvents(Worker& worker, int noEvents)
+{
+    EventSource* source;
+    uint64_t polledAt = m_config.traceSample > 0 ? PhaseTrace::now() : 0;
+    spdlog::debug("[fd {}] Worker thread received {} events", worker.kqFd, noEvents);
+    for (int i = 0; i < noEvents; i++)
+    {
+        const struct kevent& event = worker.events[i];
+        // New connections from the acceptor, messages for subscribers,
+        // or responses for coalesced requests
+        if (event.filter == EVFILT_USER)
+        {
+            if (event.ident == kWakeIdent)
+                adoptConnections(worker);
+            else if (event.ident == kBroadcastIdent)
+                deliverBroadcasts(worker);
             else
-                killClient(kqFd, data->fd, data);
+                deliverFlights();
+            continue;
+        }
+
+        // An upstream timer deleted after it fired, nothing refers to it
+        if (event.filter == EVFILT_TIMER && !event.udata)
+            continue;
+
+        source = reinterpret_cast<EventSource*>(event.udata);
+
+        // Killed earlier in this batch
+        if (source->fd < 0)
+            continue;
+
+        // Upstream EOFs may still carry the end of a response
+        if (source->upstream)
+        {
+            handleUpstreamEvent(static_cast<UpstreamConnection*>(source), event);
+            continue;
+        }
+
+        ClientContext* data = static_cast<ClientContext*>(source);
+
+        // Socket was closed by peer, or error occured
+        if ((event.flags & EV_EOF) || (event.flags & EV_ERROR))
+            killClient(data);
+
+        // If we receive read or write notification
+        else if (event.filter == EVFILT_READ || event.filter == EVFILT_WRITE)
+        {
+            PhaseTrace::beginEvent(event.filter == EVFILT_READ ? Phase::ReadEvent : Phase::WriteEvent,
+                data->fd, polledAt);
+            handleEvent(data, event);
+            PhaseTrace::endEvent();
         }
+
+        // Fallback for unexpected event
+        else
+            killClient(data);
+    }
+
+    for (ClientContext* ctx : t_closedContexts)
+    {
+        delete ctx->http2;
+        delete ctx->websocket;
+        delete ctx;
     }
+    t_closedContexts.clear();
+
+    for (UpstreamConnection* conn : t_closedUpstreams)
+        delete conn;
+    t_closedUpstreams.clear();
 }
 
-void HTTPServer::handleEvent(int kqFd, ClientContext* ctx, const struct kevent& event)
+int HTTPServer::pollEvents(Worker& worker)
 {
-    int clientFd = ctx->fd;
-    ClientContext* requestCtx{ nullptr };
-    ClientContext* responseCtx{ nullptr };
+    using Clock = std::chrono::steady_clock;
+    const struct timespec noWait{0, 0};
 
-    // Peer closed connection, early kill
-    if ((event.flags & EV_EOF) || (event.flags & EV_ERROR))
+    // Spin, the pending changes go with the first wait
+    Clock::time_point idleStart = Clock::now();
+    Clock::time_point spinEnd = idleStart + std::chrono::nanoseconds(worker.spinBudgetNs);
+    Clock::time_point now;
+    int noEvents;
+    do
     {
-        killClient(kqFd, clientFd, ctx);
-        return;
+        noEvents = kevent(worker.kqFd, t_pendingChanges.data(), t_pendingChanges.size(),
+            worker.events, m_config.maxEvents, &noWait);
+        t_pendingChanges.clear();
+        now = Clock::now();
     }
-    
-    // Handle reads
-    if (event.filter == EVFILT_READ)
+    while (noEvents == 0 && now < spinEnd && m_active.load(std::memory_order_relaxed));
+    worker.spinNs += std::chrono::duration_cast<std::chrono::nanoseconds>(now - idleStart).count();
+
+    if (noEvents > 0)
+        worker.spinWakeups++;
+    else if (noEvents == 0 && m_active.load(std::memory_order_relaxed))
     {
-        requestCtx = ctx;
-        ssize_t bytesRead = recv(clientFd, requestCtx->buffer, k_maxBufferSize, 0);
+        // Block until the next event, stop() wakes every worker
+        Clock::time_point blockStart = now;
+        noEvents = kevent(worker.kqFd, nullptr, 0, worker.events, m_config.maxEvents, nullptr);
+        now = Clock::now();
+        worker.blockedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(now - blockStart).count();
+        worker.blockWakeups++;
+    }
 
-        spdlog::info("[fd {}] Read notification, bytesRead = {}",
-            clientFd, bytesRead);
-        
-        // recv succesful
-        if (bytesRead > 0)
-        {
-            // Parse a HTTP response into a ConnectionContext
-            responseCtx = new ClientContext(); 
-            responseCtx->fd = clientFd;
-            m_router.populateResponse(requestCtx, responseCtx);
+    if (noEvents <= 0)
+        return noEvents;
 
-            // Register for writes
-            server::utils::unregisterKqFd(kqFd, clientFd, true, false);
-            delete requestCtx;
-            server::utils::registerKqFd(kqFd, clientFd, false, true, responseCtx);
-        }
+    // Spinning pays off when the next events arrive within the budget: spin
+    // for twice the average gap, up to busy-poll-budget. Beyond that most
+    // spins would end in a block anyway, so only a short one is kept for bursts.
+    int64_t gap = std::chrono::duration_cast<std::chrono::nanoseconds>(now - idleStart).count();
+    int64_t average = static_cast<int64_t>(worker.idleGapNs);
+    worker.idleGapNs = static_cast<uint64_t>(average + (gap - average) / 8);
 
-        // Peer has closed
-        else if (bytesRead == 0)
-            killClient(kqFd, clientFd, requestCtx);
-        
-        // Fatal error
-        else if (bytesRead < 0 && (errno != EAGAIN || errno != EWOULDBLOCK))
-            killClient(kqFd, clientFd, requestCtx);
+    uint64_t maxBudget = m_config.busyPollBudget * 1000ull;
+    uint64_t target = 2 * worker.idleGapNs;
+    worker.spinBudgetNs = target <= maxBudget ? std::max(target, maxBudget / 8) : maxBudget / 8;
+    return noEvents;
+}
+
+void HTTPServer::logPollStats() const
+{
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        const Worker& worker = m_workers[i];
+        uint64_t waits = worker.spinWakeups + worker.blockWakeups;
+        spdlog::info("Worker {} busy-poll: {} ms spinning, {} ms blocked, {}/{} waits answered while spinning, "
+            "spin budget {} us", i, worker.spinNs / 1000000, worker.blockedNs / 1000000,
+            worker.spinWakeups, waits, worker.spinBudgetNs / 1000);
     }
+}
 
-    // Handle writes
-    else if (event.filter == EVFILT_WRITE)
+void HTTPServer::adoptConnections(Worker& worker)
+{
+    worker.handoff->clearWake();
+
+    Handoff handoff;
+    while (worker.handoff->pop(handoff))
     {
-        responseCtx = ctx;
-        size_t bytesSent = send(
-            clientFd,
-            responseCtx->buffer + responseCtx->cursor,  // offset into buffer    
-            responseCtx->length,                        // bytes to send
-            0
-        );
-        
-        spdlog::info("[fd {}] Write notification, response buffer = {}, bytesSent = {}",
-            clientFd, responseCtx->length, bytesSent);
-        
-        if (bytesSent >= 0)
+        server::utils::setNonBlocking(handoff.fd);
+        if (m_config.busyPoll && !server::utils::enableBusyPoll(handoff.fd, m_config.busyPollBudget))
+            spdlog::debug("[fd {}] SO_BUSY_POLL not available", handoff.fd);
+
+        ClientContext* ctx = new ClientContext();
+        ctx->fd = handoff.fd;
+        ctx->clientKey = handoff.clientKey;
+
+        if (m_tls)
         {
-            // Still more bytes to send 
-            if (responseCtx->length > bytesSent)
-            {
-                // Advance cursor and re-arm for writes
-                responseCtx->cursor += bytesSent;
-                responseCtx->length -= bytesSent;
-                server::utils::registerKqFd(kqFd, clientFd, false, true, responseCtx);
-                spdlog::info("[fd {}] More bytes to write, re-armed for write notifications", clientFd);
-            }
-            
-            // Finished sending, go back to reading
-            else
+            ctx->tls = m_tls->accept(handoff.fd);
+            ctx->handshaking = true;
+            if (!ctx->tls)
             {
-                requestCtx = new ClientContext();
-                requestCtx->fd = clientFd;
-
-                // Register for reads
-                server::utils::unregisterKqFd(kqFd, clientFd, false, true);
-                delete responseCtx;
-                server::utils::registerKqFd(kqFd, clientFd, true, false, requestCtx);
-                spdlog::info("[fd {}] Finished writing, re-armed for read notifications", clientFd);
+                close(handoff.fd);
+                m_admission.releaseConnection();
+                delete ctx;
+                continue;
             }
         }
 
-        // Non fatal error, try again
-        else if (errno == EAGAIN || errno == EWOULDBLOCK)
-            server::utils::registerKqFd(kqFd, clientFd, false, true, responseCtx);
-        
-        // bytesSent < 0, fatal error
+        m_clientFds.insert({handoff.fd, ctx});
+        spdlog::debug("[fd {}] New client connection adopted by worker fd {}", handoff.fd, worker.kqFd);
+
+        // Registered once, edge-triggered, for the lifetime of the connection
+        server::utils::queueKqChange(t_pendingChanges, handoff.fd, EVFILT_READ, EV_ADD | EV_CLEAR,
+            static_cast<EventSource*>(ctx));
+    }
+}
+
+void HTTPServer::handleEvent(ClientContext* ctx, const struct kevent& event)
+{
+    // Peer closed connection, early kill
+    if ((event.flags & EV_EOF) || (event.flags & EV_ERROR))
+    {
+        killClient(ctx);
+        return;
+    }
+
+    // Either direction may be what the handshake waits for
+    if (ctx->handshaking)
+    {
+        if (event.filter == EVFILT_WRITE)
+            ctx->writeArmed = false;
+        continueHandshake(ctx);
+        return;
+    }
+
+    // Handle reads. While a write is pending the input stays in the kernel,
+    // it is picked up once the output has been flushed. So does a request
+    // after a proxied one, but not the proxied request's own body.
+    if (event.filter == EVFILT_READ)
+    {
+        if (ctx->proxy ? ctx->requestBody == 0 : ctx->writeArmed)
+            return;
+
+        if (ctx->http2)
+            readHTTP2(ctx);
+        else if (ctx->websocket)
+            readWebSocket(ctx);
         else
-            killClient(kqFd, clientFd, responseCtx);
+            readRequests(ctx);
+    }
+
+    // Handle writes, the one-shot registration is consumed by this event
+    else if (event.filter == EVFILT_WRITE)
+    {
+        ctx->writeArmed = false;
+
+        if (ctx->http2)
+        {
+            if (flushHTTP2(ctx))
+                readHTTP2(ctx);
+        }
+        else if (ctx->websocket)
+        {
+            if (flushWebSocket(ctx))
+                readWebSocket(ctx);
+        }
+        else if (flushResponse(ctx))
+        {
+            // Relaying a proxied response resumes once the client caught up
+            if (ctx->proxy)
+                readUpstream(ctx->proxy);
+            else
+                readRequests(ctx);
+        }
     }
 
     // Unexpected filter
     else
-        killClient(kqFd, clientFd, ctx);
+        killClient(ctx);
 }
 
-void HTTPServer::killClient(int kqFd, int clientFd, ClientContext* ctx)
+ssize_t HTTPServer::receive(ClientContext* ctx, char* buffer, size_t length, bool& drained)
 {
-    m_clientFds.erase(clientFd);
-    server::utils::unregisterKqFd(kqFd, clientFd, true, true);
-    close(clientFd);
-    delete ctx;
+    PhaseTrace::Span span(Phase::Recv);
+    if (!ctx->tls)
+    {
+        ssize_t bytesRead = recv(ctx->fd, buffer, length, 0);
+        drained = bytesRead > 0 ? static_cast<size_t>(bytesRead) < length
+            : bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        return bytesRead;
+    }
+
+    // Records are decrypted one at a time, a short read says nothing about
+    // the socket. Only WANT_READ means it is drained.
+    size_t total = 0;
+    drained = false;
+    while (total < length)
+    {
+        TLSContext::Status status;
+        ssize_t bytesRead = TLSContext::read(ctx->tls, buffer + total, length - total, status);
+        if (bytesRead > 0)
+        {
+            total += bytesRead;
+            continue;
+        }
+
+        if (status == TLSContext::Status::WantRead || status == TLSContext::Status::WantWrite)
+        {
+            if (status == TLSContext::Status::WantWrite)
+                armWrite(ctx);
+            drained = true;
+            break;
+        }
+
+        // Closed or failed, reported by the next call once this data is served
+        if (total > 0)
+            break;
+        if (status == TLSContext::Status::Closed)
+            return 0;
+        errno = ECONNRESET;
+        return -1;
+    }
+
+    if (total == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    return total;
+}
+
+ssize_t HTTPServer::transmit(ClientContext* ctx, const char* data, size_t length)
+{
+    PhaseTrace::Span span(Phase::Send);
+    if (!ctx->tls)
+        return send(ctx->fd, data, length, 0);
+
+    TLSContext::Status status;
+    ssize_t bytesSent = TLSContext::write(ctx->tls, data, length, status);
+    if (bytesSent > 0)
+        return bytesSent;
+
+    errno = status == TLSContext::Status::WantRead || status == TLSContext::Status::WantWrite
+        ? EAGAIN : EPIPE;
+    return -1;
+}
+
+void HTTPServer::continueHandshake(ClientContext* ctx)
+{
+    switch (m_tls->handshake(ctx->tls))
+    {
+    case TLSContext::Status::Ok:
+        // The first request may have arrived with the client's last flight
+        ctx->handshaking = false;
+        spdlog::debug("[fd {}] TLS handshake complete", ctx->fd);
+        readRequests(ctx);
+        break;
+
+    // Resumed by the next read event
+    case TLSContext::Status::WantRead:
+        break;
+
+    case TLSContext::Status::WantWrite:
+        armWrite(ctx);
+        break;
+
+    default:
+        spdlog::debug("[fd {}] TLS handshake failed", ctx->fd);
+        killClient(ctx);
+        break;
+    }
+}
+
+void HTTPServer::readRequests(ClientContext* ctx)
+{
+    int clientFd = ctx->fd;
+    BufferPool& pool = BufferPool::local();
+
+    while (true)
+    {
+        // A request body is read only as fast as the upstream takes it, the
+        // rest waits in the socket until flushUpstream catches up
+        if (ctx->proxy && ctx->requestBody > 0
+            && ctx->proxy->output.length() - ctx->proxy->cursor >= kMaxPendingOutput)
+            return;
+
+        // Edge-triggered: read until the socket is drained
+        bool drained;
+        ssize_t bytesRead = receive(ctx, t_readBuffer, kReadBufferSize, drained);
+
+        spdlog::debug("[fd {}] Read notification, bytesRead = {}", clientFd, bytesRead);
+
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // Requests may still wait in the buffer after a proxied response
+            if (ctx->input.length == 0)
+                return;
+            bytesRead = 0;
+        }
+
+        // Peer has closed, or fatal error
+        else if (bytesRead <= 0)
+        {
+            killClient(ctx);
+            return;
+        }
+
+        // Requests are served straight from the scratch buffer, unless the
+        // connection already holds the start of one
+        char* data = t_readBuffer;
+        size_t length = bytesRead;
+        if (ctx->input.length > 0)
+        {
+            pool.reserve(ctx->input, ctx->input.length + length);
+            std::memcpy(ctx->input.data + ctx->input.length, t_readBuffer, length);
+            ctx->input.length += length;
+            data = ctx->input.data;
+            length = ctx->input.length;
+        }
+
+        // The rest of a proxied request's body goes to its upstream as it
+        // arrives, or nowhere if the request was shed or already answered
+        size_t offset = 0;
+        if (ctx->requestBody > 0)
+            offset = relayRequestBody(ctx, data, length);
+
+        // HTTP/2 with prior knowledge, the session owns the connection from here on
+        if (ctx->requestBody == 0 && HTTP2Session::hasPreface(data + offset, length - offset))
+        {
+            spdlog::info("[fd {}] HTTP/2 prior knowledge connection", clientFd);
+            ctx->http2 = new HTTP2Session(m_router);
+            setupHTTP2(ctx);
+            ctx->http2->start();
+            ctx->http2->receive(data + offset, length - offset);
+            pool.release(ctx->input);
+
+            if (flushHTTP2(ctx) && !drained)
+                readHTTP2(ctx);
+            return;
+        }
+
+        // Serve every complete request in the buffer, responses are batched into one send.
+        // Admission is checked on the framing alone, shed requests are never parsed.
+        // A proxied request is forwarded as soon as its head is in, with the part
+        // of its body read so far.
+        pool.acquire(ctx->output);
+        size_t headLength, bodyLength;
+        StatusCode framingError = StatusCode::Ok;
+        while (!ctx->http2 && !ctx->websocket && !ctx->proxy && !ctx->flightTicket && ctx->requestBody == 0
+            && (headLength = http::utils::requestHeadLength(data + offset, length - offset, bodyLength, framingError)) > 0)
+        {
+            ProxyTarget target;
+            bool proxied = m_proxy.match(std::string_view(data + offset, headLength), target);
+            size_t bodyRead = std::min(bodyLength, length - offset - headLength);
+            if (!proxied && bodyRead < bodyLength)
+                break;
+
+            std::string_view request(data + offset, headLength + bodyRead);
+            offset += request.length();
+            ctx->requestBody = bodyLength - bodyRead;
+
+            if (!m_admission.admitRequest(ctx->clientKey))
+                ctx->output.append(AdmissionControl::kTooManyRequests);
+            else if (!m_admission.acquireInFlight())
+                ctx->output.append(AdmissionControl::kServiceUnavailable);
+            else
+            {
+                ctx->inFlight++;
+                if (proxied)
+                    startProxy(ctx, target, request);
+                else
+                    m_router.populateResponse(ctx, request);
+            }
+        }
+
+        // Where the next request starts is unknown, answer the earlier ones and this, then close
+        if (framingError != StatusCode::Ok)
+        {
+            spdlog::debug("[fd {}] Unusable request framing, closing", clientFd);
+            Response response(framingError);
+            response.setHeader("Connection", "close");
+            http::utils::appendResponse(ctx->output, response, true);
+            pool.release(ctx->input);
+            ctx->closeAfterWrite = true;
+            flushResponse(ctx);
+            return;
+        }
+
+        size_t remaining = length - offset;
+        if (offset == 0 && remaining > static_cast<size_t>(m_config.maxRequestSize))
+        {
+            spdlog::warn("[fd {}] Request exceeds {} bytes, closing", clientFd, m_config.maxRequestSize);
+            killClient(ctx);
+            return;
+        }
+
+        // Only a partial request is kept, in a block sized for it
+        if (remaining == 0)
+            pool.release(ctx->input);
+        else if (data == t_readBuffer)
+        {
+            pool.reserve(ctx->input, remaining);
+            std::memcpy(ctx->input.data, data + offset, remaining);
+            ctx->input.length = remaining;
+        }
+        else if (offset > 0)
+        {
+            std::memmove(ctx->input.data, data + offset, remaining);
+            ctx->input.length = remaining;
+        }
+
+        // Requests after a proxied or coalesced one are served once its response
+        // is in. The proxied request's body is still read meanwhile.
+        if (ctx->proxy || ctx->flightTicket)
+        {
+            if (flushResponse(ctx) && ctx->proxy && ctx->requestBody > 0 && !drained)
+                continue;
+            return;
+        }
+
+        // Upgrade: h2c accepted, anything after the request is already HTTP/2
+        if (ctx->http2)
+        {
+            setupHTTP2(ctx);
+            if (ctx->input.length > 0)
+                ctx->http2->receive(ctx->input.data, ctx->input.length);
+            pool.release(ctx->input);
+
+            if (flushHTTP2(ctx) && !drained)
+                readHTTP2(ctx);
+            return;
+        }
+
+        // Upgrade: websocket, anything after the request is already frames
+        if (ctx->websocket)
+        {
+            subscribe(ctx);
+            if (ctx->input.length > 0)
+                ctx->websocket->receive(ctx->input.data, ctx->input.length);
+            pool.release(ctx->input);
+
+            if (flushWebSocket(ctx) && !drained)
+                readWebSocket(ctx);
+            return;
+        }
+
+        // Blocked on the socket (write armed) or killed
+        if (!flushResponse(ctx))
+            return;
+
+        if (drained)
+            return;
+    }
+}
+
+bool HTTPServer::flushResponse(ClientContext* ctx)
+{
+    while (ctx->cursor < ctx->output.length())
+    {
+        ssize_t bytesSent = transmit(
+            ctx,
+            ctx->output.data() + ctx->cursor,   // offset into buffer
+            ctx->output.length() - ctx->cursor  // bytes to send
+        );
+
+        spdlog::debug("[fd {}] Write, response buffer = {}, bytesSent = {}",
+            ctx->fd, ctx->output.length() - ctx->cursor, bytesSent);
+
+        if (bytesSent > 0)
+            ctx->cursor += bytesSent;
+
+        // Socket buffer full, finish once it drains
+        else if (bytesSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            armWrite(ctx);
+            return false;
+        }
+
+        // Fatal error
+        else
+        {
+            killClient(ctx);
+            return false;
+        }
+    }
+
+    BufferPool::local().release(ctx->output);
+    ctx->cursor = 0;
+
+    // Response without framing, its end is the end of the connection
+    if (ctx->closeAfterWrite)
+    {
+        killClient(ctx);
+        return false;
+    }
+
+    // A proxied or coalesced response still to come keeps its request in flight
+    if (!ctx->proxy && !ctx->flightTicket)
+    {
+        m_admission.releaseInFlight(ctx->inFlight);
+        ctx->inFlight = 0;
+    }
+    return true;
+}
+
+void HTTPServer::logConnectionMemory() const
+{
+    size_t connections = m_clientFds.size();
+    size_t attached = BufferPool::attachedBytes();
+    spdlog::info("Connection memory: {} connections, {} B context + {} B input buffers each, {} B pooled",
+        connections, sizeof(ClientContext), connections > 0 ? attached / connections : 0,
+        BufferPool::pooledBytes());
+}
+
+void HTTPServer::readHTTP2(ClientContext* ctx)
+{
+    bool drained = false;
+
+    while (!drained)
+    {
+        ssize_t bytesRead = receive(ctx, t_readBuffer, kReadBufferSize, drained);
+
+        if (bytesRead > 0)
+            ctx->http2->receive(t_readBuffer, bytesRead);
+        else if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            drained = true;
+        else
+        {
+            killClient(ctx);
+            return;
+        }
+
+        // Frames are batched across the whole drain, unless output piles up
+        if (drained || ctx->http2->pendingSize() >= kMaxPendingOutput)
+        {
+            if (!flushHTTP2(ctx))
+                return;
+        }
+    }
+}
+
+bool HTTPServer::flushHTTP2(ClientContext* ctx)
+{
+    // Responses pipelined before an h2c upgrade go first, then the
+    // HTTP/1.1 requests, the upgrade included, leave flight
+    if ((!ctx->output.empty() || ctx->inFlight > 0) && !flushResponse(ctx))
+        return false;
+
+    HTTP2Session* session = ctx->http2;
+
+    // Everything the session produced goes out in as few sends as the socket allows
+    while (session->pendingSize() > 0)
+    {
+        ssize_t bytesSent = transmit(ctx, session->pendingData(), session->pendingSize());
+        if (bytesSent > 0)
+            session->consume(bytesSent);
+        else if (bytesSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            armWrite(ctx);
+            return false;
+        }
+        else
+        {
+            killClient(ctx);
+            return false;
+        }
+    }
+
+    if (session->wantsClose())
+    {
+        spdlog::info("[fd {}] HTTP/2 session finished", ctx->fd);
+        killClient(ctx);
+        return false;
+    }
+    return true;
+}
+
+void HTTPServer::armWrite(ClientContext* ctx)
+{
+    if (ctx->writeArmed)
+        return;
+
+    server::utils::queueKqChange(t_pendingChanges, ctx->fd, EVFILT_WRITE, EV_ADD | EV_ONESHOT,
+        static_cast<EventSource*>(ctx));
+    ctx->writeArmed = true;
+}
+
+void HTTPServer::killClient(ClientContext* ctx)
+{
+    // close() drops the fd's kevents, only changes not yet submitted need removing
+    server::utils::discardKqChanges(t_pendingChanges, ctx->fd);
+    m_clientFds.erase(ctx->fd);
+    close(ctx->fd);
+
+    TLSContext::release(ctx->tls);
+    ctx->tls = nullptr;
+
+    // The upstream is mid-response, its connection cannot be reused
+    if (UpstreamConnection* conn = ctx->proxy)
+    {
+        ctx->proxy = nullptr;
+        conn->client = nullptr;
+        conn->target->outstanding.fetch_sub(1, std::memory_order_relaxed);
+        closeUpstream(conn);
+    }
+
+    if (ctx->websocket)
+        unsubscribe(ctx);
+    if (ctx->flightTicket)
+        m_singleFlight->cancel(ctx);
+
+    m_admission.releaseInFlight(ctx->inFlight);
+    if (ctx->http2)
+        m_admission.releaseInFlight(ctx->http2->admittedStreams());
+    m_admission.releaseConnection();
+
+    BufferPool::local().release(ctx->input);
+    BufferPool::local().release(ctx->output);
+
+    ctx->fd = -1;
+    t_closedContexts.push_back(ctx);
+}
+
+void HTTPServer::rejectClient(int clientFd, std::string_view response)
+{
+    // The socket is fresh, a few hundred bytes always fit its send buffer.
+    // HTTPS clients are closed without an answer, no handshake is spent on them.
+    if (!m_tls && send(clientFd, response.data(), response.length(), 0) < 0)
+        spdlog::debug("[fd {}] Failed to send rejection: {}", clientFd, strerror(errno));
+    close(clientFd);
+}
+
+void HTTPServer::setupHTTP2(ClientContext* ctx)
+{
+    // Streams are charged to the client's bucket and hold an in-flight
+    // slot like HTTP/1.1 requests
+    uint64_t clientKey = ctx->clientKey;
+    ctx->http2->setAdmission([this, clientKey]
+    {
+        if (!m_admission.admitRequest(clientKey))
+            return StatusCode::TooManyRequests;
+        if (!m_admission.acquireInFlight())
+            return StatusCode::ServiceUnvailable;
+        return StatusCode::Ok;
+    },
+    [this](int count)
+    {
+        m_admission.releaseInFlight(count);
+    });
+}
+
+void HTTPServer::readWebSocket(ClientContext* ctx)
+{
+    bool drained = false;
+
+    while (!drained)
+    {
+        ssize_t bytesRead = receive(ctx, t_readBuffer, kReadBufferSize, drained);
+
+        // A protocol error queues a close frame, sent below before closing
+        if (bytesRead > 0)
+            ctx->websocket->receive(t_readBuffer, bytesRead);
+        else if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            drained = true;
+        else
+        {
+            killClient(ctx);
+            return;
+        }
+
+        // Replies are batched across the whole drain, unless output piles up
+        if (drained || ctx->websocket->queuedBytes() >= kMaxPendingOutput)
+        {
+            if (!flushWebSocket(ctx))
+                return;
+        }
+    }
+}
+
+bool HTTPServer::flushWebSocket(ClientContext* ctx)
+{
+    // The 101, and any response pipelined before the upgrade, go first
+    if (!ctx->output.empty() && !flushResponse(ctx))
+        return false;
+
+    // Queued frames are shared with other subscribers, they are gathered
+    // rather than copied. TLS records are written one frame at a time.
+    WebSocketSession* session = ctx->websocket;
+    struct iovec iov[kMaxWriteBuffers];
+    while (session->queuedBytes() > 0)
+    {
+        size_t count = session->pendingBuffers(iov, ctx->tls ? 1 : kMaxWriteBuffers);
+        ssize_t bytesSent = ctx->tls
+            ? transmit(ctx, static_cast<const char*>(iov[0].iov_base), iov[0].iov_len)
+            : writev(ctx->fd, iov, static_cast<int>(count));
+
+        if (bytesSent > 0)
+            session->consume(bytesSent);
+        else if (bytesSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            armWrite(ctx);
+            return false;
+        }
+        else
+        {
+            killClient(ctx);
+            return false;
+        }
+    }
+
+    if (session->wantsClose())
+    {
+        spdlog::debug("[fd {}] WebSocket closed", ctx->fd);
+        killClient(ctx);
+        return false;
+    }
+    return true;
+}
+
+void HTTPServer::subscribe(ClientContext* ctx)
+{
+    std::vector<ClientContext*>& subscribers = t_subscribers[ctx->websocket->channel()];
+    ctx->websocket->setSubscriberSlot(subscribers.size());
+    subscribers.push_back(ctx);
+    spdlog::debug("[fd {}] WebSocket subscribed to {}", ctx->fd, ctx->websocket->channel());
+}
+
+void HTTPServer::unsubscribe(ClientContext* ctx)
+{
+    auto it = t_subscribers.find(ctx->websocket->channel());
+    size_t slot = ctx->websocket->subscriberSlot();
+    if (it == t_subscribers.end() || slot >= it->second.size() || it->second[slot] != ctx)
+        return;
+
+    // Swap-remove, the last subscriber takes over the slot
+    std::vector<ClientContext*>& subscribers = it->second;
+    subscribers[slot] = subscribers.back();
+    subscribers[slot]->websocket->setSubscriberSlot(slot);
+    subscribers.pop_back();
+}
+
+void HTTPServer::broadcast(std::string_view channel, std::string_view message, bool binary)
+{
+    if (!m_active.load())
+        return;
+
+    // Serialized once, every worker and subscriber shares the same bytes
+    SharedFrame frame = WebSocketSession::encodeFrame(message, binary);
+    std::string key(channel);
+    m_wsBroadcasts.fetch_add(1, std::memory_order_relaxed);
+
+    for (Worker& worker : m_workers)
+    {
+        if (worker.broadcasts->push(key, frame))
+            server::utils::triggerKqUser(worker.kqFd, kBroadcastIdent);
+    }
+}
+
+void HTTPServer::deliverBroadcasts(Worker& worker)
+{
+    worker.broadcasts->clearWake();
+
+    std::vector<Broadcast> batch;
+    worker.broadcasts->drain(batch);
+
+    // Queue everything first, so each subscriber is written once per batch
+    std::vector<std::vector<ClientContext*>*> touched;
+    uint64_t delivered = 0;
+    for (const Broadcast& message : batch)
+    {
+        auto it = t_subscribers.find(message.channel);
+        if (it == t_subscribers.end())
+            continue;
+
+        // Backwards, a subscriber closed here is swapped with one already served
+        std::vector<ClientContext*>& subscribers = it->second;
+        for (size_t i = subscribers.size(); i-- > 0;)
+        {
+            ClientContext* ctx = subscribers[i];
+            ctx->websocket->send(message.frame);
+            delivered++;
+
+            // Already blocked on a full socket
+            if (ctx->writeArmed)
+                dropSlowConsumer(ctx);
+        }
+
+        if (std::find(touched.begin(), touched.end(), &subscribers) == touched.end())
+            touched.push_back(&subscribers);
+    }
+    m_wsDelivered.fetch_add(delivered, std::memory_order_relaxed);
+
+    // Subscribers waiting on a full socket are flushed by their write event
+    for (std::vector<ClientContext*>* subscribers : touched)
+    {
+        for (size_t i = subscribers->size(); i-- > 0;)
+        {
+            ClientContext* ctx = (*subscribers)[i];
+            if (!ctx->writeArmed && !flushWebSocket(ctx) && ctx->fd >= 0)
+                dropSlowConsumer(ctx);
+        }
+    }
+}
+
+void HTTPServer::deliverFlights()
+{
+    std::vector<std::pair<ClientContext*, SharedResponse>> completed;
+    m_singleFlight->drain(completed);
+
+    // Pipelined requests that waited behind the coalesced one are served next
+    for (auto& [ctx, response] : completed)
+    {
+        BufferPool::local().acquire(ctx->output);
+        ctx->output.append(*response);
+        if (flushResponse(ctx))
+            readRequests(ctx);
+    }
+}
+
+void HTTPServer::dropSlowConsumer(ClientContext* ctx)
+{
+    // What the socket would not take stays queued, up to ws-max-backlog
+    size_t backlog = ctx->websocket->queuedBytes();
+    if (backlog <= static_cast<size_t>(m_config.wsMaxBacklog))
+        return;
+
+    spdlog::warn("[fd {}] WebSocket subscriber {} bytes behind, closing", ctx->fd, backlog);
+    m_wsSlowConsumers.fetch_add(1, std::memory_order_relaxed);
+    killClient(ctx);
+}
+
+void HTTPServer::startProxy(ClientContext* ctx, const ProxyTarget& proxyTarget, std::string_view request)
+{
+    Upstream* target = proxyTarget.route->pick();
+    UpstreamConnection* conn = acquireUpstream(target);
+    if (!conn)
+    {
+        ctx->output.append(ReverseProxy::kBadGateway);
+        return;
+    }
+
+    target->outstanding.fetch_add(1, std::memory_order_relaxed);
+    conn->client = ctx;
+    conn->output = ReverseProxy::forwardRequest(request, proxyTarget, ctx->clientKey);
+    conn->cursor = 0;
+    conn->trimmed = false;
+    conn->responseStarted = false;
+    conn->framer.reset(ReverseProxy::isHeadRequest(request), ReverseProxy::acceptedEncoding(request));
+    ctx->proxy = conn;
+    armUpstreamTimer(conn, conn->connected ? m_config.proxyTimeout : m_config.proxyConnectTimeout);
+
+    // Sent from the upstream's write event, which also reports connect completion.
+    // The client's buffer is never touched from under readRequests.
+    armUpstreamWrite(conn);
+}
+
+UpstreamConnection* HTTPServer::acquireUpstream(Upstream* target)
+{
+    std::vector<UpstreamConnection*>& idle = t_idleUpstreams[target];
+    if (idle.empty())
+        return connectUpstream(target);
+
+    UpstreamConnection* conn = idle.back();
+    idle.pop_back();
+    conn->reused = true;
+    return conn;
+}
+
+UpstreamConnection* HTTPServer::connectUpstream(Upstream* target)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        spdlog::error("Failed to create upstream socket: {}", strerror(errno));
+        return nullptr;
+    }
+
+    server::utils::setNonBlocking(fd);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    bool connected = connect(fd, reinterpret_cast<const sockaddr*>(&target->addr), sizeof(target->addr)) == 0;
+    if (!connected && errno != EINPROGRESS)
+    {
+        spdlog::warn("[fd {}] Failed to connect to upstream {}: {}", fd, target->name, strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    UpstreamConnection* conn = new UpstreamConnection();
+    conn->fd = fd;
+    conn->target = target;
+    conn->connected = connected;
+
+    // Edge-triggered for the lifetime of the connection, like clients
+    server::utils::queueKqChange(t_pendingChanges, fd, EVFILT_READ, EV_ADD | EV_CLEAR,
+        static_cast<EventSource*>(conn));
+    spdlog::debug("[fd {}] Connecting to upstream {}", fd, target->name);
+    return conn;
+}
+
+void HTTPServer::handleUpstreamEvent(UpstreamConnection* conn, const struct kevent& event)
+{
+    if (event.flags & EV_ERROR)
+    {
+        upstreamFailed(conn);
+        return;
+    }
+
+    if (event.filter == EVFILT_TIMER)
+    {
+        upstreamTimedOut(conn);
+        return;
+    }
+
+    if (event.filter == EVFILT_WRITE)
+    {
+        conn->writeArmed = false;
+        if (!conn->connected)
+        {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0
+                || (event.flags & EV_EOF))
+            {
+                spdlog::warn("[fd {}] Failed to connect to upstream {}: {}",
+                    conn->fd, conn->target->name, strerror(error));
+                upstreamFailed(conn);
+                return;
+            }
+            conn->connected = true;
+        }
+
+        // A request body that waited for the upstream to catch up is read on
+        if (flushUpstream(conn) && conn->client && conn->client->requestBody > 0)
+            readRequests(conn->client);
+    }
+    else if (event.filter == EVFILT_READ)
+        readUpstream(conn);
+    else
+        upstreamFailed(conn);
+}
+
+bool HTTPServer::flushUpstream(UpstreamConnection* conn)
+{
+    // The connect timeout ends here, and the response timeout restarts
+    // whenever the upstream takes more of the request
+    if (conn->client && conn->cursor < conn->output.length())
+        armUpstreamTimer(conn, m_config.proxyTimeout);
+
+    while (conn->cursor < conn->output.length())
+    {
+        ssize_t bytesSent = send(conn->fd, conn->output.data() + conn->cursor,
+            conn->output.length() - conn->cursor, 0);
+
+        if (bytesSent > 0)
+            conn->cursor += bytesSent;
+        else if (bytesSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            armUpstreamWrite(conn);
+            return false;
+        }
+        else
+        {
+            upstreamFailed(conn);
+            return false;
+        }
+    }
+
+    // Only the start of a request is kept for a retry, what was sent of a
+    // body still arriving is dropped
+    if (conn->client && conn->client->requestBody > 0)
+    {
+        conn->output.clear();
+        conn->cursor = 0;
+        conn->trimmed = true;
+    }
+    return true;
+}
+
+void HTTPServer::armUpstreamWrite(UpstreamConnection* conn)
+{
+    if (conn->writeArmed)
+        return;
+
+    server::utils::queueKqChange(t_pendingChanges, conn->fd, EVFILT_WRITE, EV_ADD | EV_ONESHOT,
+        static_cast<EventSource*>(conn));
+    conn->writeArmed = true;
+}
+
+void HTTPServer::armUpstreamTimer(UpstreamConnection* conn, int milliseconds)
+{
+    server::utils::queueKqTimer(t_pendingChanges, conn->fd, milliseconds, static_cast<EventSource*>(conn));
+    conn->timerArmed = true;
+}
+
+void HTTPServer::cancelUpstreamTimer(UpstreamConnection* conn)
+{
+    if (!conn->timerArmed)
+        return;
+
+    // No udata: if it already fired, the error for this delete must not
+    // point at a connection that may be freed by then
+    server::utils::queueKqChange(t_pendingChanges, conn->fd, EVFILT_TIMER, EV_DELETE, nullptr);
+    conn->timerArmed = false;
+}
+
+void HTTPServer::readUpstream(UpstreamConnection* conn)
+{
+    char buffer[kUpstreamReadSize];
+
+    while (true)
+    {
+        // Idle in the pool: the upstream closed it, or sent something unasked for
+        ClientContext* ctx = conn->client;
+        if (!ctx)
+        {
+            closeUpstream(conn);
+            return;
+        }
+
+        // Backpressure, the rest stays in the upstream's socket until the client drains
+        if (ctx->output.length() - ctx->cursor >= kMaxPendingOutput)
+        {
+            if (!flushResponse(ctx))
+                return;
+            continue;
+        }
+
+        ssize_t bytesRead = recv(conn->fd, buffer, sizeof(buffer), 0);
+
+        if (bytesRead > 0)
+        {
+            // Possibly recompressed on the way, a held back head relays nothing yet
+            BufferPool::local().acquire(ctx->output);
+            size_t relayed = ctx->output.length();
+            size_t used = conn->framer.feed(buffer, bytesRead, ctx->output);
+            if (conn->framer.failed())
+            {
+                spdlog::warn("[fd {}] Malformed response from upstream {}", conn->fd, conn->target->name);
+                upstreamFailed(conn);
+                return;
+            }
+            if (ctx->output.length() > relayed)
+                conn->responseStarted = true;
+
+            // Trailing bytes mean the upstream is out of step, don't reuse it
+            if (conn->framer.complete())
+            {
+                finishProxy(conn, used == static_cast<size_t>(bytesRead));
+                return;
+            }
+        }
+        else if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // Relay what arrived so far, the upstream's silence is timed from here
+            armUpstreamTimer(conn, m_config.proxyTimeout);
+            flushResponse(ctx);
+            return;
+        }
+        else if (bytesRead == 0 && conn->framer.untilClose())
+        {
+            BufferPool::local().acquire(ctx->output);
+            conn->framer.finish(ctx->output);
+            finishProxy(conn, false);
+            return;
+        }
+        else
+        {
+            upstreamFailed(conn);
+            return;
+        }
+    }
+}
+
+size_t HTTPServer::relayRequestBody(ClientContext* ctx, const char* data, size_t length)
+{
+    size_t relayed = std::min(ctx->requestBody, length);
+    ctx->requestBody -= relayed;
+
+    // Sent from the upstream's write event, like the request's head. If the
+    // upstream had taken everything, the wait was on the client.
+    if (UpstreamConnection* conn = ctx->proxy)
+    {
+        if (conn->connected && conn->cursor == conn->output.length())
+            armUpstreamTimer(conn, m_config.proxyTimeout);
+        conn->output.append(data, relayed);
+        armUpstreamWrite(conn);
+    }
+    return relayed;
+}
+
+void HTTPServer::finishProxy(UpstreamConnection* conn, bool reusable)
+{
+    ClientContext* ctx = conn->client;
+    ctx->proxy = nullptr;
+    conn->client = nullptr;
+    conn->target->outstanding.fetch_sub(1, std::memory_order_relaxed);
+    cancelUpstreamTimer(conn);
+
+    if (conn->framer.untilClose())
+        ctx->closeAfterWrite = true;
+
+    // An upstream that answered before taking the whole request is out of step
+    reusable = reusable && ctx->requestBody == 0 && conn->cursor == conn->output.length();
+
+    std::vector<UpstreamConnection*>& idle = t_idleUpstreams[conn->target];
+    if (reusable && conn->framer.keepAlive() && idle.size() < kMaxIdleUpstreams)
+    {
+        conn->output.clear();
+        idle.push_back(conn);
+    }
+    else
+        closeUpstream(conn);
+
+    // Pipelined requests that waited for this response
+    if (flushResponse(ctx))
+        readRequests(ctx);
+}
+
+void HTTPServer::upstreamFailed(UpstreamConnection* conn)
+{
+    ClientContext* ctx = conn->client;
+    if (!ctx)
+    {
+        closeUpstream(conn);
+        return;
+    }
+
+    // A pooled connection the upstream had already dropped, the request is
+    // resent once on a fresh connection. Only safe methods: the upstream may
+    // have acted on it before dropping the connection.
+    if (conn->reused && !conn->responseStarted && !conn->trimmed && ReverseProxy::isRetryable(conn->output))
+    {
+        if (UpstreamConnection* fresh = connectUpstream(conn->target))
+        {
+            spdlog::debug("[fd {}] Stale upstream connection to {}, retrying", conn->fd, conn->target->name);
+            fresh->client = ctx;
+            fresh->output = std::move(conn->output);
+            fresh->framer.reset(ReverseProxy::isHeadRequest(fresh->output),
+                ReverseProxy::acceptedEncoding(fresh->output));
+            ctx->proxy = fresh;
+
+            conn->client = nullptr;
+            closeUpstream(conn);
+            armUpstreamWrite(fresh);
+            armUpstreamTimer(fresh, m_config.proxyConnectTimeout);
+            return;
+        }
+    }
+
+    spdlog::warn("[fd {}] Upstream {} failed", conn->fd, conn->target->name);
+    failProxy(conn, ReverseProxy::kBadGateway);
+}
+
+void HTTPServer::upstreamTimedOut(UpstreamConnection* conn)
+{
+    // Fired just as the connection went back to the pool
+    conn->timerArmed = false;
+    ClientContext* ctx = conn->client;
+    if (!ctx)
+        return;
+
+    // The client is the slow side: the upstream took all of the body sent so
+    // far, or is paused until the client takes the response
+    if (conn->connected && ((ctx->requestBody > 0 && conn->cursor == conn->output.length())
+        || ctx->output.length() - ctx->cursor >= kMaxPendingOutput))
+    {
+        armUpstreamTimer(conn, m_config.proxyTimeout);
+        return;
+    }
+
+    spdlog::warn("[fd {}] Upstream {} timed out {}", conn->fd, conn->target->name,
+        conn->connected ? "mid-request" : "connecting");
+    failProxy(conn, ReverseProxy::kGatewayTimeout);
+}
+
+void HTTPServer::failProxy(UpstreamConnection* conn, std::string_view response)
+{
+    ClientContext* ctx = conn->client;
+    bool responseStarted = conn->responseStarted;
+    ctx->proxy = nullptr;
+    conn->client = nullptr;
+    conn->target->outstanding.fetch_sub(1, std::memory_order_relaxed);
+    closeUpstream(conn);
+
+    // Part of the response already went out, only closing can signal the failure
+    if (responseStarted)
+    {
+        killClient(ctx);
+        return;
+    }
+
+    ctx->output.append(response);
+    if (flushResponse(ctx))
+        readRequests(ctx);
+}
+
+void HTTPServer::closeUpstream(UpstreamConnection* conn)
+{
+    std::erase(t_idleUpstreams[conn->target], conn);
+    server::utils::discardKqChanges(t_pendingChanges, conn->fd);
+    cancelUpstreamTimer(conn);
+    close(conn->fd);
+
+    conn->fd = -1;
+    t_closedUpstreams.push_back(conn);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <thread>
 #include <random>
 #include <atomic>
+#include <functional>
 #include <sys/event.h>
 
 #include <oneapi/tbb/concurrent_hash_map.h>
@@ -10,42 +11,210 @@
 #include "ListenerSocket.hpp"
 #include "ClientContext.hpp"
 #include "Router.hpp"
+#include "ServerConfig.hpp"
+#include "AdmissionControl.hpp"
+#include "ReverseProxy.hpp"
+#include "HandoffQueue.hpp"
+#include "BroadcastQueue.hpp"
+#include "SingleFlight.hpp"
+#include "TLSContext.hpp"
+
+class HTTPServer;
+
+// How the server fits into the process that runs it, see ServerBuilder
+struct ServerHooks
+{
+    // start() spawns no threads, the caller runs the acceptor and the workers
+    bool callerThreads{false};
+
+    std::function<void(HTTPServer&)> onStart;   // once start() has everything running
+    std::function<void(HTTPServer&)> onStop;    // as stop() begins, still serving
+    std::function<void(int)> onWorkerStart;     // on the worker's thread, before its first event
+    std::function<void(int)> onWorkerStop;      // on the worker's thread, after its last event
+};
 
 class HTTPServer
 {
 private:
-    static constexpr int kThreadPoolSize = 8;
-    static constexpr int kMaxEvents = 10000;
+    static constexpr size_t kMaxPendingOutput = 256 * 1024;
+    static constexpr size_t kReadBufferSize = 64 * 1024;
+    static constexpr size_t kUpstreamReadSize = 16 * 1024;
+    static constexpr size_t kMaxIdleUpstreams = 32;    // per upstream, per worker
+    static constexpr int kAcceptBatch = 64;             // accepts per worker wakeup round
+    static constexpr uintptr_t kWakeIdent = 1;          // EVFILT_USER ident on worker kqueues
+    static constexpr uintptr_t kBroadcastIdent = 2;     // EVFILT_USER ident for pending broadcasts
+    static constexpr uintptr_t kFlightIdent = 3;        // EVFILT_USER ident for coalesced responses
+    static constexpr size_t kMaxWriteBuffers = 64;      // iovecs per WebSocket writev()
 
+    // Per-worker state. The event array is allocated by the worker thread
+    // itself, after pinning, so it lands on the worker's NUMA node.
+    struct Worker
+    {
+        std::thread thread;
+        int kqFd{-1};
+        int cpu{-1};
+        struct kevent* events{nullptr};
+        char* readBuffer{nullptr};      // scratch for every recv, see BufferPool
+        std::unique_ptr<HandoffQueue> handoff;  // accepted connections, wakes via EVFILT_USER
+        std::unique_ptr<BroadcastQueue> broadcasts;     // WebSocket messages for its subscribers
+
+        // Busy-poll mode, only touched by the worker until it has exited
+        uint64_t spinBudgetNs{0};
+        uint64_t idleGapNs{0};          // moving average of the wait for the next events
+        uint64_t spinNs{0};
+        uint64_t blockedNs{0};
+        uint64_t spinWakeups{0};        // waits answered while spinning
+        uint64_t blockWakeups{0};       // waits that had to block
+    };
+
+    ServerConfig m_config;
+    ServerHooks m_hooks;
+    AdmissionControl m_admission;
     std::atomic<bool> m_active;
-    ListenerSocket m_listenerSocket;
+    std::vector<std::unique_ptr<ListenerSocket>> m_listeners;    // all accepted by m_listenerThread
     std::thread m_listenerThread;
+    bool m_acceptorRunning{false};  // in listen(), guarded by m_initMutex
+
+    // Acceptor state kept between rounds: the next worker in the round robin,
+    // and the workers to wake at the end of the round
+    int m_nextWorker{0};
+    std::vector<int> m_toWake;
 
     std::mt19937 m_rng;
     std::uniform_int_distribution<int> m_sleepTimes;
     void sleepThread();
 
+    // Server ends of openLoopback() connections, adopted by the acceptor
+    std::mutex m_loopbackMutex;
+    std::vector<int> m_loopbackPending;
+
     tbb::concurrent_hash_map<int, ClientContext*> m_clientFds;
     size_t m_initializedThreads;
+    size_t m_runningWorkers{0};     // attached to a thread, see attachWorker
     std::mutex m_initMutex;
     std::condition_variable m_initCondVar;
-    std::thread m_workerThreads[kThreadPoolSize];
-    int m_workerKqFds[kThreadPoolSize];
-    struct kevent m_workerEvents[kThreadPoolSize][kMaxEvents];
+    std::vector<Worker> m_workers;
 
     Router m_router;
+    ReverseProxy m_proxy;
+    std::unique_ptr<TLSContext> m_tls;      // set when serving HTTPS
+    std::unique_ptr<SingleFlight> m_singleFlight;
+
+    std::atomic<uint64_t> m_wsBroadcasts{0};
+    std::atomic<uint64_t> m_wsDelivered{0};     // frames queued on subscribers
+    std::atomic<uint64_t> m_wsSlowConsumers{0};
+
+    // Worker setup and teardown on the thread that runs it
+    void attachWorker(int workerNum);
+    void detachWorker(int workerNum);
+
+    // Handle a batch of events returned by kevent()
+    void handleEvents(Worker& worker, int noEvents);
+
+    // Queue a new connection on the next worker with room, round robin
+    void handOff(int clientFd, uint64_t clientKey, int& workerNum, std::vector<int>& toWake);
+
+    // Busy-poll wait: spin on the kqueue for the worker's spin budget, then
+    // block. The budget follows the average idle gap, see runEventLoop.
+    int pollEvents(Worker& worker);
+    void logPollStats() const;
+
+    // Take ownership of connections queued by the acceptor
+    void adoptConnections(Worker& worker);
 
-    // Unregister client from kqueue, delete ctx, close socket
-    void killClient(int kqFd, int clientFd, ClientContext* ctx);
+    // Close socket and free ctx once the current batch of events is done
+    void killClient(ClientContext* ctx);
+
+    // recv()/send() on the client, through TLS when the connection has it.
+    // receive() fills as much of the buffer as it can, drained is set once the
+    // socket would block.
+    ssize_t receive(ClientContext* ctx, char* buffer, size_t length, bool& drained);
+    ssize_t transmit(ClientContext* ctx, const char* data, size_t length);
+    void continueHandshake(ClientContext* ctx);
+
+    // Drain the socket and serve every complete request
+    void readRequests(ClientContext* ctx);
+    void readHTTP2(ClientContext* ctx);
+
+    // Send pending output, arming a one-shot write event if the socket is full.
+    // Returns true once everything was sent.
+    bool flushResponse(ClientContext* ctx);
+    bool flushHTTP2(ClientContext* ctx);
+    void armWrite(ClientContext* ctx);
+
+    // Best-effort canned response to a connection that is refused at accept
+    void rejectClient(int clientFd, std::string_view response);
+    void setupHTTP2(ClientContext* ctx);
+
+    // WebSocket connections subscribe to their route on the worker that owns
+    // them. Broadcasts reach each worker through its BroadcastQueue.
+    void readWebSocket(ClientContext* ctx);
+    bool flushWebSocket(ClientContext* ctx);
+    void subscribe(ClientContext* ctx);
+    void unsubscribe(ClientContext* ctx);
+    void deliverBroadcasts(Worker& worker);
+    void dropSlowConsumer(ClientContext* ctx);
+
+    // Responses for connections parked behind a coalesced request
+    void deliverFlights();
+    void logConnectionMemory() const;
+
+    // Reverse proxy. Upstream connections belong to the worker that opened
+    // them; the client waits, reads paused once the request body is relayed,
+    // until its proxied response is relayed.
+    void startProxy(ClientContext* ctx, const ProxyTarget& proxyTarget, std::string_view request);
+    size_t relayRequestBody(ClientContext* ctx, const char* data, size_t length);
+    UpstreamConnection* acquireUpstream(Upstream* target);
+    UpstreamConnection* connectUpstream(Upstream* target);
+    void handleUpstreamEvent(UpstreamConnection* conn, const struct kevent& event);
+    bool flushUpstream(UpstreamConnection* conn);
+    void armUpstreamWrite(UpstreamConnection* conn);
+    void armUpstreamTimer(UpstreamConnection* conn, int milliseconds);
+    void cancelUpstreamTimer(UpstreamConnection* conn);
+    void readUpstream(UpstreamConnection* conn);
+    void finishProxy(UpstreamConnection* conn, bool reusable);
+    void upstreamFailed(UpstreamConnection* conn);
+    void upstreamTimedOut(UpstreamConnection* conn);
+    void failProxy(UpstreamConnection* conn, std::string_view response);
+    void closeUpstream(UpstreamConnection* conn);
 
 public:
+    explicit HTTPServer(const ServerConfig& config, ServerHooks hooks = {});
     HTTPServer(const std::string& host, int port);
     ~HTTPServer();
 
     void start();
     void stop();
+
+    // The acceptor and worker loops, blocking until stop(). start() runs each
+    // on a thread of its own, unless the hooks ask for callerThreads.
     void listen();
     void runEventLoop(int workerNum);
-    void handleEvent(int kqfd, ClientContext* ctx, const struct kevent& event);
+
+    // With callerThreads, the loops can also be driven from the caller's own
+    // event loop instead, one step at a time. A worker must always be polled
+    // from the same thread, and each thread can serve one worker. Keep
+    // polling until pollWorker() returns false, or call stop() on the
+    // polling thread.
+    int workerCount() const { return static_cast<int>(m_workers.size()); }
+    int workerFd(int workerNum) const { return m_workers[workerNum].kqFd; }   // readable when events are ready
+    std::vector<int> listenerFds() const;   // readable when connections are waiting
+    int pollAcceptor();                 // accepts what is waiting, returns how many
+    bool pollWorker(int workerNum);     // handles what is ready without blocking, false once stopped
+
+    void handleEvent(ClientContext* ctx, const struct kevent& event);
     bool isActive() const { return m_active; }
+
+    // Routes can be changed at any time, from any thread, see Router
+    Router& router() { return m_router; }
+
+    // An in-process connection: one end of a Unix socketpair is served like
+    // an accepted client, the returned end is the caller's to read, write and
+    // close. Requests skip the TCP/IP stack, for benchmarks and embedding.
+    int openLoopback();
+
+    // Push a message to every WebSocket connection upgraded on channel (its
+    // route path), on all workers. Safe to call from any thread, including
+    // WebSocket handlers. Dropped while the server is not running.
+    void broadcast(std::string_view channel, std::string_view message, bool binary = false);
 };
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "ServerBuilder.hpp"
+
+ServerBuilder::ServerBuilder(ServerConfig config)
+    : m_config(std::move(config))
+{
+}
+
+ServerBuilder& ServerBuilder::listen(const std::string& address, int backlog)
+{
+    return listen(ServerConfig::ListenerConfig{address, backlog});
+}
+
+ServerBuilder& ServerBuilder::listen(ServerConfig::ListenerConfig listener)
+{
+    m_config.listeners.push_back(std::move(listener));
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::workers(int count)
+{
+    m_config.workers = count;
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::cpus(std::vector<int> cpus, int acceptorCpu)
+{
+    m_config.cpus = std::move(cpus);
+    m_config.acceptorCpu = acceptorCpu;
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::busyPoll(int budgetMicroseconds)
+{
+    m_config.busyPoll = true;
+    m_config.busyPollBudget = budgetMicroseconds;
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::set(const std::string& key, const std::string& value)
+{
+    m_config.set(key, value);
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::callerThreads(bool enabled)
+{
+    m_hooks.callerThreads = enabled;
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::route(const std::string& path, Method method, RequestHandler handler)
+{
+    m_routes.push_back([path, method, handler = std::move(handler)](HTTPServer&, RouteTable& table)
+    {
+        table.addHandler(path, method, handler);
+    });
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::staticResponse(const std::string& path, Response response)
+{
+    m_routes.push_back([path, response = std::move(response)](HTTPServer&, RouteTable& table)
+    {
+        table.addStaticResponse(path, response);
+    });
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::singleFlight(const std::string& path, std::vector<std::string> keyHeaders)
+{
+    m_routes.push_back([path, keyHeaders = std::move(keyHeaders)](HTTPServer&, RouteTable& table)
+    {
+        table.addSingleFlight(path, keyHeaders);
+    });
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::webSocket(const std::string& path, WebSocketHandler handler)
+{
+    m_routes.push_back([path, handler = std::move(handler)](HTTPServer&, RouteTable& table)
+    {
+        table.addWebSocket(path, handler);
+    });
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::broadcastWebSocket(const std::string& path)
+{
+    m_routes.push_back([path](HTTPServer& server, RouteTable& table)
+    {
+        table.addWebSocket(path, [&server](WebSocketSession& session, std::string_view message, bool binary)
+        {
+            server.broadcast(session.channel(), message, binary);
+        });
+    });
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::onStart(std::function<void(HTTPServer&)> hook)
+{
+    m_hooks.onStart = std::move(hook);
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::onStop(std::function<void(HTTPServer&)> hook)
+{
+    m_hooks.onStop = std::move(hook);
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::onWorkerStart(std::function<void(int)> hook)
+{
+    m_hooks.onWorkerStart = std::move(hook);
+    return *this;
+}
+
+ServerBuilder& ServerBuilder::onWorkerStop(std::function<void(int)> hook)
+{
+    m_hooks.onWorkerStop = std::move(hook);
+    return *this;
+}
+
+std::unique_ptr<HTTPServer> ServerBuilder::build()
+{
+    auto server = std::make_unique<HTTPServer>(m_config, m_hooks);
+    HTTPServer& built = *server;
+    built.router().update([this, &built](RouteTable& table)
+    {
+        for (const auto& edit : m_routes)
+            edit(built, table);
+    });
+    return server;
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Server.hpp"
+#include "ServerConfig.hpp"
+#include "RouteTable.hpp"
+
+// Assembles an HTTPServer for a program that embeds it: listeners, worker
+// settings, routes and lifecycle hooks, then build().
+//
+//   auto server = ServerBuilder()
+//       .listen("unix:/run/app.sock")
+//       .workers(2)
+//       .route("/hello", Method::GET, hello)
+//       .onWorkerStart([](int worker) { ... })
+//       .build();
+//   server->start();
+//
+// Anything else a config file can set goes through set(). Routes given here
+// are published together as the router's first version, later changes go
+// through server->router().
+class ServerBuilder
+{
+private:
+    ServerConfig m_config;
+    ServerHooks m_hooks;
+    std::vector<std::function<void(HTTPServer&, RouteTable&)>> m_routes;
+
+public:
+    explicit ServerBuilder(ServerConfig config = {});
+
+    // Listeners, see ServerConfig::ListenerConfig. The first one replaces the
+    // default host:port.
+    ServerBuilder& listen(const std::string& address, int backlog = 0);
+    ServerBuilder& listen(ServerConfig::ListenerConfig listener);
+
+    // Workers, and CPUs to pin them (and the acceptor) to, -1 = unpinned
+    ServerBuilder& workers(int count);
+    ServerBuilder& cpus(std::vector<int> cpus, int acceptorCpu = -1);
+    ServerBuilder& busyPoll(int budgetMicroseconds);
+
+    // Any config file key, e.g. set("max-connections", "10000")
+    ServerBuilder& set(const std::string& key, const std::string& value);
+
+    // Run no threads of the server's own, see HTTPServer::pollWorker()
+    ServerBuilder& callerThreads(bool enabled = true);
+
+    ServerBuilder& route(const std::string& path, Method method, RequestHandler handler);
+    ServerBuilder& staticResponse(const std::string& path, Response response);
+    ServerBuilder& singleFlight(const std::string& path, std::vector<std::string> keyHeaders = {});
+    ServerBuilder& webSocket(const std::string& path, WebSocketHandler handler);
+
+    // A WebSocket route where every message is broadcast to all of its subscribers
+    ServerBuilder& broadcastWebSocket(const std::string& path);
+
+    // See ServerHooks
+    ServerBuilder& onStart(std::function<void(HTTPServer&)> hook);
+    ServerBuilder& onStop(std::function<void(HTTPServer&)> hook);
+    ServerBuilder& onWorkerStart(std::function<void(int)> hook);
+    ServerBuilder& onWorkerStop(std::function<void(int)> hook);
+
+    // Binds the listeners and registers the routes, the server is not started.
+    // Throws std::invalid_argument for bad settings, std::runtime_error if a
+    // listener cannot be bound.
+    std::unique_ptr<HTTPServer> build();
+};
\ No newline at end of file
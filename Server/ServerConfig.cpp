@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "ServerConfig.hpp"
+
+namespace
+{
+
+std::string trim(const std::string& string)
+{
+    size_t lpos = string.find_first_not_of(" \t\r");
+    if (lpos == std::string::npos)
+        return "";
+    size_t rpos = string.find_last_not_of(" \t\r");
+    return string.substr(lpos, rpos - lpos + 1);
+}
+
+int toInt(const std::string& key, const std::string& value)
+{
+    size_t parsed = 0;
+    int result;
+    try
+    {
+        result = std::stoi(value, &parsed);
+    }
+    catch (const std::exception&)
+    {
+        parsed = 0;
+    }
+
+    if (parsed == 0 || parsed != value.length())
+        throw std::invalid_argument("Invalid integer for " + key + ": '" + value + "'");
+    return result;
+}
+
+bool toBool(const std::string& key, const std::string& value)
+{
+    if (value == "on" || value == "true" || value == "1")
+        return true;
+    if (value == "off" || value == "false" || value == "0")
+        return false;
+    throw std::invalid_argument("Invalid switch for " + key + ": '" + value + "', expected on or off");
+}
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+std::vector<int> toCpuList(const std::string& key, const std::string& value)
+{
+    std::vector<int> cpus;
+    std::stringstream stream(value);
+    std::string range;
+
+    while (std::getline(stream, range, ','))
+    {
+        range = trim(range);
+        size_t dash = range.find('-');
+        if (dash == std::string::npos)
+        {
+            cpus.push_back(toInt(key, range));
+            continue;
+        }
+
+        int first = toInt(key, range.substr(0, dash));
+        int last = toInt(key, range.substr(dash + 1));
+        if (last < first)
+            throw std::invalid_argument("Invalid CPU range for " + key + ": '" + range + "'");
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+}
+
+void ServerConfig::loadFile(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+        throw std::invalid_argument("Cannot open config file " + path);
+
+    std::string line;
+    int lineNum = 0;
+    while (std::getline(file, line))
+    {
+        lineNum++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos)
+            throw std::invalid_argument(path + ":" + std::to_string(lineNum) + ": expected key = value");
+
+        set(trim(line.substr(0, eq)), trim(line.substr(eq + 1)));
+    }
+}
+
+void ServerConfig::set(const std::string& key, const std::string& value)
+{
+    if (key == "bind")
+    {
+        // host:port, or just a port
+        size_t colon = value.rfind(':');
+        if (colon == std::string::npos)
+            port = toInt(key, value);
+        else
+        {
+            host = value.substr(0, colon);
+            port = toInt(key, value.substr(colon + 1));
+        }
+    }
+    else if (key == "host")
+        host = value;
+    else if (key == "port")
+        port = toInt(key, value);
+    else if (key == "workers")
+    {
+        // 0 = one per hardware thread
+        workers = toInt(key, value);
+        if (workers == 0)
+            workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    else if (key == "max-events")
+        maxEvents = toInt(key, value);
+    else if (key == "backlog")
+        backlog = toInt(key, value);
+    else if (key == "max-request-size")
+        maxRequestSize = toInt(key, value);
+    else if (key == "cpus")
+        cpus = value.empty() ? std::vector<int>() : toCpuList(key, value);
+    else if (key == "acceptor-cpu")
+        acceptorCpu = toInt(key, value);
+    else if (key == "busy-poll")
+        busyPoll = toBool(key, value);
+    else if (key == "busy-poll-budget")
+        busyPollBudget = toInt(key, value);
+    else if (key == "max-connections")
+        maxConnections = toInt(key, value);
+    else if (key == "max-in-flight")
+        maxInFlight = toInt(key, value);
+    else if (key == "rate-limit")
+        rateLimit = toInt(key, value);
+    else if (key == "rate-burst")
+        rateBurst = toInt(key, value);
+    else if (key == "tls-cert")
+        tlsCert = value;
+    else if (key == "tls-key")
+        tlsKey = value;
+    else if (key == "ktls")
+        ktls = toBool(key, value);
+    else if (key == "proxy-connect-timeout")
+        proxyConnectTimeout = toInt(key, value);
+    else if (key == "proxy-timeout")
+        proxyTimeout = toInt(key, value);
+    else if (key == "ws-max-backlog")
+        wsMaxBacklog = toInt(key, value);
+    else if (key == "trace-sample")
+        traceSample = toInt(key, value);
+    else if (key == "listen")
+    {
+        // address[,backlog=n][,defer-accept][,fastopen=n]
+        std::stringstream stream(value);
+        std::string option;
+        ListenerConfig listener;
+        std::getline(stream, listener.address, ',');
+        listener.address = trim(listener.address);
+        if (listener.address.empty())
+            throw std::invalid_argument("Missing address for " + key);
+
+        while (std::getline(stream, option, ','))
+        {
+            option = trim(option);
+            if (option.starts_with("backlog="))
+                listener.backlog = toInt(key, option.substr(8));
+            else if (option == "defer-accept")
+                listener.deferAccept = true;
+            else if (option.starts_with("fastopen="))
+                listener.fastOpen = toInt(key, option.substr(9));
+            else
+                throw std::invalid_argument("Unknown listener option '" + option + "'");
+        }
+        listeners.push_back(std::move(listener));
+    }
+    else if (key == "proxy")
+    {
+        // /prefix=host:port,host:port
+        size_t eq = value.find('=');
+        if (eq == std::string::npos)
+            throw std::invalid_argument("Invalid proxy route '" + value + "', expected prefix=host:port,...");
+
+        ProxyConfig proxy;
+        proxy.prefix = trim(value.substr(0, eq));
+        std::stringstream stream(value.substr(eq + 1));
+        std::string upstream;
+        while (std::getline(stream, upstream, ','))
+        {
+            if (!(upstream = trim(upstream)).empty())
+                proxy.upstreams.push_back(upstream);
+        }
+        proxies.push_back(std::move(proxy));
+    }
+    else
+        throw std::invalid_argument("Unknown option '" + key + "'");
+}
+
+void ServerConfig::validate() const
+{
+    if (port < 0 || port > 65535)
+        throw std::invalid_argument("port must be within 0-65535");
+    if (workers < 1 || workers > 1024)
+        throw std::invalid_argument("workers must be within 1-1024");
+    if (maxEvents < 1)
+        throw std::invalid_argument("max-events must be positive");
+    if (backlog < 1)
+        throw std::invalid_argument("backlog must be positive");
+    if (maxRequestSize < 1024)
+        throw std::invalid_argument("max-request-size must be at least 1024");
+    if (proxyConnectTimeout < 1 || proxyTimeout < 1)
+        throw std::invalid_argument("proxy-connect-timeout and proxy-timeout must be positive");
+    if (wsMaxBacklog < 1024)
+        throw std::invalid_argument("ws-max-backlog must be at least 1024");
+    if (traceSample < 0)
+        throw std::invalid_argument("trace-sample must not be negative");
+
+    for (const ListenerConfig& listener : listeners)
+    {
+        if (listener.backlog < 0 || listener.fastOpen < 0)
+            throw std::invalid_argument("listen backlog and fastopen must not be negative");
+        if (listener.address.starts_with("unix:") && (listener.deferAccept || listener.fastOpen > 0))
+            throw std::invalid_argument("defer-accept and fastopen need a TCP listener, not " + listener.address);
+    }
+
+    for (int cpu : cpus)
+    {
+        if (cpu < 0)
+            throw std::invalid_argument("cpus must not be negative");
+    }
+    if (acceptorCpu < -1)
+        throw std::invalid_argument("acceptor-cpu must be -1 or a CPU number");
+    if (busyPollBudget < 1 || busyPollBudget > 1000000)
+        throw std::invalid_argument("busy-poll-budget must be within 1-1000000");
+
+    if (maxConnections < 0 || maxInFlight < 0)
+        throw std::invalid_argument("max-connections and max-in-flight must not be negative");
+    // Buckets hold milli-tokens in 32 bits
+    if (rateLimit < 0 || rateBurst < 0 || rateLimit > 4000000 || rateBurst > 4000000)
+        throw std::invalid_argument("rate-limit and rate-burst must be within 0-4000000");
+
+    if (tlsCert.empty() != tlsKey.empty())
+        throw std::invalid_argument("tls-cert and tls-key must be given together");
+}
+
+int ServerConfig::workerCpu(int workerNum) const
+{
+    if (cpus.empty())
+        return -1;
+    return cpus[workerNum % cpus.size()];
+}
+
+std::vector<ServerConfig::ListenerConfig> ServerConfig::listenAddresses() const
+{
+    if (!listeners.empty())
+        return listeners;
+
+    // IPv6 hosts from --bind or --host are given without brackets
+    ListenerConfig listener;
+    if (host.find(':') != std::string::npos && !host.starts_with('['))
+        listener.address = "[" + host + "]:" + std::to_string(port);
+    else
+        listener.address = host + ":" + std::to_string(port);
+    return {listener};
+}
+
+ServerConfig ServerConfig::fromArgs(int argc, char* argv[])
+{
+    ServerConfig config;
+    std::vector<std::pair<std::string, std::string>> options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        if (!arg.starts_with("--"))
+            throw std::invalid_argument("Unexpected argument '" + arg + "'");
+        arg.erase(0, 2);
+
+        // --key=value or --key value
+        std::string value;
+        size_t eq = arg.find('=');
+        if (eq != std::string::npos)
+        {
+            value = arg.substr(eq + 1);
+            arg.resize(eq);
+        }
+        else if (i + 1 < argc)
+            value = argv[++i];
+        else
+            throw std::invalid_argument("Missing value for --" + arg);
+
+        options.emplace_back(arg, value);
+    }
+
+    // The file first, so the remaining options override it
+    for (const auto& [key, value] : options)
+    {
+        if (key == "config")
+            config.loadFile(value);
+    }
+    for (const auto& [key, value] : options)
+    {
+        if (key != "config")
+            config.set(key, value);
+    }
+
+    config.validate();
+    return config;
+}
+
+std::string ServerConfig::usage(const char* program)
+{
+    return std::string("Usage: ") + program + " [options]\n"
+        "  --config <file>        key = value file, overridden by other options\n"
+        "  --bind <host:port>     listen address (default 127.0.0.1:8080)\n"
+        "  --workers <n>          worker threads, 0 = hardware threads (default 8)\n"
+        "  --max-events <n>       kevents per wait, per worker (default 10000)\n"
+        "  --listen <address>     listen on host:port, [ipv6]:port or unix:/path instead of --bind,\n"
+        "                         with options ,backlog=n ,defer-accept ,fastopen=n (repeatable)\n"
+        "  --backlog <n>          listen() backlog (default 1000)\n"
+        "  --max-request-size <n> bytes, larger requests close the connection (default 1048576)\n"
+        "  --cpus <list>          pin workers to CPUs, e.g. 0-3,8 (default unpinned)\n"
+        "  --acceptor-cpu <n>     pin the acceptor thread (default unpinned)\n"
+        "  --busy-poll <on|off>   spin before blocking, lower latency for more CPU (default off)\n"
+        "  --busy-poll-budget <n> longest spin in microseconds, adapted to traffic (default 50)\n"
+        "  --max-connections <n>  503 and close beyond this many connections (default unlimited)\n"
+        "  --max-in-flight <n>    503 beyond this many unsent responses (default unlimited)\n"
+        "  --rate-limit <n>       requests per second per client IP, 429 beyond (default off)\n"
+        "  --rate-burst <n>       requests a client may burst (default rate-limit)\n"
+        "  --tls-cert <file>      PEM certificate chain, serves HTTPS together with --tls-key\n"
+        "  --tls-key <file>       PEM private key\n"
+        "  --ktls <on|off>        kernel TLS offload after the handshake (default on)\n"
+        "  --proxy <route>        forward a path prefix, e.g. /api=10.0.0.1:80,10.0.0.2:80 (repeatable)\n"
+        "  --proxy-connect-timeout <ms> 504 if an upstream does not accept the connection (default 5000)\n"
+        "  --proxy-timeout <ms>   504 if an upstream sends nothing for this long (default 60000)\n"
+        "  --ws-max-backlog <n>   unsent WebSocket bytes before a subscriber is closed (default 1048576)\n"
+        "  --trace-sample <n>     trace 1 in n connection events, served on /debug/trace (default off)\n";
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Runtime settings of an HTTPServer, loaded from a config file and/or the
+// command line. Later sources override earlier ones:
+//
+//   defaults < --config <file> < other command line options
+//
+// The file holds one "key = value" per line, '#' starts a comment. Keys match
+// the long command line options without the leading dashes.
+struct ServerConfig
+{
+    std::string host{"127.0.0.1"};
+    int port{8080};
+
+    int workers{8};             // worker threads, each with its own kqueue
+    int maxEvents{10000};       // kevents returned per wait, per worker
+    int backlog{1000};          // listen() backlog
+    int maxRequestSize{1024 * 1024};    // headers + body of one HTTP/1.1 request
+
+    // Listening sockets, "listen" may be given several times. All of them feed
+    // the same workers. Without any, the server listens on host:port.
+    struct ListenerConfig
+    {
+        std::string address;    // host:port, [ipv6]:port or unix:/path
+        int backlog{0};         // 0 = the backlog above
+        bool deferAccept{false};    // accept only once the client has sent data, TCP only
+        int fastOpen{0};        // TCP Fast Open queue length, 0 = off
+    };
+    std::vector<ListenerConfig> listeners;
+
+    // CPU pinning, workers take cpus[i % cpus.size()]. Empty = no pinning
+    std::vector<int> cpus;
+    int acceptorCpu{-1};        // -1 = not pinned
+
+    // Workers spin on their kqueue for up to busyPollBudget microseconds
+    // before blocking, instead of polling and sleeping. Trades CPU for latency.
+    bool busyPoll{false};
+    int busyPollBudget{50};
+
+    // Admission control, 0 = unlimited
+    int maxConnections{0};
+    int maxInFlight{0};         // requests with unsent responses, all workers
+    int rateLimit{0};           // requests per second per client IP
+    int rateBurst{0};           // bucket size, 0 = rateLimit
+
+    // HTTPS when both are set, PEM files
+    std::string tlsCert;
+    std::string tlsKey;
+    bool ktls{true};            // kernel TLS after the handshake, where supported
+
+    // Reverse proxy routes, "proxy" may be given several times
+    struct ProxyConfig
+    {
+        std::string prefix;
+        std::vector<std::string> upstreams;
+    };
+    std::vector<ProxyConfig> proxies;
+    int proxyConnectTimeout{5000};  // milliseconds to connect to an upstream
+    int proxyTimeout{60000};        // milliseconds an upstream may go silent mid-request
+
+    // Unsent WebSocket bytes a subscriber may hold before it is closed as too slow
+    int wsMaxBacklog{1024 * 1024};
+
+    // Phase tracing of one in traceSample connection events, 0 = off.
+    // The trace is served on /debug/trace.
+    int traceSample{0};
+
+    void loadFile(const std::string& path);
+    void set(const std::string& key, const std::string& value);
+
+    // Throws std::invalid_argument on bad values
+    void validate() const;
+
+    // Worker's CPU, -1 if unpinned
+    int workerCpu(int workerNum) const;
+
+    // listeners, or host:port when there are none
+    std::vector<ListenerConfig> listenAddresses() const;
+
+    static ServerConfig fromArgs(int argc, char* argv[]);
+    static std::string usage(const char* program);
+};
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include <spdlog/spdlog.h>
+
+#include "SingleFlight.hpp"
+#include "ClientContext.hpp"
+
+namespace
+{
+
+// The calling worker, and its connections parked by ticket
+thread_local int t_worker = -1;
+thread_local uint64_t t_nextTicket = 0;
+thread_local std::unordered_map<uint64_t, ClientContext*> t_parked;
+
+}
+
+SingleFlight::SingleFlight(int workers, std::function<void(int)> wake)
+    : m_shards(std::make_unique<Shard[]>(kShards))
+    , m_inboxes(std::make_unique<Inbox[]>(workers))
+    , m_wake(std::move(wake))
+{
+}
+
+void SingleFlight::bindWorker(int worker)
+{
+    t_worker = worker;
+    t_parked.clear();
+}
+
+bool SingleFlight::join(const std::string& key, ClientContext* ctx)
+{
+    Shard& s = shard(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    auto [it, inserted] = s.flights.try_emplace(key);
+    if (inserted)
+        return true;
+
+    ctx->flightTicket = ++t_nextTicket;
+    t_parked[ctx->flightTicket] = ctx;
+    it->second.push_back(Waiter{t_worker, ctx->flightTicket});
+    m_coalesced.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void SingleFlight::complete(const std::string& key, const SharedResponse& response)
+{
+    m_executed.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<Waiter> waiters;
+    {
+        Shard& s = shard(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.flights.find(key);
+        if (it == s.flights.end())
+            return;
+        waiters.swap(it->second);
+        s.flights.erase(it);
+    }
+
+    for (const Waiter& waiter : waiters)
+    {
+        Inbox& inbox = m_inboxes[waiter.worker];
+        {
+            std::lock_guard<std::mutex> lock(inbox.mutex);
+            inbox.pending.push_back(Completion{waiter.ticket, response});
+        }
+        if (!inbox.wakePending.exchange(true, std::memory_order_seq_cst))
+            m_wake(waiter.worker);
+    }
+}
+
+void SingleFlight::cancel(ClientContext* ctx)
+{
+    t_parked.erase(ctx->flightTicket);
+    ctx->flightTicket = 0;
+}
+
+void SingleFlight::drain(std::vector<std::pair<ClientContext*, SharedResponse>>& out)
+{
+    // Cleared first, so later completions wake the worker again
+    Inbox& inbox = m_inboxes[t_worker];
+    inbox.wakePending.exchange(false, std::memory_order_seq_cst);
+
+    std::vector<Completion> completions;
+    {
+        std::lock_guard<std::mutex> lock(inbox.mutex);
+        completions.swap(inbox.pending);
+    }
+
+    for (Completion& completion : completions)
+    {
+        auto it = t_parked.find(completion.ticket);
+        if (it == t_parked.end())
+            continue;
+
+        ClientContext* ctx = it->second;
+        ctx->flightTicket = 0;
+        t_parked.erase(it);
+        out.emplace_back(ctx, std::move(completion.response));
+    }
+}
+
+void SingleFlight::logStats() const
+{
+    spdlog::info("Single-flight: {} handler runs, {} requests coalesced onto them",
+        m_executed.load(), m_coalesced.load());
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ClientContext;
+
+// A serialized HTTP/1.1 response, shared by every request it answers
+using SharedResponse = std::shared_ptr<const std::string>;
+
+// Request coalescing across workers. The first request for a key runs its
+// handler; identical requests arriving on any worker meanwhile are parked
+// and get a copy of its serialized response once it is done.
+//
+// Each waiter is identified by its worker and a ticket, never by pointer, so
+// a connection closed while waiting is simply not found when the response
+// arrives. Responses reach a worker through its inbox, and the worker is
+// woken, like BroadcastQueue, only for the first completion since its last drain.
+class SingleFlight
+{
+private:
+    struct Waiter
+    {
+        int worker;
+        uint64_t ticket;
+    };
+
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::vector<Waiter>> flights;
+    };
+
+    struct Completion
+    {
+        uint64_t ticket;
+        SharedResponse response;
+    };
+
+    struct alignas(64) Inbox
+    {
+        std::mutex mutex;
+        std::vector<Completion> pending;
+        std::atomic<bool> wakePending{false};
+    };
+
+    static constexpr size_t kShards = 64;
+
+    std::unique_ptr<Shard[]> m_shards;
+    std::unique_ptr<Inbox[]> m_inboxes;
+    std::function<void(int)> m_wake;
+
+    std::atomic<uint64_t> m_executed{0};
+    std::atomic<uint64_t> m_coalesced{0};
+
+    Shard& shard(const std::string& key) { return m_shards[std::hash<std::string>{}(key) % kShards]; }
+
+public:
+    // wake(worker) signals a worker to call drain(), from any thread
+    SingleFlight(int workers, std::function<void(int)> wake);
+    SingleFlight(const SingleFlight&) = delete;
+    SingleFlight& operator=(const SingleFlight&) = delete;
+
+    // Worker side: the calling thread's worker number, before it serves requests
+    static void bindWorker(int worker);
+
+    // True if the caller leads the flight for key, and must complete() it.
+    // Otherwise ctx is parked until the leader's response arrives.
+    bool join(const std::string& key, ClientContext* ctx);
+
+    // Hand the leader's response to every waiter, and end the flight
+    void complete(const std::string& key, const SharedResponse& response);
+
+    // A parked connection that is closing, its response is discarded
+    void cancel(ClientContext* ctx);
+
+    // Worker side: responses for the calling worker's parked connections
+    void drain(std::vector<std::pair<ClientContext*, SharedResponse>>& out);
+
+    void logStats() const;
+};
\ No newline at end of file
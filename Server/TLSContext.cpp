@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+#include <spdlog/spdlog.h>
+
+#ifdef HAS_OPENSSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+#include "TLSContext.hpp"
+
+#ifdef HAS_OPENSSL
+
+namespace
+{
+
+std::string lastError()
+{
+    char message[256];
+    ERR_error_string_n(ERR_get_error(), message, sizeof(message));
+    ERR_clear_error();
+    return message;
+}
+
+int selectAlpn(SSL*, const unsigned char** out, unsigned char* outLength,
+    const unsigned char* in, unsigned int inLength, void*)
+{
+    // Server preference order
+    static const unsigned char kProtocols[] = "\x02h2\x08http/1.1";
+    if (SSL_select_next_proto(const_cast<unsigned char**>(out), outLength,
+            kProtocols, sizeof(kProtocols) - 1, in, inLength) != OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_NOACK;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+TLSContext::Status toStatus(SSL* ssl, int result)
+{
+    switch (SSL_get_error(ssl, result))
+    {
+    case SSL_ERROR_WANT_READ:
+        return TLSContext::Status::WantRead;
+    case SSL_ERROR_WANT_WRITE:
+        return TLSContext::Status::WantWrite;
+    case SSL_ERROR_ZERO_RETURN:
+        return TLSContext::Status::Closed;
+    default:
+        // Keep the thread's error queue clean for the next connection
+        ERR_clear_error();
+        return TLSContext::Status::Failed;
+    }
+}
+
+}
+
+TLSContext::TLSContext(const ServerConfig& config)
+{
+    m_ctx = SSL_CTX_new(TLS_server_method());
+    if (!m_ctx)
+        throw std::runtime_error("Failed to create TLS context: " + lastError());
+
+    SSL_CTX_set_min_proto_version(m_ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(m_ctx, SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+
+    // Writes behave like send() on a non-blocking socket, and idle
+    // connections drop their record buffers
+    SSL_CTX_set_mode(m_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+        | SSL_MODE_RELEASE_BUFFERS);
+
+    // Stateless tickets only, resumption needs no cache shared between workers
+    SSL_CTX_set_session_cache_mode(m_ctx, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_num_tickets(m_ctx, 1);
+
+    if (config.ktls)
+    {
+#ifdef SSL_OP_ENABLE_KTLS
+        SSL_CTX_set_options(m_ctx, SSL_OP_ENABLE_KTLS);
+#else
+        spdlog::warn("OpenSSL was built without kTLS, records are encrypted in user space");
+#endif
+    }
+
+    SSL_CTX_set_alpn_select_cb(m_ctx, selectAlpn, nullptr);
+
+    if (SSL_CTX_use_certificate_chain_file(m_ctx, config.tlsCert.c_str()) != 1)
+    {
+        std::string error = lastError();
+        SSL_CTX_free(m_ctx);
+        throw std::runtime_error("Failed to load TLS certificate " + config.tlsCert + ": " + error);
+    }
+    if (SSL_CTX_use_PrivateKey_file(m_ctx, config.tlsKey.c_str(), SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(m_ctx) != 1)
+    {
+        std::string error = lastError();
+        SSL_CTX_free(m_ctx);
+        throw std::runtime_error("Failed to load TLS key " + config.tlsKey + ": " + error);
+    }
+
+    spdlog::info("TLS enabled with certificate {}, kTLS {}", config.tlsCert, config.ktls ? "on" : "off");
+}
+
+TLSContext::~TLSContext()
+{
+    SSL_CTX_free(m_ctx);
+}
+
+ssl_st* TLSContext::accept(int fd)
+{
+    SSL* ssl = SSL_new(m_ctx);
+    if (!ssl)
+    {
+        spdlog::error("[fd {}] Failed to create TLS session: {}", fd, lastError());
+        return nullptr;
+    }
+
+    SSL_set_fd(ssl, fd);
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+void TLSContext::release(ssl_st* ssl)
+{
+    SSL_free(ssl);
+}
+
+TLSContext::Status TLSContext::handshake(ssl_st* ssl)
+{
+    int result = SSL_do_handshake(ssl);
+    if (result == 1)
+    {
+        m_handshakes.fetch_add(1, std::memory_order_relaxed);
+        if (SSL_session_reused(ssl))
+            m_resumed.fetch_add(1, std::memory_order_relaxed);
+        if (BIO_get_ktls_send(SSL_get_wbio(ssl)))
+            m_ktls.fetch_add(1, std::memory_order_relaxed);
+        return Status::Ok;
+    }
+
+    Status status = toStatus(ssl, result);
+    if (status == Status::Failed || status == Status::Closed)
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+    return status;
+}
+
+ssize_t TLSContext::read(ssl_st* ssl, char* buffer, size_t length, Status& status)
+{
+    int result = SSL_read(ssl, buffer, static_cast<int>(std::min<size_t>(length, INT_MAX)));
+    if (result > 0)
+    {
+        status = Status::Ok;
+        return result;
+    }
+    status = toStatus(ssl, result);
+    return -1;
+}
+
+ssize_t TLSContext::write(ssl_st* ssl, const char* data, size_t length, Status& status)
+{
+    int result = SSL_write(ssl, data, static_cast<int>(std::min<size_t>(length, INT_MAX)));
+    if (result > 0)
+    {
+        status = Status::Ok;
+        return result;
+    }
+    status = toStatus(ssl, result);
+    return -1;
+}
+
+#else
+
+TLSContext::TLSContext(const ServerConfig&)
+{
+    throw std::runtime_error("HTTPS requires building with OpenSSL");
+}
+
+TLSContext::~TLSContext() = default;
+
+ssl_st* TLSContext::accept(int) { return nullptr; }
+void TLSContext::release(ssl_st*) {}
+TLSContext::Status TLSContext::handshake(ssl_st*) { return Status::Failed; }
+
+ssize_t TLSContext::read(ssl_st*, char*, size_t, Status& status)
+{
+    status = Status::Failed;
+    return -1;
+}
+
+ssize_t TLSContext::write(ssl_st*, const char*, size_t, Status& status)
+{
+    status = Status::Failed;
+    return -1;
+}
+
+#endif
+
+void TLSContext::logStats() const
+{
+    spdlog::info("TLS: {} handshakes, {} resumed, {} with kTLS send, {} failed",
+        m_handshakes.load(), m_resumed.load(), m_ktls.load(), m_failed.load());
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+#include "ServerConfig.hpp"
+
+struct ssl_st;
+struct ssl_ctx_st;
+
+// Server-side TLS shared by all workers: one OpenSSL context, with sessions
+// created per connection and driven non-blocking from the worker event loops.
+//
+//  - ALPN offers h2 and http/1.1, an h2 client then sends the connection
+//    preface and is picked up like HTTP/2 with prior knowledge
+//  - Resumption uses stateless session tickets, no server-side session cache
+//  - With kTLS, records are encrypted by the kernel once the handshake is
+//    done, so SSL_write hands plaintext straight to the socket
+//
+// Built without OpenSSL (HAS_OPENSSL unset), constructing one throws.
+class TLSContext
+{
+private:
+    ssl_ctx_st* m_ctx{nullptr};
+
+    std::atomic<uint64_t> m_handshakes{0};
+    std::atomic<uint64_t> m_resumed{0};
+    std::atomic<uint64_t> m_ktls{0};
+    std::atomic<uint64_t> m_failed{0};
+
+public:
+    enum class Status { Ok, WantRead, WantWrite, Closed, Failed };
+
+    // Throws std::runtime_error if the certificate or key cannot be loaded
+    explicit TLSContext(const ServerConfig& config);
+    ~TLSContext();
+    TLSContext(const TLSContext&) = delete;
+    TLSContext& operator=(const TLSContext&) = delete;
+
+    // A session in server mode on a connected socket, nullptr on failure
+    ssl_st* accept(int fd);
+    static void release(ssl_st* ssl);
+
+    // One non-blocking handshake step, Ok once it is complete
+    Status handshake(ssl_st* ssl);
+
+    // Like recv()/send(): bytes moved, or -1 with the reason in status
+    static ssize_t read(ssl_st* ssl, char* buffer, size_t length, Status& status);
+    static ssize_t write(ssl_st* ssl, const char* data, size_t length, Status& status);
+
+    void logStats() const;
+};
\ No newline at end of file
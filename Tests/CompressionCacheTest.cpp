@@ -0,0 +1,95 @@
+#include <random>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "CompressionCache.hpp"
+#include "CompressionUtils.hpp"
+#include "HTTPUtils.hpp"
+
+namespace
+{
+
+std::string hex(const http::utils::Sha256Digest& digest)
+{
+    static constexpr char kHex[] = "0123456789abcdef";
+    std::string out;
+    for (uint8_t byte : digest)
+    {
+        out.push_back(kHex[byte >> 4]);
+        out.push_back(kHex[byte & 0xF]);
+    }
+    return out;
+}
+
+std::string body(char fill, size_t length = 4000)
+{
+    std::string out;
+    while (out.length() < length)
+        out += std::string("{\"id\":") + fill + ",\"name\":\"item\"},";
+    out.resize(length);
+    return out;
+}
+
+}
+
+TEST(CompressionCacheTest, Sha256Vectors)
+{
+    // FIPS 180-2 examples, the second pads into an extra block
+    EXPECT_EQ(hex(http::utils::sha256("")), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(hex(http::utils::sha256("abc")), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    EXPECT_EQ(hex(http::utils::sha256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")),
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    EXPECT_EQ(hex(http::utils::sha256(std::string(1000000, 'a'))),
+        "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+TEST(CompressionCacheTest, BodiesOfTheSameLengthAreKeptApart)
+{
+    CompressionCache cache;
+    std::string first = body('1'), second = body('2');
+    ASSERT_EQ(first.length(), second.length());
+
+    auto best = [](const std::string& content)
+    {
+        return http::utils::compress(content, ContentEncoding::Gzip, http::utils::CompressionLevel::Best);
+    };
+    EXPECT_EQ(cache.compress(first, ContentEncoding::Gzip), best(first));
+    EXPECT_EQ(cache.compress(second, ContentEncoding::Gzip), best(second));
+    EXPECT_EQ(cache.misses(), 2);
+
+    // A digest known in advance finds the same entry
+    http::utils::Sha256Digest digest = http::utils::sha256(first);
+    EXPECT_EQ(cache.compress(first, ContentEncoding::Gzip, &digest), best(first));
+    EXPECT_EQ(cache.compress(second, ContentEncoding::Gzip), best(second));
+    EXPECT_EQ(cache.hits(), 2);
+
+    // Each encoding is a variant of its own
+    cache.compress(first, ContentEncoding::Deflate);
+    EXPECT_EQ(cache.misses(), 3);
+}
+
+TEST(CompressionCacheTest, EvictsWithinCapacity)
+{
+    // 16 shards of 4KB
+    CompressionCache cache(16 * 4096);
+    std::mt19937 rng(7);
+    for (int i = 0; i < 200; i++)
+    {
+        // Hex digits, so each variant still takes ~1.5KB
+        std::string content(3000, '\0');
+        for (char& c : content)
+            c = "0123456789abcdef"[rng() % 16];
+        cache.compress(content, ContentEncoding::Gzip);
+    }
+    EXPECT_GT(cache.evictions(), 0);
+    EXPECT_LE(cache.bytes(), 16 * 4096);
+
+    // Larger than a shard, compressed every time and never stored
+    std::string large = body('x', 8192);
+    size_t bytes = cache.bytes();
+    cache.compress(large, ContentEncoding::Gzip);
+    cache.compress(large, ContentEncoding::Gzip);
+    EXPECT_EQ(cache.bytes(), bytes);
+    EXPECT_EQ(cache.hits(), 0);
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "HPACK.hpp"
+
+// RFC 7541 Appendix C examples, each a sequence of header blocks on one
+// connection so the dynamic table carries over between them.
+
+namespace
+{
+
+std::vector<uint8_t> fromHex(std::string_view hex)
+{
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i + 1 < hex.length(); i += 2)
+        bytes.push_back(static_cast<uint8_t>(std::stoi(std::string(hex.substr(i, 2)), nullptr, 16)));
+    return bytes;
+}
+
+std::vector<HeaderField> decode(HPACKDecoder& decoder, std::string_view hex)
+{
+    std::vector<uint8_t> block = fromHex(hex);
+    return decoder.decode(block.data(), block.size());
+}
+
+const std::vector<HeaderField> kFirst = {
+    {":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"} };
+const std::vector<HeaderField> kSecond = {
+    {":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"},
+    {"cache-control", "no-cache"} };
+const std::vector<HeaderField> kThird = {
+    {":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"}, {":authority", "www.example.com"},
+    {"custom-key", "custom-value"} };
+
+}
+
+TEST(HPACKTest, RequestsWithoutHuffman)
+{
+    // C.3
+    HPACKDecoder decoder;
+    EXPECT_EQ(decode(decoder, "828684410f7777772e6578616d706c652e636f6d"), kFirst);
+    EXPECT_EQ(decode(decoder, "828684be58086e6f2d6361636865"), kSecond);
+    EXPECT_EQ(decode(decoder, "828785bf400a637573746f6d2d6b65790c637573746f6d2d76616c7565"), kThird);
+}
+
+TEST(HPACKTest, RequestsWithHuffman)
+{
+    // C.4
+    HPACKDecoder decoder;
+    EXPECT_EQ(decode(decoder, "828684418cf1e3c2e5f23a6ba0ab90f4ff"), kFirst);
+    EXPECT_EQ(decode(decoder, "828684be5886a8eb10649cbf"), kSecond);
+    EXPECT_EQ(decode(decoder, "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"), kThird);
+}
+
+TEST(HPACKTest, EncoderRoundTrip)
+{
+    const std::vector<HeaderField> headers = {
+        {":status", "200"}, {"content-type", "text/plain"}, {"content-length", "15"},
+        {"x-request-id", "8f14e45fceea167a5a36dedd4bea2543"} };
+
+    HPACKEncoder encoder;
+    HPACKDecoder decoder;
+    std::string first, second;
+    encoder.encode(headers, first);
+    encoder.encode(headers, second);
+
+    EXPECT_EQ(decoder.decode(reinterpret_cast<const uint8_t*>(first.data()), first.length()), headers);
+    EXPECT_EQ(decoder.decode(reinterpret_cast<const uint8_t*>(second.data()), second.length()), headers);
+    // The repeat is served from the dynamic table
+    EXPECT_LT(second.length(), first.length());
+}
+
+TEST(HPACKTest, TableSizeUpdate)
+{
+    const std::vector<HeaderField> headers = { {"x-custom", "value"} };
+
+    HPACKEncoder encoder;
+    HPACKDecoder decoder;
+    std::string first, second;
+    encoder.encode(headers, first);
+    encoder.setMaxTableSize(0);
+    encoder.encode(headers, second);
+
+    // The update leads the next block and evicts the first block's entry
+    EXPECT_EQ(static_cast<uint8_t>(second[0]), 0x20);
+    EXPECT_EQ(decoder.decode(reinterpret_cast<const uint8_t*>(first.data()), first.length()), headers);
+    EXPECT_EQ(decoder.decode(reinterpret_cast<const uint8_t*>(second.data()), second.length()), headers);
+
+    // Referencing the evicted entry is now an error
+    EXPECT_THROW(decode(decoder, "be"), std::invalid_argument);
+}
+
+TEST(HPACKTest, CompressionErrors)
+{
+    HPACKDecoder decoder;
+    EXPECT_THROW(decode(decoder, "80"), std::invalid_argument);           // index 0
+    EXPECT_THROW(decode(decoder, "ff00"), std::invalid_argument);         // beyond both tables
+    EXPECT_THROW(decode(decoder, "400a6375"), std::invalid_argument);     // truncated literal
+    EXPECT_THROW(decode(decoder, "3fe21f"), std::invalid_argument);       // size update above the limit
+}
\ No newline at end of file
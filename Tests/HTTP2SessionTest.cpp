@@ -0,0 +1,156 @@
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "HPACK.hpp"
+#include "HTTP2Frame.hpp"
+#include "HTTP2Session.hpp"
+#include "Router.hpp"
+
+// In-flight accounting of HTTP/2 streams: every admitted stream hands its
+// slot back once answered or reset.
+
+namespace
+{
+
+class HTTP2SessionTest : public ::testing::Test
+{
+protected:
+    Router m_router;
+    HTTP2Session m_session{m_router};
+    HPACKEncoder m_encoder;
+    HPACKDecoder m_decoder;
+    StatusCode m_admission{StatusCode::Ok};
+    int m_acquired{0};
+    int m_released{0};
+
+    void SetUp() override
+    {
+        m_router.attachReader();
+        m_router.registerHandler("/hello", Method::GET, [](const Request&)
+        {
+            Response res(StatusCode::Ok);
+            res.setContent("Hello, Optiver!");
+            return res;
+        });
+        m_router.registerHandler("/large", Method::GET, [](const Request&)
+        {
+            // Larger than the initial stream window, so it stays queued
+            Response res(StatusCode::Ok);
+            res.setContent(std::string(256 * 1024, 'x'));
+            return res;
+        });
+
+        m_session.setAdmission([this]
+        {
+            if (m_admission == StatusCode::Ok)
+                m_acquired++;
+            return m_admission;
+        },
+        [this](int count)
+        {
+            m_released += count;
+        });
+        m_session.start();
+
+        std::string input = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+        http2::appendFrameHeader(input, 0, FrameType::Settings, 0, 0);
+        ASSERT_TRUE(m_session.receive(input.data(), input.length()));
+    }
+
+    void TearDown() override
+    {
+        m_router.detachReader();
+    }
+
+    void request(uint32_t streamId, const std::string& path)
+    {
+        std::string block;
+        m_encoder.encode({ { ":method", "GET" }, { ":scheme", "http" },
+            { ":path", path }, { ":authority", "test" } }, block);
+
+        std::string input;
+        http2::appendFrameHeader(input, block.length(), FrameType::Headers,
+            FrameFlag::EndStream | FrameFlag::EndHeaders, streamId);
+        input += block;
+        ASSERT_TRUE(m_session.receive(input.data(), input.length()));
+    }
+
+    void reset(uint32_t streamId)
+    {
+        std::string input;
+        http2::appendFrameHeader(input, 4, FrameType::RstStream, 0, streamId);
+        http2::appendUint32(input, static_cast<uint32_t>(HTTP2Error::Cancel));
+        ASSERT_TRUE(m_session.receive(input.data(), input.length()));
+    }
+
+    // :status of each stream answered in the pending output, which is consumed
+    std::map<uint32_t, std::string> statuses()
+    {
+        std::map<uint32_t, std::string> result;
+        std::string output(m_session.pendingData(), m_session.pendingSize());
+        m_session.consume(output.length());
+
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(output.data());
+        for (size_t offset = 0; offset + k_http2FrameHeaderSize <= output.length(); )
+        {
+            FrameHeader header = http2::parseFrameHeader(data + offset);
+            offset += k_http2FrameHeaderSize;
+            if (header.type == FrameType::Headers)
+            {
+                for (const HeaderField& field : m_decoder.decode(data + offset, header.length))
+                {
+                    if (field.first == ":status")
+                        result[header.streamId] = field.second;
+                }
+            }
+            offset += header.length;
+        }
+        return result;
+    }
+};
+
+}
+
+TEST_F(HTTP2SessionTest, AnsweredStreamsReleaseTheirSlots)
+{
+    request(1, "/hello");
+    request(3, "/hello");
+
+    std::map<uint32_t, std::string> answered = statuses();
+    EXPECT_EQ(answered[1], "200");
+    EXPECT_EQ(answered[3], "200");
+    EXPECT_EQ(m_acquired, 2);
+    EXPECT_EQ(m_released, 2);
+    EXPECT_EQ(m_session.admittedStreams(), 0);
+}
+
+TEST_F(HTTP2SessionTest, RefusedStreamsGetTheAdmissionStatus)
+{
+    m_admission = StatusCode::ServiceUnvailable;
+    request(1, "/hello");
+    m_admission = StatusCode::TooManyRequests;
+    request(3, "/hello");
+
+    std::map<uint32_t, std::string> answered = statuses();
+    EXPECT_EQ(answered[1], "503");
+    EXPECT_EQ(answered[3], "429");
+    EXPECT_EQ(m_acquired, 0);
+    EXPECT_EQ(m_released, 0);
+}
+
+TEST_F(HTTP2SessionTest, SlotIsHeldUntilTheLastDataFrameOrReset)
+{
+    request(1, "/large");
+    request(3, "/large");
+    EXPECT_EQ(statuses()[1], "200");
+    EXPECT_EQ(m_acquired, 2);
+    EXPECT_EQ(m_released, 0);
+    EXPECT_EQ(m_session.admittedStreams(), 2);
+
+    reset(1);
+    EXPECT_EQ(m_released, 1);
+    EXPECT_EQ(m_session.admittedStreams(), 1);
+}
\ No newline at end of file
@@ -0,0 +1,460 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+
+#include "HTTPUtils.hpp"
+#include "Server.hpp"
+#include "ServerBuilder.hpp"
+#include "TestClient.hpp"
+
+// The reverse proxy against a stub upstream on a loopback TCP port
+
+namespace
+{
+
+// A blocking HTTP/1.1 upstream, a thread per connection. Each response body
+// is the request exactly as it arrived, to check what the proxy forwarded.
+// Request heads are also recorded as soon as they arrive, before the body.
+// Paths ending in /upgrade are answered with a 101. After a path ending in
+// /arm, the next request on that connection is read and the connection is
+// dropped unanswered, as by an upstream that timed out an idle connection.
+// Paths ending in /stall are never answered.
+class StubUpstream
+{
+private:
+    int m_listenFd;
+    uint16_t m_port;
+    std::atomic<bool> m_running{true};
+    std::thread m_acceptThread;
+
+    std::mutex m_mutex;
+    std::vector<std::thread> m_threads;
+    std::vector<int> m_fds;
+    std::vector<std::string> m_requests;
+    std::vector<std::string> m_heads;
+    int m_connections{0};
+
+    void serve(int fd)
+    {
+        std::string buffer;
+        bool armed = false;
+        bool headSeen = false;
+        char chunk[16 * 1024];
+        for (ssize_t n; (n = recv(fd, chunk, sizeof(chunk), 0)) > 0; )
+        {
+            buffer.append(chunk, n);
+
+            StatusCode error = StatusCode::Ok;
+            size_t length, bodyLength;
+            if (!headSeen && (length = http::utils::requestHeadLength(buffer.data(), buffer.length(), bodyLength, error)) > 0)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_heads.push_back(buffer.substr(0, length));
+                headSeen = true;
+            }
+            while ((length = http::utils::requestLength(buffer.data(), buffer.length(), error)) > 0)
+            {
+                std::string request = buffer.substr(0, length);
+                buffer.erase(0, length);
+                headSeen = false;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_requests.push_back(request);
+                }
+
+                std::string_view path = std::string_view(request).substr(0, request.find(" HTTP/"));
+                if (armed)
+                {
+                    shutdown(fd, SHUT_RDWR);
+                    return;
+                }
+                if (path.ends_with("/upgrade"))
+                {
+                    std::string upgrade = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: test\r\nConnection: Upgrade\r\n\r\n";
+                    ::send(fd, upgrade.data(), upgrade.length(), MSG_NOSIGNAL);
+                    shutdown(fd, SHUT_RDWR);
+                    return;
+                }
+                armed = path.ends_with("/arm");
+                if (path.ends_with("/stall"))
+                    continue;
+
+                std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: "
+                    + std::to_string(request.length()) + "\r\n\r\n" + request;
+                ::send(fd, response.data(), response.length(), MSG_NOSIGNAL);
+            }
+            if (error != StatusCode::Ok)
+                break;
+        }
+        shutdown(fd, SHUT_RDWR);
+    }
+
+public:
+    StubUpstream()
+    {
+        m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addrLen = sizeof(addr);
+        if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), addrLen) < 0 || listen(m_listenFd, 16) < 0
+            || getsockname(m_listenFd, reinterpret_cast<sockaddr*>(&addr), &addrLen) < 0)
+            throw std::runtime_error("Failed to listen for the stub upstream");
+        m_port = ntohs(addr.sin_port);
+
+        m_acceptThread = std::thread([this]()
+        {
+            int fd;
+            while ((fd = accept(m_listenFd, nullptr, nullptr)) >= 0 && m_running)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_connections++;
+                m_fds.push_back(fd);
+                m_threads.emplace_back(&StubUpstream::serve, this, fd);
+            }
+            if (fd >= 0)
+                close(fd);
+        });
+    }
+
+    ~StubUpstream()
+    {
+        m_running = false;
+        shutdown(m_listenFd, SHUT_RDWR);
+        m_acceptThread.join();
+        close(m_listenFd);
+
+        // Unblock the connections the proxy still keeps in its pool
+        for (int fd : m_fds)
+            shutdown(fd, SHUT_RDWR);
+        for (std::thread& thread : m_threads)
+            thread.join();
+        for (int fd : m_fds)
+            close(fd);
+    }
+
+    uint16_t port() const { return m_port; }
+
+    int connections()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_connections;
+    }
+
+    // How many requests arrived whose request line starts with prefix
+    int received(std::string_view prefix)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return static_cast<int>(std::count_if(m_requests.begin(), m_requests.end(),
+            [prefix](const std::string& request) { return request.starts_with(prefix); }));
+    }
+
+    // Whether a request head starting with prefix arrived, within five seconds
+    bool waitForHead(std::string_view prefix)
+    {
+        for (int i = 0; i < 500; i++)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (std::any_of(m_heads.begin(), m_heads.end(),
+                    [prefix](const std::string& head) { return head.starts_with(prefix); }))
+                    return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+};
+
+std::string lowercase(std::string string)
+{
+    std::transform(string.begin(), string.end(), string.begin(), [](unsigned char c) { return std::tolower(c); });
+    return string;
+}
+
+// A listening socket that never accepts: once its queue is full, connection
+// attempts hang
+class Blackhole
+{
+private:
+    int m_listenFd;
+    std::vector<int> m_fillers;
+    uint16_t m_port;
+
+public:
+    Blackhole()
+    {
+        m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addrLen = sizeof(addr);
+        if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), addrLen) < 0 || listen(m_listenFd, 0) < 0
+            || getsockname(m_listenFd, reinterpret_cast<sockaddr*>(&addr), &addrLen) < 0)
+            throw std::runtime_error("Failed to listen for the blackhole");
+        m_port = ntohs(addr.sin_port);
+
+        // Fill the accept queue, non-blocking so a full queue doesn't hang the test
+        for (int i = 0; i < 4; i++)
+        {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            connect(fd, reinterpret_cast<sockaddr*>(&addr), addrLen);
+            m_fillers.push_back(fd);
+        }
+    }
+
+    ~Blackhole()
+    {
+        for (int fd : m_fillers)
+            close(fd);
+        close(m_listenFd);
+    }
+
+    uint16_t port() const { return m_port; }
+};
+
+class ProxyTest : public ::testing::Test
+{
+protected:
+    static std::unique_ptr<StubUpstream> s_upstream;
+    static std::unique_ptr<Blackhole> s_blackhole;
+    static std::unique_ptr<HTTPServer> s_server;
+
+    static void SetUpTestSuite()
+    {
+        spdlog::set_level(spdlog::level::err);
+
+        s_upstream = std::make_unique<StubUpstream>();
+        s_blackhole = std::make_unique<Blackhole>();
+        s_server = ServerBuilder()
+            .listen("127.0.0.1:0")
+            .workers(1)
+            .set("proxy", "/api=127.0.0.1:" + std::to_string(s_upstream->port()))
+            .set("proxy", "/void=127.0.0.1:" + std::to_string(s_blackhole->port()))
+            .set("proxy-connect-timeout", "300")
+            .set("proxy-timeout", "500")
+            .set("max-in-flight", "2")
+            .route("/hello", Method::GET, [](const Request&)
+            {
+                Response res(StatusCode::Ok);
+                res.setContent("Hello, Optiver!");
+                return res;
+            })
+            .build();
+        s_server->start();
+    }
+
+    static void TearDownTestSuite()
+    {
+        s_server->stop();
+        s_server.reset();
+        s_upstream.reset();
+        s_blackhole.reset();
+    }
+
+    // The request as the upstream saw it, or the local response body
+    static HttpResponse exchange(TestClient& client, const std::string& request)
+    {
+        HttpResponse response;
+        client.send(request);
+        EXPECT_TRUE(client.read(response));
+        return response;
+    }
+};
+
+// Empty if the body is not a complete gzip stream
+std::string gunzip(const std::string& body)
+{
+    z_stream stream{};
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+        return {};
+
+    std::string result;
+    char chunk[16 * 1024];
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+    stream.avail_in = body.length();
+    int status;
+    do
+    {
+        stream.next_out = reinterpret_cast<Bytef*>(chunk);
+        stream.avail_out = sizeof(chunk);
+        status = inflate(&stream, Z_NO_FLUSH);
+        result.append(chunk, sizeof(chunk) - stream.avail_out);
+    } while (status == Z_OK);
+    inflateEnd(&stream);
+    return status == Z_STREAM_END ? result : std::string();
+}
+
+std::unique_ptr<StubUpstream> ProxyTest::s_upstream;
+std::unique_ptr<Blackhole> ProxyTest::s_blackhole;
+std::unique_ptr<HTTPServer> ProxyTest::s_server;
+
+}
+
+TEST_F(ProxyTest, PrefixesMatchWholeNormalizedSegments)
+{
+    TestClient client(s_server->openLoopback());
+    const std::pair<std::string, std::string> forwarded[] = {
+        { "/api", "GET /api HTTP/1.1\r\n" },
+        { "/api/x?q=1", "GET /api/x?q=1 HTTP/1.1\r\n" },
+        { "/api/a/../b?q=1", "GET /api/b?q=1 HTTP/1.1\r\n" },
+        { "/%61pi/./x", "GET /api/x HTTP/1.1\r\n" },
+    };
+    for (const auto& [target, requestLine] : forwarded)
+    {
+        HttpResponse response = exchange(client, "GET " + target + " HTTP/1.1\r\nHost: test\r\n\r\n");
+        EXPECT_EQ(response.status, 200) << target;
+        EXPECT_TRUE(response.body.starts_with(requestLine)) << target << " was forwarded as " << response.body;
+    }
+
+    // Not under the prefix once normalized, so left to the local routes
+    // (which match the raw path)
+    EXPECT_EQ(exchange(client, "GET /apiary HTTP/1.1\r\nHost: test\r\n\r\n").status, 404);
+    EXPECT_EQ(exchange(client, "GET /api/../hello HTTP/1.1\r\nHost: test\r\n\r\n").status, 404);
+    EXPECT_EQ(exchange(client, "GET /api/%2E%2E/hello HTTP/1.1\r\nHost: test\r\n\r\n").status, 404);
+    EXPECT_EQ(s_upstream->received("GET /apiary "), 0);
+    EXPECT_EQ(s_upstream->received("GET /hello "), 0);
+}
+
+TEST_F(ProxyTest, AbsoluteFormTargets)
+{
+    TestClient client(s_server->openLoopback());
+    HttpResponse response = exchange(client, "GET http://up.example:81/api/x?y=2 HTTP/1.1\r\nHost: ignored\r\n\r\n");
+    EXPECT_EQ(response.status, 200);
+    EXPECT_TRUE(response.body.starts_with("GET /api/x?y=2 HTTP/1.1\r\n")) << response.body;
+    EXPECT_NE(response.body.find("\r\nHost: up.example:81\r\n"), std::string::npos) << response.body;
+    EXPECT_EQ(response.body.find("ignored"), std::string::npos) << response.body;
+}
+
+TEST_F(ProxyTest, HopByHopHeadersAreStripped)
+{
+    TestClient client(s_server->openLoopback());
+    HttpResponse response = exchange(client,
+        "POST /api/headers HTTP/1.1\r\n"
+        "Host: test\r\n"
+        "Connection: keep-alive, X-Secret\r\n"
+        "X-Secret: 1\r\n"
+        "Keep-Alive: timeout=5\r\n"
+        "TE: trailers\r\n"
+        "Upgrade: websocket\r\n"
+        "Proxy-Authorization: Basic Zm9vOmJhcg==\r\n"
+        "X-Kept: yes\r\n"
+        "Content-Length: 4\r\n"
+        "\r\n"
+        "body");
+    EXPECT_EQ(response.status, 200);
+
+    std::string forwarded = lowercase(response.body);
+    for (std::string_view name : { "\r\nconnection: keep-alive, x", "\r\nx-secret:", "\r\nkeep-alive:", "\r\nte:",
+        "\r\nupgrade:", "\r\nproxy-authorization:" })
+        EXPECT_EQ(forwarded.find(name), std::string::npos) << name;
+    EXPECT_NE(forwarded.find("\r\nx-kept: yes\r\n"), std::string::npos);
+    EXPECT_TRUE(forwarded.ends_with("\r\n\r\nbody"));
+}
+
+TEST_F(ProxyTest, UpgradeResponsesAreRefused)
+{
+    TestClient client(s_server->openLoopback());
+    EXPECT_EQ(exchange(client, "GET /api/upgrade HTTP/1.1\r\nHost: test\r\n\r\n").status, 502);
+
+    // The client connection is still usable
+    EXPECT_EQ(exchange(client, "GET /api/next HTTP/1.1\r\nHost: test\r\n\r\n").status, 200);
+}
+
+TEST_F(ProxyTest, OnlySafeMethodsAreRetried)
+{
+    // One client, so one worker and its pool of idle upstream connections
+    TestClient client(s_server->openLoopback());
+
+    // The pooled connection is dropped after reading the GET, which is
+    // resent on a new connection
+    ASSERT_EQ(exchange(client, "GET /api/arm HTTP/1.1\r\nHost: test\r\n\r\n").status, 200);
+    int connections = s_upstream->connections();
+    HttpResponse retried = exchange(client, "GET /api/retried HTTP/1.1\r\nHost: test\r\n\r\n");
+    EXPECT_EQ(retried.status, 200);
+    EXPECT_TRUE(retried.body.starts_with("GET /api/retried HTTP/1.1\r\n"));
+    EXPECT_EQ(s_upstream->received("GET /api/retried "), 2);
+    EXPECT_EQ(s_upstream->connections(), connections + 1);
+
+    // The upstream may have acted on a POST before dropping the connection
+    ASSERT_EQ(exchange(client, "GET /api/arm HTTP/1.1\r\nHost: test\r\n\r\n").status, 200);
+    HttpResponse failed = exchange(client, "POST /api/order HTTP/1.1\r\nHost: test\r\nContent-Length: 2\r\n\r\n{}");
+    EXPECT_EQ(failed.status, 502);
+    EXPECT_EQ(s_upstream->received("POST /api/order "), 1);
+}
+
+TEST_F(ProxyTest, RequestBodiesAreStreamed)
+{
+    // Twice max-request-size, which only bounds requests served locally
+    std::string body;
+    for (int i = 0; body.length() < 2 * 1024 * 1024; i++)
+        body += "chunk " + std::to_string(i) + "\n";
+
+    TestClient client(s_server->openLoopback());
+    client.send("POST /api/upload HTTP/1.1\r\nHost: test\r\nContent-Length: " + std::to_string(body.length())
+        + "\r\n\r\n" + body.substr(0, 64 * 1024));
+
+    // The head is forwarded before the body is complete
+    ASSERT_TRUE(s_upstream->waitForHead("POST /api/upload "));
+    client.send(body.substr(64 * 1024));
+
+    HttpResponse response;
+    ASSERT_TRUE(client.read(response));
+    EXPECT_EQ(response.status, 200);
+    EXPECT_TRUE(response.body.starts_with("POST /api/upload HTTP/1.1\r\n"));
+    EXPECT_TRUE(response.body.ends_with("\r\n\r\n" + body));
+
+    // The next request starts right after the body
+    EXPECT_EQ(exchange(client, "GET /api/next HTTP/1.1\r\nHost: test\r\n\r\n").status, 200);
+}
+
+TEST_F(ProxyTest, SilentUpstreamsTimeOut)
+{
+    TestClient client(s_server->openLoopback());
+
+    // More timeouts than in-flight slots: each one must give its slot back
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECT_EQ(exchange(client, "GET /api/stall HTTP/1.1\r\nHost: test\r\n\r\n").status, 504);
+        EXPECT_EQ(exchange(client, "GET /void HTTP/1.1\r\nHost: test\r\n\r\n").status, 504);
+    }
+    EXPECT_EQ(exchange(client, "GET /api/next HTTP/1.1\r\nHost: test\r\n\r\n").status, 200);
+    EXPECT_EQ(exchange(client, "GET /hello HTTP/1.1\r\nHost: test\r\n\r\n").status, 200);
+}
+
+TEST_F(ProxyTest, ResponsesAreCompressedAsTheyArrive)
+{
+    // Echoed back as a text/plain body the upstream did not compress
+    std::string request = "GET /api/text HTTP/1.1\r\nHost: test\r\nAccept-Encoding: gzip\r\nX-Padding: "
+        + std::string(4096, 'x') + "\r\n\r\n";
+
+    TestClient client(s_server->openLoopback());
+    HttpResponse response = exchange(client, request);
+    EXPECT_EQ(response.status, 200);
+    EXPECT_EQ(response.header("Content-Encoding"), "gzip");
+    EXPECT_EQ(response.header("Transfer-Encoding"), "chunked");
+    EXPECT_EQ(response.header("Vary"), "Accept-Encoding");
+    EXPECT_TRUE(response.header("Content-Length").empty());
+    EXPECT_LT(response.body.length(), 1024u);
+    EXPECT_TRUE(gunzip(response.body).starts_with("GET /api/text HTTP/1.1\r\n"));
+
+    // Too small to be worth it, and HTTP/1.0 clients cannot take chunked
+    HttpResponse small = exchange(client, "GET /api/small HTTP/1.1\r\nHost: test\r\nAccept-Encoding: gzip\r\n\r\n");
+    EXPECT_TRUE(small.header("Content-Encoding").empty());
+    HttpResponse old = exchange(client, "GET /api/old HTTP/1.0\r\nHost: test\r\nConnection: keep-alive\r\n"
+        "Accept-Encoding: gzip\r\nX-Padding: " + std::string(4096, 'x') + "\r\n\r\n");
+    EXPECT_TRUE(old.header("Content-Encoding").empty());
+    EXPECT_TRUE(old.body.starts_with("GET /api/old HTTP/1.0\r\n"));
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "HTTPUtils.hpp"
+
+using http::utils::ByteRange;
+
+namespace
+{
+
+std::vector<std::pair<size_t, size_t>> resolve(std::string_view header, size_t length, bool& valid)
+{
+    std::vector<ByteRange> ranges;
+    valid = http::utils::parseRange(header, length, ranges);
+    std::vector<std::pair<size_t, size_t>> out;
+    for (const ByteRange& range : ranges)
+        out.emplace_back(range.first, range.last);
+    return out;
+}
+
+using Ranges = std::vector<std::pair<size_t, size_t>>;
+
+}
+
+TEST(RangeTest, SatisfiableRanges)
+{
+    bool valid;
+    EXPECT_EQ(resolve("bytes=0-499", 10000, valid), Ranges({ {0, 499} }));
+    EXPECT_TRUE(valid);
+    EXPECT_EQ(resolve("bytes=9500-", 10000, valid), Ranges({ {9500, 9999} }));
+    EXPECT_EQ(resolve("bytes=-500", 10000, valid), Ranges({ {9500, 9999} }));
+    EXPECT_EQ(resolve("bytes=-20000", 10000, valid), Ranges({ {0, 9999} }));
+    EXPECT_EQ(resolve("bytes=9000-20000", 10000, valid), Ranges({ {9000, 9999} }));
+    EXPECT_EQ(resolve(" Bytes=0-0 , -1", 10000, valid), Ranges({ {0, 0}, {9999, 9999} }));
+    EXPECT_TRUE(valid);
+}
+
+TEST(RangeTest, UnsatisfiableRangesAreDropped)
+{
+    // Valid, but nothing left: a 416
+    bool valid;
+    EXPECT_EQ(resolve("bytes=10000-", 10000, valid), Ranges());
+    EXPECT_TRUE(valid);
+    EXPECT_EQ(resolve("bytes=-0", 10000, valid), Ranges());
+    EXPECT_TRUE(valid);
+    EXPECT_EQ(resolve("bytes=20000-30000, 0-9", 10000, valid), Ranges({ {0, 9} }));
+    EXPECT_TRUE(valid);
+}
+
+TEST(RangeTest, MalformedRangesAreIgnored)
+{
+    bool valid;
+    for (std::string_view header : { "bytes=", "items=0-9", "bytes=9-0", "bytes=a-b", "bytes=0-9x", "bytes=5" })
+    {
+        resolve(header, 10000, valid);
+        EXPECT_FALSE(valid) << header;
+    }
+
+    // More than 16 ranges is not worth serving
+    std::string many = "bytes=0-0";
+    for (int i = 1; i <= 16; i++)
+        many += "," + std::to_string(i * 2) + "-" + std::to_string(i * 2);
+    resolve(many, 10000, valid);
+    EXPECT_FALSE(valid);
+}
+
+TEST(RangeTest, EntityTags)
+{
+    std::string etag = http::utils::makeETag("hello");
+    EXPECT_EQ(etag, http::utils::makeETag("hello"));
+    EXPECT_NE(etag, http::utils::makeETag("hellp"));
+    EXPECT_TRUE(etag.starts_with("\"5-"));
+
+    // If-None-Match compares weakly
+    EXPECT_TRUE(http::utils::matchesETag(etag, etag, false));
+    EXPECT_TRUE(http::utils::matchesETag("W/" + etag, etag, false));
+    EXPECT_TRUE(http::utils::matchesETag("\"other\", " + etag, etag, false));
+    EXPECT_TRUE(http::utils::matchesETag(" * ", etag, false));
+    EXPECT_FALSE(http::utils::matchesETag("\"other\"", etag, false));
+
+    // If-Range needs a strong match
+    EXPECT_TRUE(http::utils::matchesETag(etag, etag, true));
+    EXPECT_FALSE(http::utils::matchesETag("W/" + etag, etag, true));
+    EXPECT_FALSE(http::utils::matchesETag("W/" + etag, "W/" + etag, true));
+}
+
+TEST(RangeTest, HttpDates)
+{
+    EXPECT_EQ(http::utils::formatHttpDate(784111777), "Sun, 06 Nov 1994 08:49:37 GMT");
+    EXPECT_EQ(http::utils::parseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT"), 784111777);
+    EXPECT_EQ(http::utils::parseHttpDate(" Sun, 06 Nov 1994 08:49:37 GMT "), 784111777);
+    EXPECT_EQ(http::utils::parseHttpDate("Sunday, 06-Nov-94 08:49:37 GMT"), -1);
+    EXPECT_EQ(http::utils::parseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT trailing"), -1);
+    EXPECT_EQ(http::utils::parseHttpDate(""), -1);
+}
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <spdlog/spdlog.h>
+
+#include "Server.hpp"
+#include "ServerBuilder.hpp"
+#include "TestClient.hpp"
+
+// End to end: a small corpus of requests replayed against an in-process
+// server over openLoopback() connections, checking each status and body.
+
+namespace
+{
+
+struct Case
+{
+    std::string request;
+    int status;
+    std::string body;
+};
+
+std::string staticBody()
+{
+    std::string body;
+    for (int i = 0; body.length() < 4096; i++)
+        body += "line " + std::to_string(i) + " of a static text body\n";
+    return body;
+}
+
+const std::vector<Case>& corpus()
+{
+    static const std::vector<Case> cases = {
+        { "GET /hello HTTP/1.1\r\nHost: test\r\n\r\n", 200, "Hello, Optiver!" },
+        { "HEAD /static HTTP/1.1\r\nHost: test\r\n\r\n", 200, "" },
+        { "POST /echo HTTP/1.1\r\nHost: test\r\nContent-Length: 5\r\n\r\nabcde", 200, "abcde" },
+        { "GET /greet?name=a%20b+c HTTP/1.1\r\nHost: test\r\n\r\n", 200, "Hello, a b c!" },
+        { "GET http://test/hello HTTP/1.1\r\n\r\n", 200, "Hello, Optiver!" },
+        { "GET /missing HTTP/1.1\r\nHost: test\r\n\r\n", 404, "" },
+        { "DELETE /hello HTTP/1.1\r\nHost: test\r\n\r\n", 405, "" },
+        { "GET /static HTTP/1.1\r\nHost: test\r\n\r\n", 200, staticBody() },
+        { "GET /static HTTP/1.1\r\nHost: test\r\nRange: bytes=0-9\r\n\r\n", 206, staticBody().substr(0, 10) },
+        { "GET /static HTTP/1.1\r\nHost: test\r\nRange: bytes=-5\r\n\r\n", 206, staticBody().substr(staticBody().length() - 5) },
+        { "GET /static HTTP/1.1\r\nHost: test\r\nRange: bytes=99999-\r\n\r\n", 416, "" },
+    };
+    return cases;
+}
+
+class ReplayTest : public ::testing::Test
+{
+protected:
+    static std::unique_ptr<HTTPServer> s_server;
+
+    static void SetUpTestSuite()
+    {
+        spdlog::set_level(spdlog::level::warn);
+
+        Response content(StatusCode::Ok);
+        content.setHeader("Content-Type", "text/plain");
+        content.setContent(staticBody());
+
+        s_server = ServerBuilder()
+            .listen("127.0.0.1:0")
+            .workers(2)
+            .route("/hello", Method::GET, [](const Request&)
+            {
+                Response res(StatusCode::Ok);
+                res.setContent("Hello, Optiver!");
+                return res;
+            })
+            .route("/echo", Method::POST, [](const Request& req)
+            {
+                Response res(StatusCode::Ok);
+                res.setContent(req.content());
+                return res;
+            })
+            .route("/greet", Method::GET, [](const Request& req)
+            {
+                Response res(StatusCode::Ok);
+                res.setContent("Hello, " + req.queryParam("name") + "!");
+                return res;
+            })
+            .staticResponse("/static", content)
+            .build();
+        s_server->start();
+    }
+
+    static void TearDownTestSuite()
+    {
+        s_server->stop();
+        s_server.reset();
+    }
+
+    static void expectCase(const Case& expected, const HttpResponse& response)
+    {
+        SCOPED_TRACE(expected.request.substr(0, expected.request.find("\r\n")));
+        EXPECT_EQ(response.status, expected.status);
+        EXPECT_EQ(response.body, expected.body);
+    }
+};
+
+std::unique_ptr<HTTPServer> ReplayTest::s_server;
+
+}
+
+TEST_F(ReplayTest, EachRequestInTurn)
+{
+    TestClient client(s_server->openLoopback());
+    for (const Case& expected : corpus())
+    {
+        client.send(expected.request);
+        HttpResponse response;
+        ASSERT_TRUE(client.read(response, expected.request.starts_with("HEAD ")));
+        expectCase(expected, response);
+    }
+}
+
+TEST_F(ReplayTest, PipelinedInOneWrite)
+{
+    TestClient client(s_server->openLoopback());
+    std::string batch;
+    for (const Case& expected : corpus())
+        batch += expected.request;
+    client.send(batch);
+
+    for (const Case& expected : corpus())
+    {
+        HttpResponse response;
+        ASSERT_TRUE(client.read(response, expected.request.starts_with("HEAD ")));
+        expectCase(expected, response);
+    }
+}
+
+TEST_F(ReplayTest, ConcurrentConnectionsAcrossWorkers)
+{
+    constexpr int kConnections = 8;
+    constexpr int kRounds = 50;
+
+    std::vector<int> failures(kConnections, 0);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < kConnections; c++)
+    {
+        threads.emplace_back([c, &failures]()
+        {
+            TestClient client(s_server->openLoopback());
+            for (int round = 0; round < kRounds; round++)
+            {
+                for (const Case& expected : corpus())
+                    client.send(expected.request);
+                for (const Case& expected : corpus())
+                {
+                    HttpResponse response;
+                    if (!client.read(response, expected.request.starts_with("HEAD "))
+                        || response.status != expected.status || response.body != expected.body)
+                        failures[c]++;
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    for (int c = 0; c < kConnections; c++)
+        EXPECT_EQ(failures[c], 0) << "connection " << c;
+}
+
+TEST_F(ReplayTest, ConditionalAndCompressedStatic)
+{
+    TestClient client(s_server->openLoopback());
+    HttpResponse full;
+    client.send("GET /static HTTP/1.1\r\nHost: test\r\n\r\n");
+    ASSERT_TRUE(client.read(full));
+    std::string etag = full.header("ETag");
+    ASSERT_FALSE(etag.empty());
+    EXPECT_FALSE(full.header("Last-Modified").empty());
+
+    HttpResponse notModified;
+    client.send("GET /static HTTP/1.1\r\nHost: test\r\nIf-None-Match: " + etag + "\r\n\r\n");
+    ASSERT_TRUE(client.read(notModified));
+    EXPECT_EQ(notModified.status, 304);
+    EXPECT_EQ(notModified.header("ETag"), etag);
+
+    HttpResponse staleRange;
+    client.send("GET /static HTTP/1.1\r\nHost: test\r\nRange: bytes=0-9\r\nIf-Range: \"other\"\r\n\r\n");
+    ASSERT_TRUE(client.read(staleRange));
+    EXPECT_EQ(staleRange.status, 200);
+    EXPECT_EQ(staleRange.body, full.body);
+
+    // Twice, the second is served from the compression cache
+    for (int i = 0; i < 2; i++)
+    {
+        HttpResponse gzip;
+        client.send("GET /static HTTP/1.1\r\nHost: test\r\nAccept-Encoding: gzip\r\n\r\n");
+        ASSERT_TRUE(client.read(gzip));
+        EXPECT_EQ(gzip.status, 200);
+        EXPECT_EQ(gzip.header("Content-Encoding"), "gzip");
+        EXPECT_EQ(gzip.header("Vary"), "Accept-Encoding");
+        EXPECT_EQ(gzip.header("ETag"), "W/" + etag);
+        EXPECT_LT(gzip.body.length(), full.body.length());
+    }
+}
+
+TEST_F(ReplayTest, AmbiguousFramingClosesTheConnection)
+{
+    const std::pair<std::string, int> requests[] = {
+        { "POST /echo HTTP/1.1\r\nHost: test\r\nContent-Length: 1x\r\n\r\nA", 400 },
+        { "POST /echo HTTP/1.1\r\nHost: test\r\nContent-Length: 18446744073709551617\r\n\r\n", 400 },
+        { "POST /echo HTTP/1.1\r\nHost: test\r\nContent-Length: 3\r\nContent-Length: 4\r\n\r\nabcd", 400 },
+        { "POST /echo HTTP/1.1\r\nHost: test\r\nContent-Length : 3\r\n\r\nabc", 400 },
+        { "POST /echo HTTP/1.1\r\nHost: test\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n", 501 },
+    };
+    for (const auto& [request, status] : requests)
+    {
+        SCOPED_TRACE(request);
+        TestClient client(s_server->openLoopback());
+
+        // The earlier request is still answered, the hidden one never is
+        client.send("GET /hello HTTP/1.1\r\nHost: test\r\n\r\n" + request + "GET /hello HTTP/1.1\r\nHost: test\r\n\r\n");
+        HttpResponse hello, error;
+        ASSERT_TRUE(client.read(hello));
+        EXPECT_EQ(hello.status, 200);
+        ASSERT_TRUE(client.read(error));
+        EXPECT_EQ(error.status, status);
+        EXPECT_EQ(error.header("Connection"), "close");
+        EXPECT_TRUE(client.closed());
+    }
+}
+
+TEST_F(ReplayTest, PipelinedResponsesPrecedeTheH2cUpgrade)
+{
+    TestClient client(s_server->openLoopback());
+    client.send("GET /hello HTTP/1.1\r\nHost: test\r\n\r\n"
+        "GET /hello HTTP/1.1\r\nHost: test\r\nConnection: Upgrade, HTTP2-Settings\r\n"
+        "Upgrade: h2c\r\nHTTP2-Settings: AAMAAABkAARAAAAAAAIAAAAA\r\n\r\n");
+
+    HttpResponse hello, upgrade;
+    ASSERT_TRUE(client.read(hello));
+    EXPECT_EQ(hello.status, 200);
+    EXPECT_EQ(hello.body, "Hello, Optiver!");
+    ASSERT_TRUE(client.read(upgrade, true));
+    EXPECT_EQ(upgrade.status, 101);
+    EXPECT_EQ(upgrade.header("Upgrade"), "h2c");
+}
\ No newline at end of file
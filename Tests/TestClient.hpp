@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+// Test side of an HTTP/1.1 connection, such as one from openLoopback()
+
+struct HeaderLess
+{
+    bool operator()(const std::string& a, const std::string& b) const { return strcasecmp(a.c_str(), b.c_str()) < 0; }
+};
+
+struct HttpResponse
+{
+    int status{0};
+    std::map<std::string, std::string, HeaderLess> headers;
+    std::string body;
+
+    std::string header(const std::string& name) const
+    {
+        auto it = headers.find(name);
+        return it == headers.end() ? std::string() : it->second;
+    }
+};
+
+// A client end of a loopback connection, reading responses in order
+class TestClient
+{
+private:
+    int m_fd;
+    std::string m_buffer;
+
+    bool fill()
+    {
+        char chunk[16 * 1024];
+        ssize_t n = recv(m_fd, chunk, sizeof(chunk), 0);
+        if (n <= 0)
+            return false;
+        m_buffer.append(chunk, n);
+        return true;
+    }
+
+public:
+    explicit TestClient(int fd) : m_fd(fd)
+    {
+        // A missing response fails the test instead of hanging it
+        timeval timeout{5, 0};
+        setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+    ~TestClient() { close(m_fd); }
+
+    void send(const std::string& request)
+    {
+        for (size_t written = 0; written < request.length(); )
+        {
+            ssize_t n = ::send(m_fd, request.data() + written, request.length() - written, 0);
+            ASSERT_GT(n, 0) << strerror(errno);
+            written += n;
+        }
+    }
+
+    // False if the connection closed or timed out first
+    bool read(HttpResponse& response, bool head = false)
+    {
+        size_t headerEnd;
+        while ((headerEnd = m_buffer.find("\r\n\r\n")) == std::string::npos)
+        {
+            if (!fill())
+                return false;
+        }
+
+        response = HttpResponse();
+        std::string_view headers(m_buffer.data(), headerEnd);
+        response.status = std::stoi(std::string(headers.substr(9, 3)));
+        for (size_t lpos = headers.find("\r\n"); lpos != std::string_view::npos; )
+        {
+            lpos += 2;
+            size_t rpos = headers.find("\r\n", lpos);
+            std::string_view line = headers.substr(lpos, rpos == std::string_view::npos ? rpos : rpos - lpos);
+            size_t colon = line.find(':');
+            response.headers[std::string(line.substr(0, colon))] = std::string(line.substr(colon + 2));
+            lpos = rpos;
+        }
+
+        if (!head && strcasecmp(response.header("Transfer-Encoding").c_str(), "chunked") == 0)
+            return readChunks(response, headerEnd + 4);
+
+        size_t length = 0;
+        if (!head && response.status != 304)
+            length = std::stoul(response.header("Content-Length"));
+        while (m_buffer.length() < headerEnd + 4 + length)
+        {
+            if (!fill())
+                return false;
+        }
+        response.body = m_buffer.substr(headerEnd + 4, length);
+        m_buffer.erase(0, headerEnd + 4 + length);
+        return true;
+    }
+
+    // The chunks joined into the body, trailers are not expected
+    bool readChunks(HttpResponse& response, size_t offset)
+    {
+        while (true)
+        {
+            size_t lineEnd;
+            while ((lineEnd = m_buffer.find("\r\n", offset)) == std::string::npos)
+            {
+                if (!fill())
+                    return false;
+            }
+            size_t size = std::stoul(m_buffer.substr(offset, lineEnd - offset), nullptr, 16);
+            while (m_buffer.length() < lineEnd + 2 + size + 2)
+            {
+                if (!fill())
+                    return false;
+            }
+            response.body.append(m_buffer, lineEnd + 2, size);
+            offset = lineEnd + 2 + size + 2;
+            if (size == 0)
+            {
+                m_buffer.erase(0, offset);
+                return true;
+            }
+        }
+    }
+
+    bool closed()
+    {
+        return m_buffer.empty() && !fill();
+    }
+};
\ No newline at end of file
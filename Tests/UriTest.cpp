@@ -0,0 +1,95 @@
+#include <stdexcept>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "Uri.hpp"
+
+TEST(UriTest, OriginForm)
+{
+    Uri uri("/search/a%20b?q=x+y&empty=&flag&q=second#top");
+    EXPECT_EQ(uri.scheme(), "");
+    EXPECT_EQ(uri.host(), "");
+    EXPECT_EQ(uri.path(), "/search/a%20b");
+    EXPECT_EQ(uri.decodedPath(), "/search/a b");
+    EXPECT_EQ(uri.query(), "q=x+y&empty=&flag&q=second");
+    EXPECT_EQ(uri.fragment(), "top");
+
+    // The first occurrence, '+' decoded as a space
+    EXPECT_EQ(uri.rawQueryParam("q"), "x+y");
+    EXPECT_EQ(uri.queryParam("q"), "x y");
+    EXPECT_TRUE(uri.hasQueryParam("empty"));
+    EXPECT_TRUE(uri.hasQueryParam("flag"));
+    EXPECT_EQ(uri.queryParam("flag"), "");
+    EXPECT_FALSE(uri.hasQueryParam("missing"));
+
+    Uri encodedName("/?na%6De=1");
+    EXPECT_EQ(encodedName.queryParam("name"), "1");
+}
+
+TEST(UriTest, AbsoluteForm)
+{
+    Uri uri("http://user@example.com:8080/path?x=1");
+    EXPECT_EQ(uri.scheme(), "http");
+    EXPECT_EQ(uri.host(), "example.com");
+    EXPECT_EQ(uri.port(), 8080);
+    EXPECT_EQ(uri.path(), "/path");
+    EXPECT_EQ(uri.queryParam("x"), "1");
+
+    // No path is the root
+    EXPECT_EQ(Uri("http://example.com").path(), "/");
+    EXPECT_EQ(Uri("http://example.com?x").path(), "/");
+
+    Uri ipv6("http://[::1]:81/");
+    EXPECT_EQ(ipv6.host(), "[::1]");
+    EXPECT_EQ(ipv6.port(), 81);
+}
+
+TEST(UriTest, AuthorityAndAsteriskForms)
+{
+    Uri connect("example.com:443");
+    EXPECT_EQ(connect.host(), "example.com");
+    EXPECT_EQ(connect.port(), 443);
+
+    Uri asterisk("*");
+    EXPECT_EQ(asterisk.path(), "*");
+    EXPECT_EQ(asterisk.normalizedPath(), "*");
+
+    // The Host header fills in the authority of an origin-form target
+    Uri origin("/index.html");
+    origin.setAuthority("example.com:8000");
+    EXPECT_EQ(origin.host(), "example.com");
+    EXPECT_EQ(origin.port(), 8000);
+    EXPECT_EQ(origin.target(), "/index.html");
+}
+
+TEST(UriTest, MalformedTargets)
+{
+    EXPECT_THROW(Uri(""), std::invalid_argument);
+    EXPECT_THROW(Uri("/a b"), std::invalid_argument);
+    EXPECT_THROW(Uri("/a?b\x7f"), std::invalid_argument);
+    EXPECT_THROW(Uri("http://example.com:65536/"), std::invalid_argument);
+    EXPECT_THROW(Uri("http://example.com:8x/"), std::invalid_argument);
+    EXPECT_THROW(Uri("http://[::1/"), std::invalid_argument);
+}
+
+TEST(UriTest, NormalizedPath)
+{
+    const std::pair<std::string_view, std::string_view> cases[] = {
+        { "/", "/" },
+        { "/a/b/c", "/a/b/c" },
+        { "/a/./b/../c", "/a/c" },
+        { "/a/b/..", "/a/" },
+        { "/a/b/.", "/a/b/" },
+        { "/../../a", "/a" },
+        { "/..", "/" },
+        { "/a/%2E%2e/b", "/b" },
+        { "/%7euser/%41", "/~user/A" },
+        { "/a%2fb", "/a%2Fb" },         // an encoded '/' is not a separator
+        { "/a//b", "/a//b" },
+        { "/a%2", "/a%2" },
+        { "http://example.com/x/../y", "/y" },
+    };
+    for (const auto& [target, normalized] : cases)
+        EXPECT_EQ(Uri(target).normalizedPath(), normalized) << target;
+}
\ No newline at end of file
@@ -0,0 +1,159 @@
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+#include <gtest/gtest.h>
+
+#include "HTTPUtils.hpp"
+#include "WebSocket.hpp"
+
+namespace
+{
+
+const uint8_t kMask[4] = {0x37, 0xfa, 0x21, 0x3d};
+
+// A client frame, masked as clients must
+std::string clientFrame(uint8_t opcode, std::string_view payload, bool fin = true)
+{
+    std::string frame;
+    frame.push_back(static_cast<char>((fin ? 0x80 : 0x00) | opcode));
+    if (payload.length() < 126)
+        frame.push_back(static_cast<char>(0x80 | payload.length()));
+    else
+    {
+        frame.push_back(static_cast<char>(0x80 | 126));
+        frame.push_back(static_cast<char>(payload.length() >> 8));
+        frame.push_back(static_cast<char>(payload.length()));
+    }
+    frame.append(reinterpret_cast<const char*>(kMask), sizeof(kMask));
+    for (size_t i = 0; i < payload.length(); i++)
+        frame.push_back(static_cast<char>(payload[i] ^ kMask[i % 4]));
+    return frame;
+}
+
+std::string pending(WebSocketSession& session)
+{
+    iovec iov[16];
+    std::string out;
+    size_t count = session.pendingBuffers(iov, 16);
+    for (size_t i = 0; i < count; i++)
+        out.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+    session.consume(out.length());
+    return out;
+}
+
+Request upgradeRequest(std::string_view key, std::string_view version = "13")
+{
+    return http::utils::toRequest(
+        "GET /chat HTTP/1.1\r\nHost: server.example.com\r\nUpgrade: websocket\r\nConnection: keep-alive, Upgrade\r\n"
+        "Sec-WebSocket-Key: " + std::string(key) + "\r\nSec-WebSocket-Version: " + std::string(version) + "\r\n\r\n");
+}
+
+}
+
+TEST(WebSocketTest, Handshake)
+{
+    // RFC 6455 section 1.3
+    Request request = upgradeRequest("dGhlIHNhbXBsZSBub25jZQ==");
+    EXPECT_TRUE(WebSocketSession::isUpgradeRequest(request));
+
+    std::string response = WebSocketSession::handshakeResponse(request);
+    EXPECT_TRUE(response.starts_with("HTTP/1.1 101 Switching Protocols\r\n"));
+    EXPECT_NE(response.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"), std::string::npos);
+
+    EXPECT_THROW(WebSocketSession::handshakeResponse(upgradeRequest("dGhlIHNhbXBsZSBub25jZQ==", "8")), std::invalid_argument);
+    EXPECT_THROW(WebSocketSession::handshakeResponse(upgradeRequest("c2hvcnQ=")), std::invalid_argument);
+}
+
+TEST(WebSocketTest, UnmaskMatchesScalar)
+{
+    std::string input;
+    for (int i = 0; i < 1000; i++)
+        input.push_back(static_cast<char>(i * 7));
+
+    // Every offset and length around the vector width
+    for (uint64_t offset = 0; offset < 4; offset++)
+    {
+        for (size_t length : {0, 1, 3, 15, 16, 17, 31, 64, 999})
+        {
+            std::string expected(length, '\0'), actual(length, '\0');
+            for (size_t i = 0; i < length; i++)
+                expected[i] = static_cast<char>(input[i] ^ kMask[(offset + i) % 4]);
+            WebSocketSession::unmask(actual.data(), input.data(), length, kMask, offset);
+            EXPECT_EQ(actual, expected) << "offset " << offset << " length " << length;
+
+            // In place
+            std::string inPlace = input.substr(0, length);
+            WebSocketSession::unmask(inPlace.data(), inPlace.data(), length, kMask, offset);
+            EXPECT_EQ(inPlace, expected);
+        }
+    }
+}
+
+TEST(WebSocketTest, MessagesSplitAcrossReads)
+{
+    std::vector<std::pair<std::string, bool>> messages;
+    WebSocketSession session([&](WebSocketSession&, std::string_view message, bool binary)
+    {
+        messages.emplace_back(message, binary);
+    }, "/chat");
+
+    std::string large(300, 'x');
+    std::string stream = clientFrame(0x1, "Hello") + clientFrame(0x2, large)
+        + clientFrame(0x1, "frag", false) + clientFrame(0x0, "men", false) + clientFrame(0x0, "ted");
+
+    // One byte at a time, every header and payload boundary is crossed
+    for (char c : stream)
+        ASSERT_TRUE(session.receive(&c, 1));
+
+    ASSERT_EQ(messages.size(), 3);
+    EXPECT_EQ(messages[0], std::make_pair(std::string("Hello"), false));
+    EXPECT_EQ(messages[1], std::make_pair(large, true));
+    EXPECT_EQ(messages[2], std::make_pair(std::string("fragmented"), false));
+}
+
+TEST(WebSocketTest, ControlFrames)
+{
+    std::vector<std::string> messages;
+    WebSocketSession session([&](WebSocketSession& s, std::string_view message, bool)
+    {
+        messages.emplace_back(message);
+        s.send(message);
+    }, "/chat");
+
+    // A ping between the fragments of a message is answered at once
+    std::string stream = clientFrame(0x1, "ab", false) + clientFrame(0x9, "ping") + clientFrame(0x0, "cd");
+    ASSERT_TRUE(session.receive(stream.data(), stream.length()));
+    EXPECT_EQ(messages, std::vector<std::string>({ "abcd" }));
+    EXPECT_EQ(pending(session), std::string("\x8a\x04ping") + std::string("\x81\x04" "abcd"));
+
+    // A close is echoed and nothing is sent after it
+    std::string close = clientFrame(0x8, std::string("\x03\xe8", 2));
+    ASSERT_TRUE(session.receive(close.data(), close.length()));
+    session.send("late");
+    EXPECT_EQ(pending(session), std::string("\x88\x02\x03\xe8", 4));
+    EXPECT_TRUE(session.wantsClose());
+}
+
+TEST(WebSocketTest, ProtocolErrors)
+{
+    auto ignore = [](WebSocketSession&, std::string_view, bool) {};
+    const std::string invalid[] = {
+        std::string("\x81\x05Hello", 7),                        // unmasked
+        clientFrame(0x0, "orphan"),                             // continuation without a message
+        clientFrame(0x9, "ping", false),                        // fragmented control frame
+        clientFrame(0x1, "a", false) + clientFrame(0x1, "b"),   // new message inside another
+        clientFrame(0x3, "reserved"),
+    };
+    for (const std::string& stream : invalid)
+    {
+        WebSocketSession session(ignore, "/chat");
+        EXPECT_FALSE(session.receive(stream.data(), stream.length()));
+
+        // Closed with 1002, protocol error
+        EXPECT_EQ(pending(session), std::string("\x88\x02\x03\xea", 4));
+        EXPECT_TRUE(session.wantsClose());
+    }
+}
\ No newline at end of file
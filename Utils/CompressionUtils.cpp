@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <stdexcept>
+#include <zlib.h>
+
+#ifdef HAS_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#ifdef HAS_ZSTD
+#include <zstd.h>
+#endif
+
+#include "CompressionUtils.hpp"
+
+namespace http::utils
+{
+
+bool isEncodingSupported(ContentEncoding encoding)
+{
+    switch (encoding)
+    {
+    case ContentEncoding::Identity:
+    case ContentEncoding::Gzip:
+    case ContentEncoding::Deflate:
+        return true;
+#ifdef HAS_BROTLI
+    case ContentEncoding::Brotli:
+        return true;
+#endif
+#ifdef HAS_ZSTD
+    case ContentEncoding::Zstd:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+bool isCompressibleType(std::string_view contentType)
+{
+    // Unlabelled bodies are usually our own text/JSON
+    if (contentType.empty())
+        return true;
+
+    std::string type;
+    std::transform(contentType.begin(), contentType.end(),
+                    std::back_inserter(type),
+                    [](char c) { return tolower(c); });
+
+    return type.starts_with("text/")
+        || type.find("json") != std::string::npos
+        || type.find("xml") != std::string::npos
+        || type.find("javascript") != std::string::npos
+        || type.starts_with("application/wasm")
+        || type.starts_with("image/svg");
+}
+
+ContentEncoding negotiateEncoding(std::string_view acceptEncoding)
+{
+    // Server preference when the client weighs codings equally
+    static constexpr std::array<ContentEncoding, 4> kPreference = {
+        ContentEncoding::Brotli,
+        ContentEncoding::Zstd,
+        ContentEncoding::Gzip,
+        ContentEncoding::Deflate
+    };
+
+    // q-values per coding, -1 = not mentioned
+    std::array<double, 5> qValues;
+    qValues.fill(-1.0);
+    double wildcard = -1.0;
+
+    size_t lpos = 0;
+    while (lpos < acceptEncoding.length())
+    {
+        size_t rpos = acceptEncoding.find(',', lpos);
+        if (rpos == std::string_view::npos)
+            rpos = acceptEncoding.length();
+
+        std::string token(acceptEncoding.substr(lpos, rpos - lpos));
+        lpos = rpos + 1;
+
+        token.erase(std::remove_if(token.begin(), token.end(),
+            [](char c) { return std::isspace(c); }), token.end());
+        std::transform(token.begin(), token.end(), token.begin(),
+            [](char c) { return tolower(c); });
+
+        double q = 1.0;
+        size_t semi = token.find(';');
+        if (semi != std::string::npos)
+        {
+            size_t qpos = token.find("q=", semi);
+            if (qpos != std::string::npos)
+                q = std::strtod(token.c_str() + qpos + 2, nullptr);
+            token.resize(semi);
+        }
+
+        if (token == "*")
+            wildcard = q;
+        else if (token == "gzip" || token == "x-gzip")
+            qValues[static_cast<int>(ContentEncoding::Gzip)] = q;
+        else if (token == "deflate")
+            qValues[static_cast<int>(ContentEncoding::Deflate)] = q;
+        else if (token == "br")
+            qValues[static_cast<int>(ContentEncoding::Brotli)] = q;
+        else if (token == "zstd")
+            qValues[static_cast<int>(ContentEncoding::Zstd)] = q;
+    }
+
+    ContentEncoding best = ContentEncoding::Identity;
+    double bestQ = 0.0;
+    for (ContentEncoding encoding : kPreference)
+    {
+        if (!isEncodingSupported(encoding))
+            continue;
+
+        double q = qValues[static_cast<int>(encoding)];
+        if (q < 0)
+            q = wildcard;
+        if (q > bestQ)
+        {
+            best = encoding;
+            bestQ = q;
+        }
+    }
+    return best;
+}
+
+std::string compress(std::string_view body, ContentEncoding encoding, CompressionLevel level)
+{
+    StreamCompressor compressor(encoding, level);
+    std::string out;
+
+    for (size_t offset = 0; offset < body.length(); offset += k_compressChunkSize)
+        out += compressor.compressChunk(body.substr(offset, k_compressChunkSize), false);
+    out += compressor.finish();
+    return out;
+}
+
+struct StreamCompressor::Impl
+{
+    ContentEncoding encoding;
+    z_stream zlib{};
+#ifdef HAS_BROTLI
+    BrotliEncoderState* brotli{ nullptr };
+#endif
+#ifdef HAS_ZSTD
+    ZSTD_CCtx* zstd{ nullptr };
+#endif
+
+    // mode: 0 = process, 1 = flush, 2 = finish
+    void run(std::string_view in, int mode, std::string& out)
+    {
+        char buffer[k_compressChunkSize];
+
+        switch (encoding)
+        {
+        case ContentEncoding::Gzip:
+        case ContentEncoding::Deflate:
+        {
+            static constexpr int kFlush[] = { Z_NO_FLUSH, Z_SYNC_FLUSH, Z_FINISH };
+            zlib.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+            zlib.avail_in = in.length();
+            int ret;
+            do
+            {
+                zlib.next_out = reinterpret_cast<Bytef*>(buffer);
+                zlib.avail_out = sizeof(buffer);
+                ret = deflate(&zlib, kFlush[mode]);
+                if (ret == Z_STREAM_ERROR)
+                    throw std::runtime_error("deflate failed");
+                out.append(buffer, sizeof(buffer) - zlib.avail_out);
+            } while (zlib.avail_out == 0 || (mode == 2 && ret != Z_STREAM_END));
+            break;
+        }
+#ifdef HAS_BROTLI
+        case ContentEncoding::Brotli:
+        {
+            static constexpr BrotliEncoderOperation kOp[] = {
+                BROTLI_OPERATION_PROCESS, BROTLI_OPERATION_FLUSH, BROTLI_OPERATION_FINISH };
+            size_t availIn = in.length();
+            const uint8_t* nextIn = reinterpret_cast<const uint8_t*>(in.data());
+            do
+            {
+                size_t availOut = sizeof(buffer);
+                uint8_t* nextOut = reinterpret_cast<uint8_t*>(buffer);
+                if (!BrotliEncoderCompressStream(brotli, kOp[mode],
+                        &availIn, &nextIn, &availOut, &nextOut, nullptr))
+                    throw std::runtime_error("brotli compression failed");
+                out.append(buffer, sizeof(buffer) - availOut);
+            } while (availIn > 0 || BrotliEncoderHasMoreOutput(brotli));
+            break;
+        }
+#endif
+#ifdef HAS_ZSTD
+        case ContentEncoding::Zstd:
+        {
+            static constexpr ZSTD_EndDirective kDirective[] = {
+                ZSTD_e_continue, ZSTD_e_flush, ZSTD_e_end };
+            ZSTD_inBuffer input{ in.data(), in.length(), 0 };
+            size_t remaining;
+            do
+            {
+                ZSTD_outBuffer output{ buffer, sizeof(buffer), 0 };
+                remaining = ZSTD_compressStream2(zstd, &output, &input, kDirective[mode]);
+                if (ZSTD_isError(remaining))
+                    throw std::runtime_error("zstd compression failed");
+                out.append(buffer, output.pos);
+            } while (input.pos < input.size || (mode != 0 && remaining > 0));
+            break;
+        }
+#endif
+        default:
+            out.append(in);
+            break;
+        }
+    }
+};
+
+StreamCompressor::StreamCompressor(ContentEncoding encoding, CompressionLevel level)
+    : m_impl(std::make_unique<Impl>())
+{
+    bool best = level == CompressionLevel::Best;
+    m_impl->encoding = encoding;
+
+    switch (encoding)
+    {
+    case ContentEncoding::Gzip:
+    case ContentEncoding::Deflate:
+    {
+        // windowBits + 16 selects the gzip wrapper, plain 15 is zlib (HTTP "deflate")
+        int windowBits = encoding == ContentEncoding::Gzip ? 15 + 16 : 15;
+        if (deflateInit2(&m_impl->zlib, best ? 9 : 4, Z_DEFLATED,
+                windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            throw std::runtime_error("deflateInit2 failed");
+        break;
+    }
+#ifdef HAS_BROTLI
+    case ContentEncoding::Brotli:
+        m_impl->brotli = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+        if (m_impl->brotli == nullptr)
+            throw std::runtime_error("BrotliEncoderCreateInstance failed");
+        // Quality 10/11 costs ~40x the CPU of 9 for a marginal gain, too slow
+        // even for the cache since the first request pays for it
+        BrotliEncoderSetParameter(m_impl->brotli, BROTLI_PARAM_QUALITY, best ? 9 : 4);
+        break;
+#endif
+#ifdef HAS_ZSTD
+    case ContentEncoding::Zstd:
+        m_impl->zstd = ZSTD_createCCtx();
+        if (m_impl->zstd == nullptr)
+            throw std::runtime_error("ZSTD_createCCtx failed");
+        // Levels above 9 cost ~30x the CPU for a few percent, the same
+        // first-request stall as brotli 10/11
+        ZSTD_CCtx_setParameter(m_impl->zstd, ZSTD_c_compressionLevel, best ? 9 : 3);
+        break;
+#endif
+    case ContentEncoding::Identity:
+        break;
+    default:
+        throw std::invalid_argument("Unsupported content encoding");
+    }
+}
+
+StreamCompressor::~StreamCompressor()
+{
+    switch (m_impl->encoding)
+    {
+    case ContentEncoding::Gzip:
+    case ContentEncoding::Deflate:
+        deflateEnd(&m_impl->zlib);
+        break;
+#ifdef HAS_BROTLI
+    case ContentEncoding::Brotli:
+        BrotliEncoderDestroyInstance(m_impl->brotli);
+        break;
+#endif
+#ifdef HAS_ZSTD
+    case ContentEncoding::Zstd:
+        ZSTD_freeCCtx(m_impl->zstd);
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+std::string StreamCompressor::compressChunk(std::string_view chunk, bool flush)
+{
+    std::string out;
+    m_impl->run(chunk, flush ? 1 : 0, out);
+    return out;
+}
+
+std::string StreamCompressor::finish()
+{
+    std::string out;
+    m_impl->run(std::string_view(), 2, out);
+    return out;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+
+#include "Enum.hpp"
+
+namespace http::utils
+{
+
+// Bodies smaller than this are not worth the CPU or the extra headers
+constexpr size_t k_minCompressSize = 1024;
+
+// Input is fed to the codecs in slices of this size
+constexpr size_t k_compressChunkSize = 16 * 1024;
+
+enum class CompressionLevel
+{
+    Fast,   // per-request compression on the hot path
+    Best    // compressed once and cached
+};
+
+bool isEncodingSupported(ContentEncoding encoding);
+bool isCompressibleType(std::string_view contentType);
+
+// Pick the best supported coding from an Accept-Encoding header value
+ContentEncoding negotiateEncoding(std::string_view acceptEncoding);
+
+// One-shot compression of a complete body
+std::string compress(std::string_view body, ContentEncoding encoding,
+    CompressionLevel level = CompressionLevel::Fast);
+
+// Incremental compressor, compress() feeds bodies through it in slices and the
+// proxy feeds upstream responses through it as they arrive.
+// compressChunk() with flush makes its output decodable on its own.
+class StreamCompressor
+{
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+
+public:
+    StreamCompressor(ContentEncoding encoding, CompressionLevel level = CompressionLevel::Fast);
+    ~StreamCompressor();
+
+    StreamCompressor(const StreamCompressor&) = delete;
+    StreamCompressor& operator=(const StreamCompressor&) = delete;
+
+    std::string compressChunk(std::string_view chunk, bool flush = true);
+    std::string finish();
+};
+
+}
\ No newline at end of file
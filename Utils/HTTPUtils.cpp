@@ -1,6 +1,13 @@
 #include <iterator>
 #include <algorithm>
-#include <sstream>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <cstring>
+#include <strings.h>
 
 #include "HTTPUtils.hpp"
 #include "Request.hpp"
@@ -9,6 +16,115 @@
 namespace http::utils
 {
 
+namespace
+{
+
+struct Status
+{
+    StatusCode code;
+    std::string_view reason;
+};
+
+// Every StatusCode with its reason phrase (RFC 9110, section 15)
+constexpr Status kStatuses[] =
+{
+    { StatusCode::Continue, "Continue" },
+    { StatusCode::SwitchingProtocols, "Switching Protocols" },
+    { StatusCode::EarlyHints, "Early Hints" },
+    { StatusCode::Ok, "OK" },
+    { StatusCode::Created, "Created" },
+    { StatusCode::Accepted, "Accepted" },
+    { StatusCode::NonAuthoritativeInformation, "Non-Authoritative Information" },
+    { StatusCode::NoContent, "No Content" },
+    { StatusCode::ResetContent, "Reset Content" },
+    { StatusCode::PartialContent, "Partial Content" },
+    { StatusCode::MultipleChoices, "Multiple Choices" },
+    { StatusCode::MovedPermanently, "Moved Permanently" },
+    { StatusCode::Found, "Found" },
+    { StatusCode::NotModified, "Not Modified" },
+    { StatusCode::BadRequest, "Bad Request" },
+    { StatusCode::Unauthorized, "Unauthorized" },
+    { StatusCode::Forbidden, "Forbidden" },
+    { StatusCode::NotFound, "Not Found" },
+    { StatusCode::MethodNotAllowed, "Method Not Allowed" },
+    { StatusCode::RequestTimeout, "Request Timeout" },
+    { StatusCode::RangeNotSatisfiable, "Range Not Satisfiable" },
+    { StatusCode::ImATeapot, "I'm a Teapot" },
+    { StatusCode::TooManyRequests, "Too Many Requests" },
+    { StatusCode::InternalServerError, "Internal Server Error" },
+    { StatusCode::NotImplemented, "Not Implemented" },
+    { StatusCode::BadGateway, "Bad Gateway" },
+    { StatusCode::ServiceUnvailable, "Service Unavailable" },
+    { StatusCode::GatewayTimeout, "Gateway Timeout" },
+    { StatusCode::HttpVersionNotSupported, "HTTP Version Not Supported" },
+};
+
+// Status code -> index into kStatuses
+constexpr uint8_t kNoStatus = 0xFF;
+constexpr auto kStatusIndex = []
+{
+    std::array<uint8_t, 600> index{};
+    index.fill(kNoStatus);
+    for (size_t i = 0; i < std::size(kStatuses); i++)
+        index[static_cast<int>(kStatuses[i].code)] = static_cast<uint8_t>(i);
+    return index;
+}();
+
+const Status* findStatus(StatusCode code)
+{
+    auto value = static_cast<size_t>(code);
+    if (value >= kStatusIndex.size() || kStatusIndex[value] == kNoStatus)
+        return nullptr;
+    return &kStatuses[kStatusIndex[value]];
+}
+
+// "HTTP/1.1 200 OK\r\n", rendered at compile time
+struct StatusLine
+{
+    char text[48]{};
+    size_t length{0};
+
+    constexpr void append(std::string_view string)
+    {
+        for (char c : string)
+            text[length++] = c;
+    }
+};
+
+constexpr StatusLine renderStatusLine(std::string_view version, const Status& status)
+{
+    int code = static_cast<int>(status.code);
+    const char digits[] = { static_cast<char>('0' + code / 100), static_cast<char>('0' + code / 10 % 10),
+        static_cast<char>('0' + code % 10) };
+
+    StatusLine line;
+    line.append(version);
+    line.append(" ");
+    line.append(std::string_view(digits, 3));
+    line.append(" ");
+    line.append(status.reason);
+    line.append("\r\n");
+    return line;
+}
+
+// Per status, the HTTP/1.0 and the HTTP/1.1 line
+constexpr auto kStatusLines = []
+{
+    std::array<std::array<StatusLine, 2>, std::size(kStatuses)> lines{};
+    for (size_t i = 0; i < std::size(kStatuses); i++)
+    {
+        lines[i][0] = renderStatusLine("HTTP/1.0", kStatuses[i]);
+        lines[i][1] = renderStatusLine("HTTP/1.1", kStatuses[i]);
+    }
+    return lines;
+}();
+
+// The calling thread's Date line and the second it was rendered for
+thread_local std::time_t t_dateSecond = -1;
+thread_local std::string t_dateLine;
+
+}
+
 std::string toString(Method method)
 {
     switch (method)
@@ -54,39 +170,30 @@ std::string toString(Version version)
 
 std::string toString(StatusCode code)
 {
-    switch (code) {
-    case StatusCode::Continue:
-        return "Continue";
-    case StatusCode::Ok:
-        return "OK";
-    case StatusCode::Accepted:
-        return "Accepted";
-    case StatusCode::MovedPermanently:
-        return "Moved Permanently";
-    case StatusCode::Found:
-        return "Found";
-    case StatusCode::BadRequest:
-        return "Bad Request";
-    case StatusCode::Forbidden:
-        return "Forbidden";
-    case StatusCode::NotFound:
-        return "Not Found";
-    case StatusCode::MethodNotAllowed:
-        return "Method Not Allowed";
-    case StatusCode::ImATeapot:
-        return "I'm a Teapot";
-    case StatusCode::InternalServerError:
-        return "Internal Server Error";
-    case StatusCode::NotImplemented:
-        return "Not Implemented";
-    case StatusCode::BadGateway:
-        return "Bad Gateway";
+    const Status* status = findStatus(code);
+    return status ? std::string(status->reason) : std::string();
+}
+
+std::string toString(ContentEncoding encoding)
+{
+    switch (encoding)
+    {
+    case ContentEncoding::Identity:
+        return "identity";
+    case ContentEncoding::Gzip:
+        return "gzip";
+    case ContentEncoding::Deflate:
+        return "deflate";
+    case ContentEncoding::Brotli:
+        return "br";
+    case ContentEncoding::Zstd:
+        return "zstd";
     default:
         return std::string();
-  }
+    }
 }
 
-Method toMethod(const std::string& string)
+Method toMethod(std::string_view string)
 {
     std::string methodStr;
     std::transform(string.begin(), string.end(),
@@ -115,7 +222,7 @@ Method toMethod(const std::string& string)
         throw std::invalid_argument("Unexpected HTTP method");
 }
 
-Version toVersion(const std::string& string)
+Version toVersion(std::string_view string)
 {
     std::string versionStr;
     std::transform(string.begin(), string.end(),
@@ -137,90 +244,593 @@ Version toVersion(const std::string& string)
 
 std::string toString(const Request& request)
 {
-    std::ostringstream oss;
-    oss << toString(request.method()) << ' ';
-    oss << request.uri().path() << ' ';
-    oss << toString(request.version()) << "\r\n";
+    std::string out;
+    out.append(toString(request.method())).append(" ");
+    out.append(request.uri().target()).append(" ");
+    out.append(toString(request.version())).append("\r\n");
     for (const auto& p : request.headers())
-        oss << p.first << ": " << p.second << "\r\n";
-    oss << "\r\n";
-    oss << request.content();
-    return oss.str();
+        out.append(p.first).append(": ").append(p.second).append("\r\n");
+    out.append("\r\n");
+    out.append(request.content());
+    return out;
 }
 
-std::string toString(const Response& response, bool sendBody)
+std::string_view statusLine(Version version, StatusCode code)
+{
+    const Status* status = findStatus(code);
+    if (!status || (version != Version::HTTP_1_0 && version != Version::HTTP_1_1))
+        return std::string_view();
+
+    const StatusLine& line = kStatusLines[status - kStatuses][version == Version::HTTP_1_1];
+    return std::string_view(line.text, line.length);
+}
+
+std::string_view dateHeaderLine()
+{
+    std::time_t now = std::time(nullptr);
+    if (now != t_dateSecond)
+    {
+        t_dateSecond = now;
+        t_dateLine = "Date: " + formatHttpDate(now) + "\r\n";
+    }
+    return t_dateLine;
+}
+
+std::string_view currentHttpDate()
 {
-    std::ostringstream oss;
-    oss << toString(response.version()) << ' ';
-    oss << static_cast<int>(response.statusCode()) << ' ';
-    oss << toString(response.statusCode()) << "\r\n";
+    std::string_view line = dateHeaderLine();
+    return line.substr(6, line.length() - 8);
+}
+
+void appendNumber(std::string& out, uint64_t value)
+{
+    size_t length = out.length();
+    out.resize_and_overwrite(length + 20, [length, value](char* data, size_t size)
+    {
+        return std::to_chars(data + length, data + size, value).ptr - data;
+    });
+}
+
+void appendResponse(std::string& out, const Response& response, bool sendBody)
+{
+    // Status line, Date, Content-Length with room for 20 digits, blank line
+    size_t size = 128 + (sendBody ? response.content().length() : 0);
+    for (const auto& p : response.headers())
+        size += p.first.length() + p.second.length() + 4;
+    out.reserve(out.length() + size);
+
+    std::string_view line = statusLine(response.version(), response.statusCode());
+    if (!line.empty())
+        out.append(line);
+    else
+    {
+        out.append(toString(response.version())).append(" ");
+        appendNumber(out, static_cast<int>(response.statusCode()));
+        out.append(" ").append(toString(response.statusCode())).append("\r\n");
+    }
+
+    // Handlers may set their own
+    if (!response.hasHeader("Date"))
+        out.append(dateHeaderLine());
     if (sendBody)
-        oss << "Content-Length: " << response.contentLength() << "\r\n";
+    {
+        out.append("Content-Length: ");
+        appendNumber(out, response.contentLength());
+        out.append("\r\n");
+    }
     for (const auto& p : response.headers())
-        oss << p.first << ": " << p.second << "\r\n";
-    oss << "\r\n";
+        out.append(p.first).append(": ").append(p.second).append("\r\n");
+    out.append("\r\n");
     if (sendBody)
-        oss << response.content();
-    return oss.str();
+        out.append(response.content());
+}
+
+std::string toString(const Response& response, bool sendBody)
+{
+    std::string out;
+    appendResponse(out, response, sendBody);
+    return out;
 }
 
-Request toRequest(const std::string& string)
+std::string_view trimWhitespace(std::string_view string)
 {
-    std::string startLine, headerLines, messageBody;
-    std::istringstream iss;
-    Request request;
-    std::string line, method, path, version;
-    std::string key, value;
-    Uri uri;
+    size_t lpos = string.find_first_not_of(" \t");
+    if (lpos == std::string_view::npos)
+        return std::string_view();
+    size_t rpos = string.find_last_not_of(" \t\r");
+    return string.substr(lpos, rpos - lpos + 1);
+}
+
+void parseRequest(std::string_view string, Request& request)
+{
+    std::string_view startLine, headerLines, messageBody;
     size_t lpos = 0, rpos = 0;
 
     rpos = string.find("\r\n", lpos);
-    if (rpos == std::string::npos)
+    if (rpos == std::string_view::npos)
         throw std::invalid_argument("Could not find request start line");
 
     startLine = string.substr(lpos, rpos - lpos);
     lpos = rpos + 2;
     rpos = string.find("\r\n\r\n", lpos);
-    if (rpos != std::string::npos) // has header
+    if (rpos != std::string_view::npos) // has header
     {
         headerLines = string.substr(lpos, rpos - lpos);
         lpos = rpos + 4;
-        rpos = string.length();
-        if (lpos < rpos)
-            messageBody = string.substr(lpos, rpos - lpos);
+        if (lpos < string.length())
+            messageBody = string.substr(lpos);
     }
 
-    iss.clear();
-    iss.str(startLine);
-    iss >> method >> path >> version;
-    if (!iss.good() && !iss.eof())
+    // method SP request-target SP version
+    size_t methodEnd = startLine.find(' ');
+    size_t pathEnd = startLine.find(' ', methodEnd + 1);
+    if (methodEnd == std::string_view::npos || pathEnd == std::string_view::npos
+        || startLine.find(' ', pathEnd + 1) != std::string_view::npos)
         throw std::invalid_argument("Invalid start line format");
 
-    request.setMethod(toMethod(method));
-    request.setUri(Uri(path));
-    if (toVersion(version) != request.version())
+    request.setMethod(toMethod(startLine.substr(0, methodEnd)));
+    request.setTarget(startLine.substr(methodEnd + 1, pathEnd - methodEnd - 1));
+    if (toVersion(startLine.substr(pathEnd + 1)) != request.version())
         throw std::logic_error("HTTP version not supported");
 
-    iss.clear();
-    iss.str(headerLines);
-    while (std::getline(iss, line))
+    lpos = 0;
+    while (lpos < headerLines.length())
     {
-        std::istringstream headerStream(line);
-        std::getline(headerStream, key, ':');
-        std::getline(headerStream, value);
+        rpos = headerLines.find("\r\n", lpos);
+        if (rpos == std::string_view::npos)
+            rpos = headerLines.length();
+        std::string_view line = headerLines.substr(lpos, rpos - lpos);
+        lpos = rpos + 2;
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos)
+            throw std::invalid_argument("Invalid header line");
 
-        // remove whitespaces from the two strings
-        key.erase(std::remove_if(key.begin(), key.end(),
-            [](char c) { return std::isspace(c); }), key.end());
-        
-        value.erase(std::remove_if(value.begin(), value.end(),
-            [](char c) { return std::isspace(c); }), value.end());
-        
-        request.setHeader(key, value);
+        request.setHeader(trimWhitespace(line.substr(0, colon)),
+            trimWhitespace(line.substr(colon + 1)));
     }
 
+    request.resolveAuthority();
     request.setContent(messageBody);
+}
+
+Request toRequest(std::string_view string)
+{
+    Request request;
+    parseRequest(string, request);
     return request;
 }
 
+size_t requestLength(const char* data, size_t length, StatusCode& error)
+{
+    size_t bodyLength;
+    size_t headLength = requestHeadLength(data, length, bodyLength, error);
+    return headLength > 0 && bodyLength <= length - headLength ? headLength + bodyLength : 0;
+}
+
+size_t requestHeadLength(const char* data, size_t length, size_t& bodyLength, StatusCode& error)
+{
+    bodyLength = 0;
+    std::string_view request(data, length);
+    size_t headerEnd = request.find("\r\n\r\n");
+    if (headerEnd == std::string_view::npos)
+        return 0;
+
+    size_t total = headerEnd + 4;
+    std::string_view headers = request.substr(0, headerEnd);
+
+    // Where the next request starts must not be open to interpretation: a
+    // proxy in front of or behind the server could read it differently and
+    // smuggle a request past it. Anything ambiguous is refused.
+    auto isHeader = [](std::string_view name, std::string_view expected)
+    {
+        return name.length() == expected.length()
+            && strncasecmp(name.data(), expected.data(), expected.length()) == 0;
+    };
+
+    bool hasLength = false;
+    for (size_t lpos = headers.find("\r\n"); lpos != std::string_view::npos; )
+    {
+        lpos += 2;
+        size_t rpos = headers.find("\r\n", lpos);
+        std::string_view line = headers.substr(lpos, rpos == std::string_view::npos ? rpos : rpos - lpos);
+        lpos = rpos;
+
+        // Folded lines and whitespace before the colon hide a header from some parsers
+        size_t colon = line.find(':');
+        std::string_view name = line.substr(0, colon);
+        if (colon == std::string_view::npos || name.empty() || name.find_first_of(" \t") != std::string_view::npos)
+        {
+            error = StatusCode::BadRequest;
+            return 0;
+        }
+
+        // Only Content-Length framed bodies are supported
+        if (isHeader(name, "Transfer-Encoding"))
+        {
+            error = StatusCode::NotImplemented;
+            return 0;
+        }
+        if (!isHeader(name, "Content-Length"))
+            continue;
+
+        // Digits only, no sign, list or overflow, and repeats must agree
+        std::string_view value = trimWhitespace(line.substr(colon + 1));
+        size_t parsed = 0;
+        auto [end, ec] = std::from_chars(value.data(), value.data() + value.length(), parsed);
+        if (ec != std::errc() || end != value.data() + value.length() || (hasLength && parsed != bodyLength))
+        {
+            error = StatusCode::BadRequest;
+            return 0;
+        }
+        bodyLength = parsed;
+        hasLength = true;
+    }
+
+    return total;
+}
+
+std::string decodeBase64(std::string_view input)
+{
+    std::string out;
+    out.reserve(input.length() * 3 / 4);
+    uint32_t buffer = 0;
+    int bits = 0;
+
+    for (char c : input)
+    {
+        int value;
+        if (c >= 'A' && c <= 'Z')
+            value = c - 'A';
+        else if (c >= 'a' && c <= 'z')
+            value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9')
+            value = c - '0' + 52;
+        else if (c == '+' || c == '-')
+            value = 62;
+        else if (c == '/' || c == '_')
+            value = 63;
+        else if (c == '=')
+            break;
+        else
+            throw std::invalid_argument("Invalid base64 character");
+
+        buffer = (buffer << 6) | value;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out.push_back(static_cast<char>(buffer >> bits));
+        }
+    }
+    return out;
+}
+
+std::string encodeBase64(std::string_view input)
+{
+    static constexpr char kAlphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string out;
+    out.reserve((input.length() + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 3 <= input.length(); i += 3)
+    {
+        uint32_t group = static_cast<uint8_t>(input[i]) << 16
+            | static_cast<uint8_t>(input[i + 1]) << 8 | static_cast<uint8_t>(input[i + 2]);
+        out.push_back(kAlphabet[group >> 18]);
+        out.push_back(kAlphabet[(group >> 12) & 0x3F]);
+        out.push_back(kAlphabet[(group >> 6) & 0x3F]);
+        out.push_back(kAlphabet[group & 0x3F]);
+    }
+
+    size_t rest = input.length() - i;
+    if (rest > 0)
+    {
+        uint32_t group = static_cast<uint8_t>(input[i]) << 16;
+        if (rest == 2)
+            group |= static_cast<uint8_t>(input[i + 1]) << 8;
+        out.push_back(kAlphabet[group >> 18]);
+        out.push_back(kAlphabet[(group >> 12) & 0x3F]);
+        out.push_back(rest == 2 ? kAlphabet[(group >> 6) & 0x3F] : '=');
+        out.push_back('=');
+    }
+    return out;
+}
+
+std::string sha1(std::string_view input)
+{
+    uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    auto rotl = [](uint32_t value, int bits) { return (value << bits) | (value >> (32 - bits)); };
+
+    // Message, 0x80, zero padding, then the bit length in 64 bits big-endian
+    std::string message(input);
+    uint64_t bitLength = static_cast<uint64_t>(input.length()) * 8;
+    message.push_back(static_cast<char>(0x80));
+    while (message.length() % 64 != 56)
+        message.push_back('\0');
+    for (int shift = 56; shift >= 0; shift -= 8)
+        message.push_back(static_cast<char>(bitLength >> shift));
+
+    for (size_t block = 0; block < message.length(); block += 64)
+    {
+        uint32_t w[80];
+        for (int t = 0; t < 16; t++)
+        {
+            const auto* p = reinterpret_cast<const uint8_t*>(message.data() + block + t * 4);
+            w[t] = uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+        }
+        for (int t = 16; t < 80; t++)
+            w[t] = rotl(w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16], 1);
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        for (int t = 0; t < 80; t++)
+        {
+            uint32_t f, k;
+            if (t < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+            else if (t < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+            else if (t < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+
+            uint32_t temp = rotl(a, 5) + f + e + k + w[t];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+
+    std::string digest(20, '\0');
+    for (int i = 0; i < 20; i++)
+        digest[i] = static_cast<char>(state[i / 4] >> (24 - 8 * (i % 4)));
+    return digest;
+}
+
+Sha256Digest sha256(std::string_view input)
+{
+    static constexpr uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    auto rotr = [](uint32_t value, int bits) { return (value >> bits) | (value << (32 - bits)); };
+
+    auto compressBlock = [&](const uint8_t* p)
+    {
+        uint32_t w[64];
+        for (int t = 0; t < 16; t++, p += 4)
+            w[t] = uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+        for (int t = 16; t < 64; t++)
+        {
+            uint32_t s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int t = 0; t < 64; t++)
+        {
+            uint32_t temp1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[t] + w[t];
+            uint32_t temp2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + temp2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    };
+
+    // Whole blocks straight from the input, bodies can be large. Only the
+    // tail is copied, followed by 0x80, zero padding and the bit length.
+    const auto* data = reinterpret_cast<const uint8_t*>(input.data());
+    size_t whole = input.length() / 64 * 64;
+    for (size_t block = 0; block < whole; block += 64)
+        compressBlock(data + block);
+
+    uint8_t tail[128] = {};
+    size_t rest = input.length() - whole;
+    std::memcpy(tail, data + whole, rest);
+    tail[rest] = 0x80;
+    size_t tailLength = rest < 56 ? 64 : 128;
+    uint64_t bitLength = static_cast<uint64_t>(input.length()) * 8;
+    for (int i = 0; i < 8; i++)
+        tail[tailLength - 1 - i] = static_cast<uint8_t>(bitLength >> (8 * i));
+    for (size_t block = 0; block < tailLength; block += 64)
+        compressBlock(tail + block);
+
+    Sha256Digest digest;
+    for (int i = 0; i < 32; i++)
+        digest[i] = static_cast<uint8_t>(state[i / 4] >> (24 - 8 * (i % 4)));
+    return digest;
+}
+
+namespace
+{
+
+// Plain decimal, as in Range specs
+bool parseSize(std::string_view string, size_t& value)
+{
+    if (string.empty() || string.length() > 19)
+        return false;
+
+    value = 0;
+    for (char c : string)
+    {
+        if (c < '0' || c > '9')
+            return false;
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+}
+
+bool parseRange(std::string_view header, size_t length, std::vector<ByteRange>& ranges)
+{
+    static constexpr size_t kMaxRanges = 16;
+    static constexpr std::string_view kUnit = "bytes=";
+
+    ranges.clear();
+    header = trimWhitespace(header);
+    if (header.length() <= kUnit.length() || strncasecmp(header.data(), kUnit.data(), kUnit.length()) != 0)
+        return false;
+    header.remove_prefix(kUnit.length());
+
+    size_t count = 0;
+    while (!header.empty())
+    {
+        size_t comma = header.find(',');
+        std::string_view spec = trimWhitespace(header.substr(0, comma));
+        header = comma == std::string_view::npos ? std::string_view() : header.substr(comma + 1);
+        if (spec.empty())
+            continue;
+        if (++count > kMaxRanges)
+            return false;
+
+        size_t dash = spec.find('-');
+        if (dash == std::string_view::npos)
+            return false;
+        std::string_view firstPart = trimWhitespace(spec.substr(0, dash));
+        std::string_view lastPart = trimWhitespace(spec.substr(dash + 1));
+
+        size_t first, last;
+        if (firstPart.empty())
+        {
+            // Suffix, the final n bytes
+            size_t suffix;
+            if (!parseSize(lastPart, suffix))
+                return false;
+            if (suffix == 0 || length == 0)
+                continue;
+            first = length - std::min(suffix, length);
+            last = length - 1;
+        }
+        else
+        {
+            if (!parseSize(firstPart, first))
+                return false;
+            if (lastPart.empty())
+                last = length - 1;
+            else if (!parseSize(lastPart, last) || last < first)
+                return false;
+
+            if (first >= length)
+                continue;
+            last = std::min(last, length - 1);
+        }
+        ranges.push_back(ByteRange{first, last});
+    }
+    return count > 0;
+}
+
+std::string makeETag(std::string_view content)
+{
+    char etag[48];
+    int length = snprintf(etag, sizeof(etag), "\"%zx-%zx\"",
+        content.length(), std::hash<std::string_view>{}(content));
+    return std::string(etag, length);
+}
+
+bool matchesETag(std::string_view header, std::string_view etag, bool strong)
+{
+    header = trimWhitespace(header);
+    if (header == "*")
+        return true;
+
+    auto opaque = [](std::string_view tag)
+    {
+        return tag.starts_with("W/") ? tag.substr(2) : tag;
+    };
+    if (strong && etag.starts_with("W/"))
+        return false;
+
+    while (!header.empty())
+    {
+        size_t comma = header.find(',');
+        std::string_view tag = trimWhitespace(header.substr(0, comma));
+        header = comma == std::string_view::npos ? std::string_view() : header.substr(comma + 1);
+
+        if (strong ? tag == etag : opaque(tag) == opaque(etag))
+            return true;
+    }
+    return false;
+}
+
+std::string formatHttpDate(std::time_t time)
+{
+    std::tm tm;
+    gmtime_r(&time, &tm);
+    char date[32];
+    size_t length = std::strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(date, length);
+}
+
+std::time_t parseHttpDate(std::string_view date)
+{
+    std::string string(trimWhitespace(date));
+    std::tm tm{};
+    const char* end = strptime(string.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end != '\0')
+        return -1;
+    return timegm(&tm);
+}
+
+std::string percentDecode(std::string_view input, bool plusAsSpace)
+{
+    auto hexValue = [](char c) -> int
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    };
+
+    std::string out;
+    out.reserve(input.length());
+    for (size_t i = 0; i < input.length(); i++)
+    {
+        char c = input[i];
+        int high, low;
+        if (c == '%' && i + 2 < input.length()
+            && (high = hexValue(input[i + 1])) >= 0 && (low = hexValue(input[i + 2])) >= 0)
+        {
+            out.push_back(static_cast<char>(high << 4 | low));
+            i += 2;
+        }
+        else if (c == '+' && plusAsSpace)
+            out.push_back(' ');
+        else
+            out.push_back(c);
+    }
+    return out;
+}
+
 }
\ No newline at end of file
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <array>
 #include <string>
+#include <string_view>
+#include <cstdint>
+#include <vector>
+#include <ctime>
 
 #include "Enum.hpp"
 
@@ -14,13 +19,83 @@ namespace http::utils
 std::string toString(Method method);
 std::string toString(Version version);
 std::string toString(StatusCode code);
-Method toMethod(const std::string& string);
-Version toVersion(const std::string& string);
+std::string toString(ContentEncoding encoding);
+Method toMethod(std::string_view string);
+Version toVersion(std::string_view string);
 
 // MessageInterface Helpers
 std::string toString(const Request& request);
 std::string toString(const Response& response, bool sendBody = true);
-Request toRequest(const std::string& string);
+Request toRequest(std::string_view string);
+
+// Optional whitespace around header values (RFC 9110, section 5.6.3)
+std::string_view trimWhitespace(std::string_view string);
+
+// Serialize straight into an output buffer, without an intermediate string.
+// Adds a Date header unless the response has one.
+void appendResponse(std::string& out, const Response& response, bool sendBody = true);
+
+// "HTTP/1.1 200 OK\r\n", pre-rendered for every StatusCode in HTTP/1.0 and
+// HTTP/1.1. Empty for other versions.
+std::string_view statusLine(Version version, StatusCode code);
+
+// The current IMF-fixdate, alone and as a "Date: ...\r\n" line. Each thread
+// renders it again at most once per second.
+std::string_view currentHttpDate();
+std::string_view dateHeaderLine();
+
+// Decimal digits written in place at the end of out
+void appendNumber(std::string& out, uint64_t value);
+
+// Parse into a request that was constructed with the desired allocator
+void parseRequest(std::string_view string, Request& request);
 Response toResponse(const std::string& string);
 
+// Length of the first complete request in data (headers + Content-Length body), 0 if incomplete.
+// Also 0 with error set if the framing is ambiguous or unsupported: BadRequest for
+// malformed, overflowing or conflicting Content-Length or malformed header lines,
+// NotImplemented for Transfer-Encoding. The connection must then be closed.
+size_t requestLength(const char* data, size_t length, StatusCode& error);
+// Length of the first request's head (request line and headers), 0 until it is
+// complete, and the Content-Length of its body. Errors as for requestLength().
+size_t requestHeadLength(const char* data, size_t length, size_t& bodyLength, StatusCode& error);
+
+// Conditional and Range Helpers
+struct ByteRange
+{
+    size_t first;
+    size_t last;    // inclusive
+};
+
+// Resolve a "bytes=" Range header against a body of length bytes. Returns
+// false if the header must be ignored (malformed, another unit, too many
+// ranges). Unsatisfiable ranges are dropped, so true with no ranges is a 416.
+bool parseRange(std::string_view header, size_t length, std::vector<ByteRange>& ranges);
+
+// Strong validator for a body, e.g. "1f4-9c0a5e31d2b4f817"
+std::string makeETag(std::string_view content);
+
+// If-None-Match (weak comparison) or If-Range (strong) against an entity tag
+bool matchesETag(std::string_view header, std::string_view etag, bool strong);
+
+// IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT". parseHttpDate returns -1 if invalid.
+std::string formatHttpDate(std::time_t time);
+std::time_t parseHttpDate(std::string_view date);
+
+// Encoding Helpers
+std::string decodeBase64(std::string_view input);  // accepts base64 and base64url
+std::string encodeBase64(std::string_view input);  // padded, standard alphabet
+
+// %XX sequences decoded, malformed ones kept as they are. With plusAsSpace,
+// '+' becomes ' ' as in query strings.
+std::string percentDecode(std::string_view input, bool plusAsSpace);
+
+// 20-byte digest, for handshakes such as Sec-WebSocket-Accept, not for security
+std::string sha1(std::string_view input);
+
+// Identifies a body by its content where a collision must not be forgeable,
+// e.g. as a cache key
+using Sha256Digest = std::array<uint8_t, 32>;
+Sha256Digest sha256(std::string_view input);
+
 }
\ No newline at end of file
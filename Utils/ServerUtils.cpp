@@ -1,3 +1,20 @@
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <cstddef>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#elif defined(__FreeBSD__)
+#include <pthread_np.h>
+#include <sys/cpuset.h>
+#endif
+
+#ifdef HAS_NUMA
+#include <numa.h>
+#endif
+
 #include "ServerUtils.hpp"
 
 namespace server::utils
@@ -28,85 +45,169 @@ sockaddr_in createSockAddr(const std::string& host, int port)
     return addr;
 }
 
-void registerKqFd(int kqfd, int fd, bool wantsRead, bool wantsWrite, void* udata)
+socklen_t createSockAddr(const std::string& address, sockaddr_storage& addr)
 {
-    struct kevent changeList[2];
-    int nChanges = 0;
-
-    if (wantsRead)
-        EV_SET(
-            &changeList[nChanges++],    // ptr to new kevent slot
-            fd,                         // fd to monitor
-            EVFILT_READ,                // 'readable' filter
-            EV_ADD | EV_ENABLE,         // add if missing
-            0,                          // no filter-specific flags
-            0,                          // no filter-specific data
-            udata                       // udata
-        );
-    
-    if (wantsWrite)
-        EV_SET(
-            &changeList[nChanges++],
-            fd,
-            EVFILT_WRITE,               // 'writable' filter
-            EV_ADD | EV_ENABLE,
-            0,
-            0,
-            udata
-        );
-
-    if (nChanges > 0)
-        if (kevent(kqfd, changeList, nChanges, nullptr, 0, nullptr) < 0)
-            throw std::runtime_error("kevent register failed");
-        
-    spdlog::info(
-        "[fd {}] Client registered for {} with worker thread fd {}",
-        fd, wantsRead ? "reads" : "writes", kqfd);
+    std::memset(&addr, 0, sizeof(addr));
+
+    if (address.starts_with("unix:"))
+    {
+        auto* un = reinterpret_cast<sockaddr_un*>(&addr);
+        std::string path = address.substr(5);
+        if (path.empty() || path.length() >= sizeof(un->sun_path))
+            throw std::invalid_argument("Invalid Unix socket path in '" + address + "'");
+
+        un->sun_family = AF_UNIX;
+        std::memcpy(un->sun_path, path.c_str(), path.length() + 1);
+        return offsetof(sockaddr_un, sun_path) + path.length() + 1;
+    }
+
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        throw std::invalid_argument("Missing port in '" + address + "'");
+
+    std::string host = address.substr(0, colon);
+    int port = -1;
+    try
+    {
+        size_t parsed = 0;
+        port = std::stoi(address.substr(colon + 1), &parsed);
+        if (parsed != address.length() - colon - 1)
+            port = -1;
+    }
+    catch (const std::exception&)
+    {
+    }
+    if (port < 0 || port > 65535)
+        throw std::invalid_argument("Invalid port in '" + address + "'");
+
+    if (host.starts_with('[') && host.ends_with(']'))
+    {
+        auto* in6 = reinterpret_cast<sockaddr_in6*>(&addr);
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        if (inet_pton(AF_INET6, host.substr(1, host.length() - 2).c_str(), &in6->sin6_addr) <= 0)
+            throw std::invalid_argument("Invalid IPv6 address in '" + address + "'");
+        return sizeof(sockaddr_in6);
+    }
+
+    auto* in = reinterpret_cast<sockaddr_in*>(&addr);
+    in->sin_family = AF_INET;
+    in->sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &in->sin_addr) <= 0)
+        throw std::invalid_argument("Invalid IPv4 address in '" + address + "'");
+    return sizeof(sockaddr_in);
+}
+
+void queueKqChange(std::vector<struct kevent>& changes, int fd, int16_t filter, uint16_t flags, void* udata)
+{
+    struct kevent change;
+    EV_SET(&change, fd, filter, flags, 0, 0, udata);
+    changes.push_back(change);
 }
 
-void unregisterKqFd(int kqFd, int fd, bool read, bool write)
+void queueKqTimer(std::vector<struct kevent>& changes, uintptr_t ident, int milliseconds, void* udata)
 {
     struct kevent change;
+    EV_SET(&change, ident, EVFILT_TIMER, EV_ADD | EV_ONESHOT, 0, milliseconds, udata);
+    changes.push_back(change);
+}
+
+void discardKqChanges(std::vector<struct kevent>& changes, int fd)
+{
+    std::erase_if(changes, [fd](const struct kevent& change)
+    {
+        return change.ident == static_cast<uintptr_t>(fd) && change.filter != EVFILT_TIMER;
+    });
+}
+
+void registerKqUser(int kqFd, uintptr_t ident)
+{
+    struct kevent change;
+    EV_SET(&change, ident, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+    if (kevent(kqFd, &change, 1, nullptr, 0, nullptr) < 0)
+        throw std::runtime_error("kevent register user event failed");
+}
 
-    // Ignore ENOENT, when we try to delete a filter that doesn't exist
+void triggerKqUser(int kqFd, uintptr_t ident)
+{
+    struct kevent change;
+    EV_SET(&change, ident, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
+    if (kevent(kqFd, &change, 1, nullptr, 0, nullptr) < 0)
+        spdlog::error("[fd {}] kevent trigger user event failed: {}", kqFd, strerror(errno));
+}
 
-    if (read)
+bool pinCurrentThread(int cpu)
+{
+#if defined(__APPLE__)
+    // Threads with different tags are spread over different cores
+    thread_affinity_policy_data_t policy{ cpu + 1 };
+    return thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY,
+        reinterpret_cast<thread_policy_t>(&policy), THREAD_AFFINITY_POLICY_COUNT) == KERN_SUCCESS;
+#elif defined(__FreeBSD__)
+    cpuset_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+bool enableBusyPoll(int fd, int microseconds)
+{
+#ifdef SO_BUSY_POLL
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &microseconds, sizeof(microseconds)) < 0)
+        return false;
+#ifdef SO_PREFER_BUSY_POLL
+    // Best effort, older kernels only have SO_BUSY_POLL
+    int prefer = 1;
+    setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer));
+#endif
+    return true;
+#else
+    (void)fd;
+    (void)microseconds;
+    return false;
+#endif
+}
+
+void* allocateLocal(size_t bytes)
+{
+#ifdef HAS_NUMA
+    if (numa_available() >= 0)
     {
-        EV_SET(&change,
-                fd,
-                EVFILT_READ,
-                EV_DELETE,
-                0,
-                0,
-                nullptr);
-        
-        if (kevent(kqFd, &change, 1, nullptr, 0, nullptr) < 0)
-        {
-            if (errno != ENOENT)
-                throw std::runtime_error("kevent unregister read failed");
-        }
-        else
-            spdlog::info("[fd {}] Unregistered read notifications for worker fd {}", fd, kqFd);
+        void* ptr = numa_alloc_local(bytes);
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+        return ptr;
     }
+#endif
+    void* ptr = std::malloc(bytes);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+
+    // Fault the pages in from this thread
+    std::memset(ptr, 0, bytes);
+    return ptr;
+}
 
-    if (write)
+void freeLocal(void* ptr, size_t bytes)
+{
+#ifdef HAS_NUMA
+    if (numa_available() >= 0)
     {
-        EV_SET(&change,
-                fd,
-                EVFILT_WRITE,
-                EV_DELETE,
-                0,
-                0,
-                nullptr);
-        
-        if (kevent(kqFd, &change, 1, nullptr, 0, nullptr) < 0)
-        {
-            if (errno != ENOENT)
-                throw std::runtime_error("kevent unregister write failed");
-        }
-        else
-            spdlog::info("[fd {}] Unregistered write notifications for worker fd {}", fd, kqFd);
-    }    
+        numa_free(ptr, bytes);
+        return;
+    }
+#endif
+    (void)bytes;
+    std::free(ptr);
 }
 
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <chrono>
 #include <csignal>
 #include <sys/types.h>
@@ -12,6 +13,7 @@
 #include <fcntl.h> // fcntl
 #include <arpa/inet.h> // htons(), inet_pton()
 #include <netinet/in.h> // sockaddr_in
+#include <sys/socket.h> // sockaddr_storage
 #include <spdlog/spdlog.h>
 
 namespace server::utils
@@ -19,7 +21,33 @@ namespace server::utils
 
 void setNonBlocking(int fd);
 sockaddr_in createSockAddr(const std::string& host, int port);
-void registerKqFd(int kqfd, int fd, bool read, bool write, void* udata);
-void unregisterKqFd(int kqFd, int fd, bool read, bool write); 
+
+// "host:port", "[ipv6]:port" or "unix:/path" into addr, returns its length.
+// Hosts are numeric, throws std::invalid_argument otherwise.
+socklen_t createSockAddr(const std::string& address, sockaddr_storage& addr);
+
+// Batched changes, the caller submits them as the changelist of its next kevent() wait
+void queueKqChange(std::vector<struct kevent>& changes, int fd, int16_t filter, uint16_t flags, void* udata);
+// One-shot EVFILT_TIMER, re-adding an armed timer restarts it
+void queueKqTimer(std::vector<struct kevent>& changes, uintptr_t ident, int milliseconds, void* udata);
+// Changes for the fd's filters, not timers: those outlive close() and are deleted explicitly
+void discardKqChanges(std::vector<struct kevent>& changes, int fd);
+
+// EVFILT_USER events, for waking a worker from another thread
+void registerKqUser(int kqFd, uintptr_t ident);
+void triggerKqUser(int kqFd, uintptr_t ident);
+
+// Pin the calling thread to a CPU, returns false if the platform refused.
+// macOS only takes this as an affinity hint (and ignores it on Apple silicon).
+bool pinCurrentThread(int cpu);
+
+// SO_BUSY_POLL (and SO_PREFER_BUSY_POLL) on a socket, where the platform has
+// them. Returns false if unsupported or refused, e.g. without CAP_NET_ADMIN.
+bool enableBusyPoll(int fd, int microseconds);
+
+// Memory on the calling thread's NUMA node: libnuma when available,
+// otherwise zeroed here so first-touch places the pages locally
+void* allocateLocal(size_t bytes);
+void freeLocal(void* ptr, size_t bytes);
 
 }
\ No newline at end of file
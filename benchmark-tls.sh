@@ -0,0 +1,25 @@
+#!/bin/sh
+
+# Handshake rate and encrypted throughput of a local HTTPS server, e.g.
+#   ./main --bind 127.0.0.1:8443 --tls-cert cert.pem --tls-key key.pem
+# Pass the path of a large response to measure bulk throughput.
+
+HOST=${HOST:-127.0.0.1:8443}
+URL_PATH=${1:-/hello}
+
+ulimit -n 65536
+
+if ! nc -z ${HOST%:*} ${HOST#*:}; then
+    echo "Error: Server not running on $HOST"
+    exit 1
+fi
+
+echo "Full handshakes:"
+openssl s_time -connect $HOST -new -time 10 | grep "real seconds"
+
+# s_time does not wait for TLS 1.3 tickets, resumption is measured on TLS 1.2
+echo "Resumed handshakes (session tickets):"
+openssl s_time -connect $HOST -reuse -tls1_2 -time 10 | grep "real seconds"
+
+echo "Encrypted throughput:"
+wrk -t4 -c100 -d30s --latency https://$HOST$URL_PATH
\ No newline at end of file
@@ -12,4 +12,17 @@ if ! nc -z localhost 8080; then
     exit 1
 fi
 
-wrk -t10 -c10k -d30s --latency http://127.0.0.1:8080/hello
\ No newline at end of file
+CONNECTIONS=10000
+SERVER_PID=$(pgrep -x main | head -1)
+IDLE_RSS=$(ps -o rss= -p "$SERVER_PID")
+
+wrk -t10 -c$CONNECTIONS -d30s --latency http://127.0.0.1:8080/hello &
+WRK_PID=$!
+
+# Resident memory per connection, sampled mid-run
+sleep 15
+LOADED_RSS=$(ps -o rss= -p "$SERVER_PID")
+wait $WRK_PID
+
+echo "Server RSS: ${IDLE_RSS} KB idle, ${LOADED_RSS} KB with $CONNECTIONS connections," \
+    "$(( (LOADED_RSS - IDLE_RSS) * 1024 / CONNECTIONS )) bytes per connection"
\ No newline at end of file
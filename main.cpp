@@ -3,17 +3,49 @@
 #include <algorithm>
 #include <cctype>
 #include "Server.hpp"
+#include "ServerBuilder.hpp"
+#include "ServerConfig.hpp"
 #include "Logger.hpp"
 
-int main()
+int main(int argc, char* argv[])
 {
+    ServerConfig config;
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg(argv[i]);
+            if (arg == "--help" || arg == "-h")
+            {
+                std::cout << ServerConfig::usage(argv[0]);
+                return 0;
+            }
+        }
+        config = ServerConfig::fromArgs(argc, argv);
+    }
+    catch (const std::invalid_argument& ex)
+    {
+        std::cerr << ex.what() << "\n" << ServerConfig::usage(argv[0]);
+        return 1;
+    }
+
     try
     {
         Logger::Initialize("logs/server.log", 1024 * 1024 * 100, 10);
-        spdlog::info("Creating HTTPServer");
-        HTTPServer server("127.0.0.1", 8080);
+        for (const ServerConfig::ListenerConfig& listener : config.listenAddresses())
+            spdlog::info("Creating HTTPServer on {}", listener.address);
+        auto server = ServerBuilder(config)
+            .route("/hello", Method::GET, [](const Request&)
+            {
+                Response res(StatusCode::Ok);
+                res.setContent("Hello, Optiver!");
+                return res;
+            })
+            // Every message on /ws is pushed to all of its subscribers, on all workers
+            .broadcastWebSocket("/ws")
+            .build();
         spdlog::info("Calling server.start()");
-        server.start();
+        server->start();
         std::cout << "Enter \"quit\" to stop server." << std::endl;
 
         std::string command;
@@ -38,7 +70,7 @@ int main()
         }
 
         std::cout << "quit command entered. Stopping the web server." << std::endl;
-        server.stop();
+        server->stop();
         spdlog::info("Main thread detected shutdown");
     }
     catch (const std::exception& ex)